@@ -0,0 +1,68 @@
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bptree/block_manager.h"
+#include "gflags/gflags.h"
+#include "helper.h"
+#include "spdlog/spdlog.h"
+
+DEFINE_string(db_name, "example_db", "db name");
+DEFINE_uint64(key_size, 10, "key size");
+DEFINE_uint64(value_size, 100, "value size");
+DEFINE_uint64(kv_count, 1000000, "kv count");
+DEFINE_uint64(cache_size, 1280, "block cache size (16kb each block)");
+DEFINE_uint64(max_thread_count, 8, "read threads count: 1, 2, 4 ... max_thread_count");
+
+// 读取由bptree_write生成的db，每轮使用不同的线程数并发随机读取全部kv，统计吞吐量
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  Timer tm;
+  bptree::BlockManagerOption option;
+  option.db_name = FLAGS_db_name;
+  option.neflag = bptree::NotExistFlag::ERROR;
+  option.eflag = bptree::ExistFlag::SUCC;
+  option.mode = bptree::Mode::R;
+  option.key_size = FLAGS_key_size;
+  option.value_size = FLAGS_value_size;
+  option.create_check_point_per_ops = 10000000;
+  option.cache_size = FLAGS_cache_size;
+  bptree::BlockManager manager(option);
+
+  manager.PrintOption();
+
+  auto kvs = ConstructRandomKv(FLAGS_kv_count, FLAGS_key_size, FLAGS_value_size);
+
+  for (uint64_t thread_count = 1; thread_count <= FLAGS_max_thread_count; thread_count *= 2) {
+    std::atomic<bool> check_fail(false);
+    std::vector<std::thread> threads;
+    BPTREE_LOG_INFO("begin to get {} kvs with {} threads", FLAGS_kv_count, thread_count);
+    tm.Start();
+    for (uint64_t t = 0; t < thread_count; ++t) {
+      threads.emplace_back([&, t]() {
+        for (size_t i = t; i < kvs.size(); i += thread_count) {
+          auto v = manager.Get(kvs[i].key);
+          if (v != kvs[i].value) {
+            check_fail = true;
+            return;
+          }
+        }
+      });
+    }
+    for (auto& each : threads) {
+      each.join();
+    }
+    auto ms = tm.End();
+    if (check_fail == true) {
+      BPTREE_LOG_ERROR("get check fail");
+      return -1;
+    }
+    BPTREE_LOG_INFO("get {} kvs with {} threads use {} ms, {} ops/s", FLAGS_kv_count, thread_count, ms,
+                    ms == 0 ? 0 : static_cast<uint64_t>(FLAGS_kv_count * 1000 / ms));
+  }
+
+  manager.PrintCacheInfo();
+  manager.PrintMetricSet();
+  return 0;
+}
@@ -12,7 +12,20 @@ DEFINE_uint64(key_size, 10, "key size");
 DEFINE_uint64(value_size, 100, "value size");
 DEFINE_uint64(kv_count, 1000000, "kv count");
 DEFINE_uint64(cache_size, 1280, "block cache size (16kb each block)");
-DEFINE_int32(random_or_sync, 0, "randomly read (0) or seq read (1) or half_seq(2)");
+DEFINE_uint64(inner_block_cache_size, 0, "blocks reserved for inner blocks in the block cache");
+DEFINE_int32(random_or_sync, 0, "randomly read (0) or seq read (1) or half_seq(2) or scan all kvs with GetRange (3)");
+DEFINE_uint64(multi_get_batch, 0, "if not 0, randomly read with MultiGet, each call gets multi_get_batch keys");
+DEFINE_bool(io_uring, false, "batch block io with io_uring");
+DEFINE_bool(direct_io, false, "open the db file with O_DIRECT, blocks are only cached in the block cache");
+DEFINE_uint64(io_queue_depth, 32, "io_uring queue depth");
+DEFINE_uint64(readahead_blocks, 0,
+              "leaf blocks prefetched ahead of a GetRange scan, loaded synchronously in batches with --io_uring, "
+              "0 to disable");
+DEFINE_bool(key_filter, false, "skip the tree for keys that are certainly absent with a cuckoo filter");
+DEFINE_bool(huge_page, false, "back the block buffer pool with huge pages");
+DEFINE_uint64(row_cache_bytes, 0, "row cache capacity in bytes, 0 to disable");
+DEFINE_bool(mmap, false, "map the db file and let loaded blocks reference the mapped pages");
+DEFINE_int32(get_api, 0, "use Get(key) (0) or Get(key, &value) with a reused buffer (1) or GetPinned (2)");
 
 int main(int argc, char* argv[]) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
@@ -26,6 +39,15 @@ int main(int argc, char* argv[]) {
   option.value_size = FLAGS_value_size;
   option.create_check_point_per_ops = 10000000;
   option.cache_size = FLAGS_cache_size;
+  option.inner_block_cache_size = FLAGS_inner_block_cache_size;
+  option.readahead_blocks = FLAGS_readahead_blocks;
+  option.io_engine = FLAGS_io_uring ? bptree::IoEngine::IO_URING : bptree::IoEngine::SYNC;
+  option.io_queue_depth = FLAGS_io_queue_depth;
+  option.direct_io = FLAGS_direct_io;
+  option.enable_key_filter = FLAGS_key_filter;
+  option.mmap_read_only = FLAGS_mmap;
+  option.buffer_pool_huge_page = FLAGS_huge_page;
+  option.row_cache_bytes = FLAGS_row_cache_bytes;
   bptree::BlockManager manager(option);
 
   manager.PrintOption();
@@ -41,24 +63,64 @@ int main(int argc, char* argv[]) {
   }
   FisherYatesAlg(indexs);
 
+  std::string buf;
+  auto check = [&](const std::string& key, const std::string& value) -> bool {
+    if (FLAGS_get_api == 1) {
+      manager.Get(key, &buf);
+      return buf == value;
+    } else if (FLAGS_get_api == 2) {
+      return manager.GetPinned(key).Value() == value;
+    }
+    return manager.Get(key) == value;
+  };
+
   BPTREE_LOG_INFO("begin to get {} kvs", FLAGS_kv_count);
   tm.Start();
-  if (FLAGS_random_or_sync == 0) {
+  if (FLAGS_multi_get_batch != 0) {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < kvs.size(); i += FLAGS_multi_get_batch) {
+      keys.clear();
+      for (size_t j = i; j < std::min<size_t>(kvs.size(), i + FLAGS_multi_get_batch); ++j) {
+        keys.push_back(kvs[j].key);
+      }
+      auto values = manager.MultiGet(keys);
+      for (size_t j = 0; j < values.size(); ++j) {
+        if (values[j] != kvs[i + j].value) {
+          BPTREE_LOG_ERROR("get check fail");
+          return -1;
+        }
+      }
+    }
+  } else if (FLAGS_random_or_sync == 0) {
     for (auto& each : kvs) {
-      auto v = manager.Get(each.key);
-      if (v != each.value) {
+      if (check(each.key, each.value) == false) {
         BPTREE_LOG_ERROR("get check fail");
         return -1;
       }
     }
   } else if (FLAGS_random_or_sync == 1) {
     for (auto& each : seq_kvs) {
-      auto v = manager.Get(each.key);
-      if (v != each.value) {
+      if (check(each.key, each.value) == false) {
         BPTREE_LOG_ERROR("get check fail");
         return -1;
       }
     }
+  } else if (FLAGS_random_or_sync == 3) {
+    size_t index = 0;
+    bool succ = true;
+    manager.GetRange(seq_kvs[0].key, [&](const bptree::Entry& entry) -> bptree::GetRangeOption {
+      if (index >= seq_kvs.size() || entry.key_view != seq_kvs[index].key ||
+          entry.value_view != seq_kvs[index].value) {
+        succ = false;
+        return bptree::GetRangeOption::STOP;
+      }
+      ++index;
+      return bptree::GetRangeOption::SKIP;
+    });
+    if (succ == false || index != seq_kvs.size()) {
+      BPTREE_LOG_ERROR("get check fail");
+      return -1;
+    }
   } else {
     for (int i = 0; i < 1000; ++i) {
       int base_index = indexs[i];
@@ -66,8 +128,7 @@ int main(int argc, char* argv[]) {
       FisherYatesAlg(edge_indexs);
       for (int j = 0; j < 1000; ++j) {
         int index = base_index * 1000 + edge_indexs[j];
-        auto v = manager.Get(seq_kvs[index].key);
-        if (v != seq_kvs[index].value) {
+        if (check(seq_kvs[index].key, seq_kvs[index].value) == false) {
           BPTREE_LOG_ERROR("get check fail");
           return -1;
         }
@@ -13,7 +13,13 @@ DEFINE_uint64(value_size, 100, "value size");
 DEFINE_uint64(kv_count, 1000000, "kv count");
 DEFINE_uint64(cache_size, 1280, "block cache size (16kb each block)");
 DEFINE_bool(sync_per_write, false, "sync per write");
+DEFINE_uint64(group_commit_batch_size, 16, "number of concurrent commits shared by one wal sync");
+DEFINE_uint64(group_commit_max_wait_us, 0, "max time (us) the group commit leader waits for the batch to fill");
+DEFINE_uint64(wal_buffer_size, 1024 * 1024, "wal buffer size in bytes, drained by a background writer thread");
 DEFINE_bool(turn_off_double_write, false, "turn off double write");
+DEFINE_bool(io_uring, false, "batch block io with io_uring");
+DEFINE_bool(direct_io, false, "open the db file with O_DIRECT, blocks are only cached in the block cache");
+DEFINE_uint64(io_queue_depth, 32, "io_uring queue depth");
 DEFINE_int32(random_or_sync, 0, "randomly write (0) or seq write (1)");
 
 int main(int argc, char* argv[]) {
@@ -29,7 +35,13 @@ int main(int argc, char* argv[]) {
   option.create_check_point_per_ops = 10000000;
   option.cache_size = FLAGS_cache_size;
   option.sync_per_write = FLAGS_sync_per_write;
+  option.group_commit_batch_size = FLAGS_group_commit_batch_size;
+  option.group_commit_max_wait_us = FLAGS_group_commit_max_wait_us;
+  option.wal_buffer_size = FLAGS_wal_buffer_size;
   option.double_write_turn_off = FLAGS_turn_off_double_write;
+  option.io_engine = FLAGS_io_uring ? bptree::IoEngine::IO_URING : bptree::IoEngine::SYNC;
+  option.io_queue_depth = FLAGS_io_queue_depth;
+  option.direct_io = FLAGS_direct_io;
   bptree::BlockManager manager(option);
 
   manager.PrintOption();
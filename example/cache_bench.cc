@@ -0,0 +1,64 @@
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bptree/cache.h"
+#include "gflags/gflags.h"
+#include "helper.h"
+#include "spdlog/spdlog.h"
+
+DEFINE_uint64(capacity, 1024, "cache capacity");
+DEFINE_uint64(key_count, 4096, "keys are chosen from [0, key_count)");
+DEFINE_uint64(op_count, 1000000, "get operations per thread");
+DEFINE_uint64(max_thread_count, 8, "threads count: 1, 2, 4 ... max_thread_count");
+DEFINE_uint64(shard_count, 16, "shard count of the sharded cache");
+
+// 每个线程随机Get（未命中时GetOrInsert）并持有一小段时间，模拟BlockManager访问block cache的模式
+static double RunBench(bptree::ShardedCache<uint32_t, uint64_t>& cache, uint64_t thread_count) {
+  std::vector<std::thread> threads;
+  Timer tm;
+  tm.Start();
+  for (uint64_t t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&cache, t]() {
+      uint32_t seed = static_cast<uint32_t>(t) + 1;
+      uint64_t sum = 0;
+      for (uint64_t i = 0; i < FLAGS_op_count; ++i) {
+        uint32_t key = rand_r(&seed) % FLAGS_key_count;
+        auto wrapper = cache.Get(key);
+        if (wrapper.Exist() == false) {
+          wrapper = cache.GetOrInsert(key, std::unique_ptr<uint64_t>(new uint64_t(key)));
+        }
+        sum += wrapper.Get();
+      }
+      if (sum == 0) {
+        BPTREE_LOG_WARN("unexpected sum");
+      }
+    });
+  }
+  for (auto& each : threads) {
+    each.join();
+  }
+  return tm.End();
+}
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  for (uint64_t thread_count = 1; thread_count <= FLAGS_max_thread_count; thread_count *= 2) {
+    for (auto policy : {bptree::CachePolicy::LRU, bptree::CachePolicy::CLOCK, bptree::CachePolicy::TWO_QUEUE}) {
+      for (uint64_t shard_count : {uint64_t(1), FLAGS_shard_count}) {
+        bptree::ShardedCache<uint32_t, uint64_t> cache(FLAGS_capacity, shard_count, policy);
+        std::atomic<uint64_t> evict_count(0);
+        cache.SetFreeNotify([&evict_count](const uint32_t&, uint64_t&) { evict_count.fetch_add(1); });
+        double ms = RunBench(cache, thread_count);
+        uint64_t total_op = FLAGS_op_count * thread_count;
+        BPTREE_LOG_INFO("threads {}, policy {}, shards {} : {} ops use {} ms, {} ops/s, evict {}", thread_count,
+                        bptree::CachePolicyStr(policy), cache.GetShardCount(), total_op, ms,
+                        ms == 0 ? 0 : static_cast<uint64_t>(total_op * 1000 / ms), evict_count.load());
+        cache.Clear();
+      }
+    }
+  }
+  return 0;
+}
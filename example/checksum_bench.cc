@@ -0,0 +1,50 @@
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "bptree/block.h"
+#include "bptree/checksum.h"
+#include "crc32.h"
+#include "gflags/gflags.h"
+#include "helper.h"
+#include "spdlog/spdlog.h"
+
+DEFINE_uint64(buf_size, bptree::block_size, "bytes of each checksum, default to the block size");
+DEFINE_uint64(buf_count, 64, "count of buffers, checksum them in turn");
+DEFINE_uint64(total_mb, 4096, "total MB to checksum for each implementation");
+
+// 依次对buf_count个buf计算校验码，返回MB/s
+template <typename Func>
+static double RunBench(const std::vector<std::string>& bufs, const Func& func) {
+  uint64_t round = FLAGS_total_mb * 1024 * 1024 / FLAGS_buf_size;
+  uint64_t sum = 0;
+  Timer tm;
+  tm.Start();
+  for (uint64_t i = 0; i < round; ++i) {
+    const std::string& buf = bufs[i % bufs.size()];
+    sum += func(buf.data(), buf.size());
+  }
+  double ms = tm.End();
+  if (sum == 0) {
+    BPTREE_LOG_WARN("unexpected checksum");
+  }
+  return ms == 0 ? 0 : double(round * FLAGS_buf_size) / 1024 / 1024 * 1000 / ms;
+}
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  std::vector<std::string> bufs;
+  for (uint64_t i = 0; i < FLAGS_buf_count; ++i) {
+    bufs.push_back(ConstructRandomStr(FLAGS_buf_size));
+  }
+  BPTREE_LOG_INFO("crc32c is dispatched to {}", bptree::checksum::Crc32cImplStr());
+  auto legacy = [](const char* data, size_t n) -> uint32_t { return crc32(data, n); };
+  BPTREE_LOG_INFO("crc32 (legacy)   : {} MB/s", RunBench(bufs, legacy));
+  BPTREE_LOG_INFO("crc32c portable  : {} MB/s", RunBench(bufs, bptree::checksum::Crc32cPortable));
+#if defined(__x86_64__)
+  if (bptree::checksum::Crc32cHardwareSupported() == true) {
+    BPTREE_LOG_INFO("crc32c sse4.2    : {} MB/s", RunBench(bufs, bptree::checksum::Crc32cHardware));
+  }
+#endif
+  return 0;
+}
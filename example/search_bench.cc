@@ -0,0 +1,134 @@
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bptree/block.h"
+#include "bptree/key_comparator.h"
+#include "bptree/key_search.h"
+#include "gflags/gflags.h"
+#include "helper.h"
+#include "spdlog/spdlog.h"
+
+DEFINE_uint64(value_size, 32, "value size of each kv, used to compute how many kvs a block can hold");
+DEFINE_uint64(block_count, 1024, "count of blocks, lookups are spread over them to simulate cache misses");
+DEFINE_uint64(lookup_count, 4 * 1024 * 1024, "lookup count for each case");
+
+/*
+ * 对比block内的两种查找方式：
+ * binary : 改动之前的实现，直接在buf中的key上二分查找，每次比较都通过Comparator的虚函数
+ * prefix : 先在key前缀数组上查找（二分缩小范围后使用scalar/sse4.2/avx2统计），前缀相等时再比较完整的key
+ */
+
+struct BenchBlock {
+  std::string buf;
+  std::vector<uint64_t> abbr_keys;
+  size_t key_size;
+  size_t entry_size;
+  size_t count;
+
+  std::string_view GetKey(size_t i) const { return std::string_view(&buf[i * entry_size], key_size); }
+};
+
+static size_t BinarySearch(const bptree::Comparator& cmp, const BenchBlock& block, const std::string_view& key) {
+  size_t left = 0;
+  size_t right = block.count;
+  while (left < right) {
+    size_t mid = left + (right - left) / 2;
+    if (cmp.Compare(block.GetKey(mid), key) < 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return left;
+}
+
+static size_t PrefixSearch(const bptree::Comparator& cmp, const BenchBlock& block, const std::string_view& key,
+                           bptree::search::count_less_func count_less) {
+  uint64_t abbr = cmp.AbbreviateKey(key);
+  size_t left = bptree::search::LowerBound(block.abbr_keys.data(), block.count, abbr, count_less);
+  size_t right = left;
+  if (left != block.count && block.abbr_keys[left] == abbr) {
+    right = left + bptree::search::LowerBound(&block.abbr_keys[left], block.count - left, abbr + 1, count_less);
+  }
+  while (left < right) {
+    size_t mid = left + (right - left) / 2;
+    if (cmp.Compare(block.GetKey(mid), key) < 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return left;
+}
+
+// 返回每次查找的平均耗时(ns)
+template <typename Func>
+static double RunBench(const std::vector<BenchBlock>& blocks, const std::vector<std::string>& keys,
+                       const Func& func) {
+  uint64_t sum = 0;
+  Timer tm;
+  tm.Start();
+  for (uint64_t i = 0; i < FLAGS_lookup_count; ++i) {
+    const BenchBlock& block = blocks[(i * 7919) % blocks.size()];
+    sum += func(block, keys[i % keys.size()]);
+  }
+  double ms = tm.End();
+  if (sum == 0) {
+    BPTREE_LOG_WARN("unexpected search result");
+  }
+  return ms * 1000 * 1000 / FLAGS_lookup_count;
+}
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  bptree::Comparator cmp;
+  BPTREE_LOG_INFO("key search is dispatched to {}", bptree::search::SearchImplStr());
+  for (size_t key_size : {8, 16, 32}) {
+    size_t entry_size = key_size + FLAGS_value_size;
+    size_t max_count = bptree::block_size / (entry_size + sizeof(uint16_t));
+    for (double fill : {0.25, 0.5, 1.0}) {
+      size_t count = static_cast<size_t>(max_count * fill);
+      std::vector<BenchBlock> blocks;
+      for (uint64_t b = 0; b < FLAGS_block_count; ++b) {
+        std::vector<std::string> block_keys;
+        for (size_t i = 0; i < count; ++i) {
+          block_keys.push_back(ConstructRandomStr(key_size));
+        }
+        std::sort(block_keys.begin(), block_keys.end());
+        BenchBlock block{std::string(bptree::block_size, '\0'), {}, key_size, entry_size, count};
+        for (size_t i = 0; i < count; ++i) {
+          memcpy(&block.buf[i * entry_size], block_keys[i].data(), key_size);
+          block.abbr_keys.push_back(cmp.AbbreviateKey(block_keys[i]));
+        }
+        blocks.push_back(std::move(block));
+      }
+      std::vector<std::string> keys;
+      for (size_t i = 0; i < 4096; ++i) {
+        keys.push_back(ConstructRandomStr(key_size));
+      }
+      auto binary = [&](const BenchBlock& block, const std::string& key) { return BinarySearch(cmp, block, key); };
+      BPTREE_LOG_INFO("key_size {}, fill {}, kv count {}", key_size, fill, count);
+      BPTREE_LOG_INFO("  binary         : {} ns/lookup", RunBench(blocks, keys, binary));
+      auto prefix = [&](bptree::search::count_less_func impl) {
+        return [&cmp, impl](const BenchBlock& block, const std::string& key) {
+          return PrefixSearch(cmp, block, key, impl);
+        };
+      };
+      BPTREE_LOG_INFO("  prefix scalar  : {} ns/lookup",
+                      RunBench(blocks, keys, prefix(bptree::search::detail::CountLessScalar)));
+#if defined(__x86_64__)
+      if (__builtin_cpu_supports("sse4.2")) {
+        BPTREE_LOG_INFO("  prefix sse4.2  : {} ns/lookup",
+                        RunBench(blocks, keys, prefix(bptree::search::detail::CountLessSse42)));
+      }
+      if (__builtin_cpu_supports("avx2")) {
+        BPTREE_LOG_INFO("  prefix avx2    : {} ns/lookup",
+                        RunBench(blocks, keys, prefix(bptree::search::detail::CountLessAvx2)));
+      }
+#endif
+    }
+  }
+  return 0;
+}
@@ -8,11 +8,13 @@
 #include <iostream>
 #include <limits>
 #include <new>
+#include <shared_mutex>
 #include <string>
 #include <string_view>
 #include <type_traits>
 #include <vector>
 
+#include "bptree/checksum.h"
 #include "bptree/exception.h"
 #include "bptree/log.h"
 #include "bptree/util.h"
@@ -27,10 +29,32 @@ constexpr uint32_t super_height = std::numeric_limits<uint32_t>::max();
 
 constexpr uint32_t not_free_flag = std::numeric_limits<uint32_t>::max();
 
-constexpr uint32_t linux_alignment = 512;
+// O_DIRECT要求buf、偏移和长度按照逻辑块大小对齐，4096覆盖常见的4k扇区设备
+constexpr uint32_t linux_alignment = 4096;
+
+// 采用slot目录格式的block的标识，旧版本的block在这个位置存储链表头部entry的索引值，不会等于该值
+constexpr uint32_t slotted_page_format = 0x534C5031;
 
 class BlockManager;
 
+namespace detail {
+
+// 元数据修改日志中的字段编号
+enum class MetaField : uint8_t {
+  HEIGHT,
+  KV_COUNT,
+  NEXT_FREE_INDEX,
+  PREV,
+  NEXT,
+  CURRENT_MAX_BLOCK_INDEX,
+  FREE_BLOCK_HEAD,
+  FREE_BLOCK_SIZE,
+};
+
+inline constexpr uint8_t MetaFieldToUint8T(MetaField field) { return static_cast<uint8_t>(field); }
+
+}  // namespace detail
+
 struct InsertInfo {
   enum class State { Ok, Split, Invalid };
   State state_;
@@ -108,11 +132,13 @@ class BlockBase {
   /**
    * @brief BlockBase构造函数，新建一个从磁盘导入的block时调用，index和height等在之后parse时解析得到
    * @param manager BlockManager引用
-   * @param buf 存储着磁盘数据的buf，大小需要至少为block_size
+   * @param buf 存储着磁盘数据的buf，大小需要至少为block_size，需要从BlockManager的buf池中分配
+   * @param own_buf 为false时buf不属于该block（例如只读模式下映射的文件页），析构时不释放，并且block不能被修改
    */
-  BlockBase(BlockManager& manager, char* buf) noexcept
+  BlockBase(BlockManager& manager, char* buf, bool own_buf = true) noexcept
       : manager_(manager),
         buf_(buf),
+        own_buf_(own_buf),
         dirty_(true),
         need_to_parse_(true),
         crc_(0),
@@ -126,29 +152,20 @@ class BlockBase {
    * @param index 该block的index值
    * @param height 该block的高度
    */
-  BlockBase(BlockManager& manager, uint32_t index, uint32_t height) noexcept
-      : manager_(manager),
-        buf_(nullptr),
-        dirty_(true),
-        need_to_parse_(false),
-        crc_(0),
-        index_(index),
-        height_(height),
-        change_log_number_(0) {
-    buf_ = new ((std::align_val_t)linux_alignment) char[block_size];
-  }
+  BlockBase(BlockManager& manager, uint32_t index, uint32_t height);
 
   void NeedToParse() noexcept { need_to_parse_ = true; }
 
   /**
    * @brief 从磁盘导入的block当填充buf后，需要调用本函数解析元数据和kv数据
+   * @param check_crc 为false时跳过crc校验，用于已经校验过的buf
    */
-  bool Parse() noexcept {
+  bool Parse(bool check_crc = true) noexcept {
     // 只有从磁盘导入的block才能Parse
     assert(need_to_parse_ == true);
     uint32_t offset = 0;
     offset = ::bptree::util::ParseFromBuf(buf_, crc_, offset);
-    if (CheckForDamage() == true) {
+    if (check_crc == true && CheckForDamage() == true) {
       return false;
     }
     offset = ::bptree::util::ParseFromBuf(buf_, index_, offset);
@@ -189,11 +206,12 @@ class BlockBase {
   uint64_t GetLogNumber() const noexcept { return change_log_number_; }
 
   bool CheckForDamage() const noexcept {
-    uint32_t crc = crc32((const char*)&buf_[sizeof(crc_)], block_size - sizeof(crc_));
-    if (crc != crc_) {
-      return true;
+    uint32_t crc = checksum::Crc32c((const char*)&buf_[sizeof(crc_)], block_size - sizeof(crc_));
+    if (crc == crc_) {
+      return false;
     }
-    return false;
+    // 兼容旧版本使用crc32生成校验码的block，下次刷盘时会改为crc32c
+    return crc32((const char*)&buf_[sizeof(crc_)], block_size - sizeof(crc_)) != crc_;
   }
 
   const char* GetBuf() const noexcept { return buf_; }
@@ -206,21 +224,21 @@ class BlockBase {
 
   uint32_t& getHeight() noexcept { return height_; };
 
+  // 所有修改block的操作都需要在修改前调用本函数
   void SetDirty(bool update_dirty_block_count = true);
 
   void SetClean() { dirty_ = false; }
 
-  virtual ~BlockBase() {
-    if (dirty_ == true) {
-      std::cerr << "warn : block " << index_ << " destruct in dirty state, maybe throw exception or some inner error!"
-                << std::endl;
-    }
-    delete[] buf_;
-  }
+  // 在SetDirty中被调用，此时block还没有被修改
+  virtual void BeforeModify() {}
+
+  // buf归还给BlockManager的buf池
+  virtual ~BlockBase();
 
  protected:
   BlockManager& manager_;
   char* buf_;
+  bool own_buf_;
   // 标识从磁盘导入的数据是否被修改过，如果是新建的block，初始化为true。如果是从磁盘导入的block，初始化为false。
   bool dirty_;
   bool need_to_parse_;
@@ -235,7 +253,6 @@ class BlockBase {
 struct Entry {
   std::string_view key_view;
   std::string_view value_view;
-  uint32_t index;
 };
 
 class Block : public BlockBase {
@@ -244,7 +261,12 @@ class Block : public BlockBase {
   Block(BlockManager& manager, uint32_t index, uint32_t height, uint32_t key_size, uint32_t value_size);
 
   // 新建一个从磁盘导入的block的构造函数
-  explicit Block(BlockManager& manager, char* buf) noexcept : BlockBase(manager, buf) {}
+  explicit Block(BlockManager& manager, char* buf, bool own_buf = true) noexcept
+      : BlockBase(manager, buf, own_buf), version_(0) {}
+
+  // cache置换时Block对象被频繁构造和析构，对象的内存被回收复用
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr) noexcept;
 
   Block(const Block&) = delete;
   Block(Block&&) = delete;
@@ -261,19 +283,14 @@ class Block : public BlockBase {
   void SetNextFreeIndex(uint32_t nfi, uint64_t sequence) noexcept;
 
   // tested
-  std::string GetMaxKey() const {
-    if (kv_view_.empty() == true) {
-      throw BptreeExecption("get max key from empty block {}", GetIndex());
-    }
-    return std::string(kv_view_.back().key_view);
-  }
+  std::string GetMaxKey() const { return std::string(GetMaxKeyAsView()); }
 
   // note: 只有在持有block的wrapper的时候才保证正确，否则可能导致结果指向资源已经被释放的地址
   std::string_view GetMaxKeyAsView() const {
-    if (kv_view_.empty() == true) {
+    if (kv_count_ == 0) {
       throw BptreeExecption("get max key from empty block {}", GetIndex());
     }
-    return kv_view_.back().key_view;
+    return GetKeyView(kv_count_ - 1);
   }
 
   // 查找含有key的leaf block的index以及view_index
@@ -296,45 +313,35 @@ class Block : public BlockBase {
     offset = util::AppendToBuf(buf_, next_, offset);
     offset = util::AppendToBuf(buf_, key_size_, offset);
     offset = util::AppendToBuf(buf_, value_size_, offset);
-    offset = util::AppendToBuf(buf_, head_entry_, offset);
-    offset = util::AppendToBuf(buf_, free_list_, offset);
+    offset = util::AppendToBuf(buf_, page_format_, offset);
+    offset = util::AppendToBuf(buf_, kv_count_, offset);
   }
 
+  // slot目录和记录直接在buf中访问，解析时只需要读取元数据，旧版本格式的block需要先转换格式
   void ParseFromBuf(size_t offset) noexcept override {
-    offset = ::bptree::util::ParseFromBuf(buf_, next_free_index_, offset);
-    offset = ::bptree::util::ParseFromBuf(buf_, prev_, offset);
-    offset = ::bptree::util::ParseFromBuf(buf_, next_, offset);
-    offset = ::bptree::util::ParseFromBuf(buf_, key_size_, offset);
-    offset = ::bptree::util::ParseFromBuf(buf_, value_size_, offset);
-    offset = ::bptree::util::ParseFromBuf(buf_, head_entry_, offset);
-    offset = ::bptree::util::ParseFromBuf(buf_, free_list_, offset);
-    if (next_free_index_ == not_free_flag) {
-      UpdateKvViewByBuf();
+    UpdateMetaData(offset);
+    if (IsLinkedEntryFormat() == true) {
+      ConvertFromLinkedEntryFormat();
     }
+    RebuildAbbreviatedKeys();
+  }
+
+  // 需要在UpdateMeta之后调用，旧版本链表格式的block在ParseFromBuf中会原地转换格式，因此不能直接解析只读的buf
+  bool IsLinkedEntryFormat() const noexcept {
+    return next_free_index_ == not_free_flag && page_format_ != slotted_page_format;
   }
 
+  // 根据buf中的slot目录重新计算abbr_keys_，wal日志恢复直接修改buf，恢复完成后需要调用
+  void RebuildAbbreviatedKeys() noexcept;
+
   void UpdateMetaData(size_t offset) noexcept override {
     offset = ::bptree::util::ParseFromBuf(buf_, next_free_index_, offset);
     offset = ::bptree::util::ParseFromBuf(buf_, prev_, offset);
     offset = ::bptree::util::ParseFromBuf(buf_, next_, offset);
     offset = ::bptree::util::ParseFromBuf(buf_, key_size_, offset);
     offset = ::bptree::util::ParseFromBuf(buf_, value_size_, offset);
-    offset = ::bptree::util::ParseFromBuf(buf_, head_entry_, offset);
-    offset = ::bptree::util::ParseFromBuf(buf_, free_list_, offset);
-  }
-
-  /**
-   * @brief 根据buf中的数据更新kv_view_的数据
-   */
-  void UpdateKvViewByBuf() {
-    kv_view_.clear();
-    uint32_t entry_index = head_entry_;
-    while (entry_index != 0) {
-      Entry entry;
-      entry.index = entry_index;
-      entry_index = ParseEntry(entry_index, entry.key_view, entry.value_view);
-      kv_view_.push_back(entry);
-    }
+    offset = ::bptree::util::ParseFromBuf(buf_, page_format_, offset);
+    offset = ::bptree::util::ParseFromBuf(buf_, kv_count_, offset);
   }
 
   void SetPrev(uint32_t prev, uint64_t sequence) noexcept;
@@ -343,190 +350,153 @@ class Block : public BlockBase {
 
   void SetHeight(uint32_t height, uint64_t sequence) noexcept;
 
-  void SetHeadEntry(uint32_t entry, uint64_t sequence) noexcept;
-
-  void SetFreeList(uint32_t free_list, uint64_t sequence) noexcept;
+  void SetKvCount(uint32_t kv_count, uint64_t sequence) noexcept;
 
   uint32_t GetPrev() const noexcept { return prev_; }
 
   uint32_t GetNext() const noexcept { return next_; }
 
-  const std::vector<Entry>& GetKVView() const noexcept { return kv_view_; }
+  size_t GetKVCount() const noexcept { return kv_count_; }
 
-  const Entry& GetViewByIndex(size_t i) const noexcept { return kv_view_[i]; }
+  // note: 返回的view指向block的buf，只有在持有block的wrapper并且block没有被修改的时候才保证正确
+  Entry GetViewByIndex(size_t i) const noexcept {
+    assert(i < kv_count_);
+    return Entry{GetKeyView(i), GetValueView(i)};
+  }
 
-  std::string CreateMetaChangeWalLog(const std::string& meta_name, uint32_t value);
+  // 在叶子节点中查找key，找到时value指向buf中的数据，只在持有block的latch并且block没有被修改时有效
+  bool GetValueByKey(const std::string_view& key, std::string_view& value) const {
+    assert(GetHeight() == 0);
+    size_t index = SearchKey(key);
+    if (index == kv_count_) {
+      return false;
+    }
+    value = GetValueView(index);
+    return true;
+  }
 
-  std::string CreateDataChangeWalLog(uint32_t offset, const std::string& change_region);
+  // 没有空闲的空间，继续插入会导致分裂
+  bool IsFull() const noexcept { return kv_count_ >= GetMaxEntrySize(); }
 
-  std::string CreateDataView();
+  // 并发控制使用的latch，读操作持有共享锁，写操作持有独占锁，由BlockManager负责加锁和解锁
+  std::shared_mutex& GetLatch() noexcept { return latch_; }
 
- private:
-  uint32_t next_free_index_;
-  uint32_t prev_;
-  uint32_t next_;
-  uint32_t key_size_;
-  uint32_t value_size_;
-  uint32_t free_list_;
-  uint32_t head_entry_;
-  std::vector<Entry> kv_view_;
+  // 最后一次修改本block的写操作的版本号，见BlockVersionStore。从磁盘导入的block为0
+  uint64_t GetVersion() const noexcept { return version_; }
 
-  uint32_t GetMetaSpace() const noexcept {
-    return BlockBase::GetUsedSpace() + sizeof(next_free_index_) + sizeof(prev_) + sizeof(next_) + sizeof(key_size_) +
-           sizeof(value_size_) + sizeof(head_entry_) + sizeof(free_list_);
-  }
+  void SetVersion(uint64_t version) noexcept { version_ = version; }
+
+  void BeforeModify() override;
 
   /**
-   * @brief 在kv_view_中查找key对应的元素下标
+   * @brief 在slot目录中查找key对应的元素下标，先在key前缀数组上查找，前缀相等时再比较完整的key
    * @param key 用户指定的key
    * @return
-   *      - kv_view_.size() 查找失败
-   *      - [0, kv_view_.size()) 查找结果在kv_view_中的下标
+   *      - GetKVCount() 查找失败
+   *      - [0, GetKVCount()) 查找结果在slot目录中的下标
    */
   size_t SearchKey(const std::string_view& key) const;
 
   /**
-   * @brief 在kv_view_中查找第一个key大于等于指定key的元素下标
+   * @brief 在slot目录中查找第一个key大于等于指定key的元素下标，查找方式同SearchKey
    * @param key 用户指定的key
    * @return
-   *      - kv_view_.size() 查找失败
-   *      - [0, kv_view_.size()) 查找结果在kv_view_中的下标
+   *      - GetKVCount() 查找失败
+   *      - [0, GetKVCount()) 查找结果在slot目录中的下标
    */
   size_t SearchTheFirstGEKey(const std::string_view& key) const;
 
-  // 索引值从1开始计数
-  // tested
-  uint32_t GetOffsetByEntryIndex(uint32_t index) noexcept {
-    assert(index > 0);
-    uint32_t result = GetMetaSpace() + (index - 1) * GetEntrySize();
-    return result;
-  }
+  /**
+   * @brief 在slot目录中查找第一个key大于指定key的元素下标，查找方式同SearchKey
+   * @param key 用户指定的key
+   * @return
+   *      - GetKVCount() 查找失败
+   *      - [0, GetKVCount()) 查找结果在slot目录中的下标
+   */
+  size_t SearchTheFirstGTKey(const std::string_view& key) const;
 
-  // 解析索引值为index的entry，并返回下一个entry的索引值 or 0 （0
-  // 代表本entry为最后一个）
-  // tested
-  uint32_t ParseEntry(uint32_t index, std::string_view& key, std::string_view& value) noexcept {
-    assert(index != 0);
-    uint32_t offset = GetOffsetByEntryIndex(index);
-    uint32_t next = GetEntryNext(offset);
-    key = GetEntryKeyView(offset);
-    value = GetEntryValueView(offset);
-    return next;
-  }
-
-  // 对于这种操作，可以考虑将整个block记录为redo、undo日志内容，避免多个小改动占用太多空间
-  void InitEmptyEntrys(uint64_t sequence) noexcept {
-    uint32_t free_index = 1;
-    uint32_t offset = GetOffsetByEntryIndex(free_index);
-    while (offset + GetEntrySize() <= block_size) {
-      SetEntryNext(free_index, free_index + 1, sequence);
-      free_index += 1;
-      offset += GetEntrySize();
-    }
-    assert(free_index >= 1);
-    // 最后一个entry的next改为0，标志结尾。
-    SetEntryNext(free_index - 1, 0, sequence);
-  }
+  LogHead CreateMetaChangeWalLog(detail::MetaField field, uint32_t value);
 
-  void SetEntryNext(uint32_t index, uint32_t next, uint64_t sequence) noexcept;
+  // 修改区域的内容作为LogPayload的数据部分
+  LogHead CreateDataChangeWalLog(uint32_t offset);
 
-  // tested
-  uint32_t GetEntryNext(uint32_t offset) const noexcept {
-    uint32_t result = 0;
-    memcpy(&result, &buf_[offset], sizeof(result));
-    return result;
-  }
+  std::string CreateDataView();
 
-  std::string_view SetEntryKey(uint32_t offset, const std::string& key, uint64_t sequence) noexcept {
-    return SetEntryKey(offset, std::string_view(key), sequence);
+ private:
+  uint32_t next_free_index_;
+  uint32_t prev_;
+  uint32_t next_;
+  uint32_t key_size_;
+  uint32_t value_size_;
+  uint32_t page_format_;
+  uint32_t kv_count_;
+  std::shared_mutex latch_;
+  uint64_t version_;
+  // 与slot目录一一对应的key前缀（见Comparator::AbbreviateKey），只存在于内存中。
+  // 查找时先在前缀数组上定位（见key_search.h），只有前缀相等时才访问buf中的key，减少对block数据的随机访问
+  std::vector<uint64_t> abbr_keys_;
+
+  /*
+   * kv数据的格式（slotted page）：
+   * 元数据之后为slot目录，每个slot为uint16_t类型的记录编号，slot按照key的顺序排列，查找时直接在slot目录上二分
+   * 记录从block的尾部开始向前排列，每条记录为key + value，编号为[0, kv_count_)的记录都在使用中
+   * 删除记录时将编号最大的记录移动到被删除的位置，因此不需要维护空闲链表
+   */
+
+  uint32_t GetMetaSpace() const noexcept {
+    return BlockBase::GetUsedSpace() + sizeof(next_free_index_) + sizeof(prev_) + sizeof(next_) + sizeof(key_size_) +
+           sizeof(value_size_) + sizeof(page_format_) + sizeof(kv_count_);
   }
 
   // tested
-  std::string_view SetEntryKey(uint32_t offset, const std::string_view& key, uint64_t sequence) noexcept;
+  uint32_t GetEntrySize() const noexcept { return key_size_ + value_size_; }
 
   // tested
-  std::string_view GetEntryKeyView(uint32_t offset) const noexcept {
-    return std::string_view((const char*)&buf_[offset + sizeof(uint32_t)], static_cast<size_t>(key_size_));
+  uint32_t GetSlotOffset(size_t slot) const noexcept {
+    return GetMetaSpace() + static_cast<uint32_t>(slot * sizeof(uint16_t));
   }
 
-  std::string_view SetEntryValue(uint32_t offset, const std::string& value, uint64_t sequence) noexcept {
-    return SetEntryValue(offset, std::string_view(value), sequence);
+  // tested
+  uint16_t GetSlot(size_t slot) const noexcept {
+    uint16_t record = 0;
+    memcpy(&record, &buf_[GetSlotOffset(slot)], sizeof(record));
+    return record;
   }
 
   // tested
-  std::string_view SetEntryValue(uint32_t offset, const std::string_view& value, uint64_t sequence) noexcept;
+  uint32_t GetRecordOffset(uint32_t record) const noexcept { return block_size - (record + 1) * GetEntrySize(); }
 
-  // tested
-  std::string_view GetEntryValueView(uint32_t offset) const noexcept {
-    return std::string_view((const char*)&buf_[offset + sizeof(uint32_t) + key_size_],
+  std::string_view GetKeyView(size_t slot) const noexcept {
+    return std::string_view((const char*)&buf_[GetRecordOffset(GetSlot(slot))], static_cast<size_t>(key_size_));
+  }
+
+  std::string_view GetValueView(size_t slot) const noexcept {
+    return std::string_view((const char*)&buf_[GetRecordOffset(GetSlot(slot)) + key_size_],
                             static_cast<size_t>(value_size_));
   }
 
-  // tested
-  uint32_t GetEntrySize() const noexcept { return sizeof(uint32_t) + key_size_ + value_size_; }
+  uint64_t AbbreviateKey(const std::string_view& key) const noexcept;
 
-  // tested
-  void RemoveEntry(uint32_t index, uint32_t prev_index, uint64_t sequence) noexcept {
-    SetDirty();
-    uint32_t offset = GetOffsetByEntryIndex(index);
-    uint32_t next = GetEntryNext(offset);
-    if (prev_index != 0) {
-      uint32_t prev_offset = GetOffsetByEntryIndex(prev_index);
-      assert(GetEntryNext(prev_offset) == index);
-      SetEntryNext(prev_index, next, sequence);
-    } else {
-      SetHeadEntry(next, sequence);
-    }
-    // 将index的entry加入freelist中
-    SetEntryNext(index, free_list_, sequence);
-    SetFreeList(index, sequence);
-  }
+  // 根据BlockManager的KeyKind选择key_traits中内联的比较实现并调用func，自定义的Comparator通过虚函数调用
+  template <typename Func>
+  decltype(auto) DispatchKeyCompare(Func&& func) const;
 
-  Entry InsertEntry(uint32_t prev_index, const std::string& key, const std::string& value, bool& full,
-                    uint64_t sequence) noexcept {
-    return InsertEntry(prev_index, std::string_view(key), std::string_view(value), full, sequence);
-  }
+  // 返回第一个key大于等于指定key的下标，equal表示该位置的key是否与指定key相等
+  template <typename KeyCompare>
+  size_t SearchTheFirstGEKey(const KeyCompare& cmp, const std::string_view& key, bool& equal) const;
 
-  // tested
-  Entry InsertEntry(uint32_t prev_index, const std::string_view& key, const std::string_view& value, bool& full,
-                    uint64_t sequence) noexcept {
-    if (free_list_ == 0) {
-      full = true;
-      return Entry();
-    }
-    SetDirty();
-    uint32_t new_index = free_list_;
-    uint32_t new_offset = GetOffsetByEntryIndex(free_list_);
-    SetFreeList(GetEntryNext(new_offset), sequence);
-    if (prev_index == 0) {
-      // 插入到头部的情况
-      SetEntryNext(new_index, head_entry_, sequence);
-      SetHeadEntry(new_index, sequence);
-    } else {
-      uint32_t prev_offset = GetOffsetByEntryIndex(prev_index);
-      uint32_t prev_next = GetEntryNext(prev_offset);
-      SetEntryNext(prev_index, new_index, sequence);
-      SetEntryNext(new_index, prev_next, sequence);
-    }
-    Entry entry;
-    entry.index = new_index;
-    entry.key_view = SetEntryKey(new_offset, key, sequence);
-    entry.value_view = SetEntryValue(new_offset, value, sequence);
-    return entry;
-  }
+  // 修改buf中[offset, offset + region.size())的数据，同时将新值和旧值写入sequence标识的wal日志中，region可以指向buf自身
+  void SetRegion(uint32_t offset, const std::string_view& region, uint64_t sequence) noexcept;
 
-  // note : 调用者需要保证key的有序性
+  // 在slot目录的slot位置插入一条新的记录，调用者需要保证block没有满并且key的有序性
   // tested
-  std::string_view UpdateEntryKey(uint32_t index, const std::string& key, uint64_t sequence) noexcept {
-    uint32_t offset = GetOffsetByEntryIndex(index);
-    return SetEntryKey(offset, key, sequence);
-  }
+  void InsertSlot(size_t slot, const std::string_view& key, const std::string_view& value, uint64_t sequence) noexcept;
 
   // tested
-  std::string_view UpdateEntryValue(uint32_t index, const std::string& value, uint64_t sequence) noexcept {
-    uint32_t offset = GetOffsetByEntryIndex(index);
-    return SetEntryValue(offset, value, sequence);
-  }
+  void RemoveSlot(size_t slot, uint64_t sequence) noexcept;
+
+  // 将旧版本的链表格式（每个entry为next + key + value，通过head_entry_串联）转换为slot目录格式，只修改内存中的buf
+  void ConvertFromLinkedEntryFormat() noexcept;
 
  public:
   enum class InsertResult {
@@ -556,54 +526,55 @@ class Block : public BlockBase {
   }
 
   void DeleteKvByIndex(uint32_t index, uint64_t sequence) {
-    assert(index < kv_view_.size());
-    uint32_t block_index = kv_view_[index].index;
-    if (index == 0) {
-      RemoveEntry(block_index, 0, sequence);
-    } else {
-      RemoveEntry(block_index, kv_view_[index - 1].index, sequence);
-    }
-    auto it = kv_view_.begin();
-    std::advance(it, index);
-    kv_view_.erase(it);
+    assert(index < kv_count_);
+    RemoveSlot(index, sequence);
   }
 
   void Clear(uint64_t sequence) noexcept {
-    SetHeadEntry(0, sequence);
-    SetFreeList(1, sequence);
-    InitEmptyEntrys(sequence);
-    kv_view_.clear();
+    SetKvCount(0, sequence);
+    abbr_keys_.clear();
   }
 
   uint32_t GetChildIndex(size_t child_index) const noexcept {
     uint32_t result = 0;
-    std::string_view index_view = kv_view_[child_index].value_view;
+    std::string_view index_view = GetValueView(child_index);
     memcpy(&result, index_view.data(), index_view.size());
     return result;
   }
 
+  // note : 调用者需要保证更新后key的有序性
+  // tested
+  void UpdateKeyByIndex(size_t index, const std::string_view& key, uint64_t sequence) noexcept {
+    assert(index < kv_count_ && key.size() == key_size_);
+    SetRegion(GetRecordOffset(GetSlot(index)), key, sequence);
+    abbr_keys_[index] = AbbreviateKey(key);
+  }
+
+  // tested
+  void UpdateValueByIndex(size_t index, const std::string_view& value, uint64_t sequence) noexcept {
+    assert(index < kv_count_ && value.size() == value_size_);
+    SetRegion(GetRecordOffset(GetSlot(index)) + key_size_, value, sequence);
+  }
+
   // note : 调用者需要保证更新后key的有序性
   // tested
   void UpdateByIndex(size_t child_index, const std::string& key, const std::string& value, uint64_t sequence) noexcept {
-    assert(kv_view_.size() > child_index);
-    uint32_t update_index = kv_view_[child_index].index;
-    auto key_view = UpdateEntryKey(update_index, key, sequence);
-    auto value_view = UpdateEntryValue(update_index, value, sequence);
-    kv_view_[child_index].key_view = key_view;
-    kv_view_[child_index].value_view = value_view;
+    assert(kv_count_ > child_index);
+    UpdateKeyByIndex(child_index, key, sequence);
+    UpdateValueByIndex(child_index, value, sequence);
   }
 
   /*
    * 以下函数涉及block的分裂和合并相关操作
    */
 
-  uint32_t GetMaxEntrySize() const { return (block_size - GetMetaSpace()) / GetEntrySize(); }
+  uint32_t GetMaxEntrySize() const { return (block_size - GetMetaSpace()) / (GetEntrySize() + sizeof(uint16_t)); }
 
-  bool CheckIfNeedToMerge() noexcept { return kv_view_.size() * 2 < GetMaxEntrySize(); }
+  bool CheckIfNeedToMerge() noexcept { return kv_count_ * 2 < GetMaxEntrySize(); }
 
   bool CheckCanMerge(Block* b1, Block* b2) noexcept {
     assert(b1->key_size_ == b2->key_size_ && b1->value_size_ == b2->value_size_);
-    return b1->kv_view_.size() + b2->kv_view_.size() <= b1->GetMaxEntrySize();
+    return b1->kv_count_ + b2->kv_count_ <= b1->GetMaxEntrySize();
   }
 
   void UpdateBlockPrevIndex(uint32_t block_index, uint32_t prev, uint64_t sequence);
@@ -618,11 +589,11 @@ class Block : public BlockBase {
 
   DeleteInfo DoMerge(uint32_t child_index, uint64_t sequence, const std::string& old_v);
 
-  void HandleMetaUpdateWal(const std::string& meta_name, uint32_t value);
+  void HandleMetaUpdateWal(detail::MetaField field, uint32_t value);
 
-  void HandleDataUpdateWal(uint32_t offset, const std::string& region);
+  void HandleDataUpdateWal(uint32_t offset, std::string_view region);
 
-  void HandleViewWal(const std::string& view);
+  void HandleViewWal(std::string_view view);
 };
 
 class SuperBlock : public BlockBase {
@@ -659,7 +630,7 @@ class SuperBlock : public BlockBase {
     offset = ::bptree::util::ParseFromBuf(buf_, current_max_block_index_, offset);
   }
 
-  std::string CreateMetaChangeWalLog(const std::string& meta_name, uint32_t value);
+  LogHead CreateMetaChangeWalLog(detail::MetaField field, uint32_t value);
 
   void SetCurrentMaxBlockIndex(uint32_t value, uint64_t sequence);
 
@@ -667,15 +638,19 @@ class SuperBlock : public BlockBase {
 
   void SetFreeBlockSize(uint32_t value, uint64_t sequence);
 
-  void HandleWAL(const std::string& meta_name, uint32_t value) {
-    if (meta_name == "current_max_block_index") {
-      current_max_block_index_ = value;
-    } else if (meta_name == "free_block_head") {
-      free_block_head_ = value;
-    } else if (meta_name == "free_block_size") {
-      free_block_size_ = value;
-    } else {
-      throw BptreeExecption("invalid super meta name : {}", meta_name);
+  void HandleWAL(detail::MetaField field, uint32_t value) {
+    switch (field) {
+      case detail::MetaField::CURRENT_MAX_BLOCK_INDEX:
+        current_max_block_index_ = value;
+        break;
+      case detail::MetaField::FREE_BLOCK_HEAD:
+        free_block_head_ = value;
+        break;
+      case detail::MetaField::FREE_BLOCK_SIZE:
+        free_block_size_ = value;
+        break;
+      default:
+        throw BptreeExecption("invalid super meta field : {}", detail::MetaFieldToUint8T(field));
     }
   }
 
@@ -1,18 +1,32 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
 #include <string>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
 #include "bptree/block.h"
+#include "bptree/buffer_pool.h"
 #include "bptree/cache.h"
+#include "bptree/cuckoo_filter.h"
 #include "bptree/double_write.h"
 #include "bptree/exception.h"
 #include "bptree/fault_injection.h"
@@ -20,7 +34,9 @@
 #include "bptree/key_comparator.h"
 #include "bptree/log.h"
 #include "bptree/metric/metric.h"
+#include "bptree/snapshot.h"
 #include "bptree/metric/metric_set.h"
+#include "bptree/row_cache.h"
 #include "bptree/unused_block.h"
 #include "bptree/util.h"
 #include "bptree/wal.h"
@@ -33,6 +49,16 @@ enum class GetRangeOption {
   STOP,
 };
 
+// GetRange的起始位置
+enum class RangeStart {
+  // 从等于key的位置开始，key不存在时结果为空
+  EQ,
+  // 从第一个大于等于key的位置开始
+  GE,
+  // 从第一个大于key的位置开始
+  GT,
+};
+
 enum class Mode {
   R,
   W,
@@ -80,12 +106,61 @@ struct BlockManagerOption {
   // 指定lru使用的block数量
   size_t cache_size = 1024;
 
+  // 指定lru cache的分片数量，每个分片有独立的锁。实际分片数量为不超过该值的2的幂，并且每个分片至少容纳16个block
+  size_t cache_shard_count = 16;
+
+  // 指定block cache的淘汰策略，CLOCK策略命中时不需要移动链表节点，TWO_QUEUE策略可以防止大范围的扫描淘汰内部节点
+  CachePolicy cache_policy = CachePolicy::LRU;
+
+  // 指定cache中为内部节点（height > 0）保留的block数量，包含在cache_size中，0表示不区分内部节点和叶子节点
+  // 内部节点位于每次查找的路径上，只有数量超出该值或者没有其他可淘汰的block时才会被淘汰
+  size_t inner_block_cache_size = 0;
+
   // 指定多少个写操作之后生成一个check point
   size_t create_check_point_per_ops = 4096;
 
+  // 范围查找沿着叶子节点的链表连续访问一定数量的block之后，对之后的readahead_blocks个叶子节点发起预读，0表示不预读（默认）
+  // SYNC时只通知内核预读；IO_URING时由执行范围查找的线程同步地批量读入cache，读取完成之前范围查找不会继续
+  size_t readahead_blocks = 0;
+
+  // 指定批量读写block使用的io引擎，IO_URING时MultiGet和范围查找的预读在调用线程上同步地批量读入cache，关闭double write时check point批量写回
+  // 内核不支持io_uring时退化为SYNC
+  IoEngine io_engine = IoEngine::SYNC;
+
+  // io_uring一次最多提交的请求数量
+  uint32_t io_queue_depth = 32;
+
+  // 指定是否在内存中维护所有key的cuckoo filter，Get和MultiGet对filter确定不存在的key直接返回，不访问任何block
+  // filter在生成check point时持久化，内存占用约为每个key 2.5字节
+  bool enable_key_filter = false;
+
+  // 只在mode为R时生效，打开db之后以只读方式映射db文件，加载block时直接引用映射的页而不是拷贝到单独分配的buf中
+  // 每个block在进程生命周期内只校验一次crc，多个只读进程共享page cache中的物理页
+  bool mmap_read_only = false;
+
+  // 指定是否以O_DIRECT打开db文件，block只缓存在block cache中，不再同时占用内核的page cache
+  // 开启后block cache是db文件唯一的缓存，需要相应地增大cache_size；文件系统不支持时退化为普通读写
+  bool direct_io = false;
+
+  // 指定block buf池是否尝试使用大页，buf池按照cache_size预留内存，cache置换时直接复用被淘汰的block的buf
+  bool buffer_pool_huge_page = false;
+
+  // 指定row cache的容量（字节），0表示不使用。Get先查询row cache，命中时不需要从根节点开始查找
+  // Update和Delete在修改叶子节点时使对应的行失效，快照读、范围查找和MultiGet不使用row cache
+  size_t row_cache_bytes = 0;
+
   // 指定是否每个写操作之后同步wal日志
   bool sync_per_write = false;
 
+  // sync_per_write为true时，并发提交的写操作组成一组，由其中一个线程执行一次fdatasync
+  // 执行同步的线程最多等待group_commit_max_wait_us微秒，直到等待同步的写操作数量达到group_commit_batch_size
+  // group_commit_max_wait_us为0时不等待，同步期间到达的写操作由下一次同步覆盖
+  size_t group_commit_batch_size = 16;
+  uint64_t group_commit_max_wait_us = 0;
+
+  // wal日志缓冲区的大小（字节），日志先追加到缓冲区中，由后台线程批量写入wal文件，缓冲区满时写操作等待
+  size_t wal_buffer_size = WriteAheadLog::default_buffer_size;
+
   // 指定是否关闭double write写（计划通过wal日志记录block最近版本，避免double write写）
   bool double_write_turn_off = false;
 
@@ -101,24 +176,166 @@ inline std::string CreateDWfileNameByDB(const std::string& db_name) {
 
 inline std::string CreateDbFileNameByDB(const std::string& db_name) { return db_name + "/" + db_name + ".db"; }
 
+inline std::string CreateKeyFilterFileNameByDB(const std::string& db_name) {
+  return db_name + "/" + db_name + "_key_filter";
+}
+
 namespace detail {
 
 enum class LogType : uint8_t {
+  // 旧版本的日志格式，元数据字段记录为字段名，只用于识别旧版本的wal，不再回放
   SUPER_META,
   BLOCK_META,
   BLOCK_DATA,
   BLOCK_ALLO,
   BLOCK_RESET,
   BLOCK_VIEW,
+  // 以下为紧凑格式，block编号、偏移量等整数使用varint编码，元数据字段使用MetaField编号代替字段名
+  // 数据部分（修改区域的内容和block的数据快照）位于日志末尾，不记录长度
+  COMPACT_SUPER_META,
+  COMPACT_BLOCK_META,
+  COMPACT_BLOCK_DATA,
+  COMPACT_BLOCK_ALLO,
+  COMPACT_BLOCK_RESET,
+  COMPACT_BLOCK_VIEW,
 };
 
 inline constexpr uint8_t LogTypeToUint8T(LogType type) { return static_cast<uint8_t>(type); }
 
 }  // namespace detail
 
+/*
+ * 同时持有block在cache中的引用计数以及block的latch，Lock为std::shared_lock（读）或者std::unique_lock（写）
+ * 析构时首先释放latch，然后释放引用计数，避免block被淘汰之后再解锁
+ * 不支持移动赋值，原因同上
+ */
+template <typename Lock>
+class LatchedBlock {
+ public:
+  using wrapper_type = typename ShardedCache<uint32_t, Block>::Wrapper;
+
+  explicit LatchedBlock(wrapper_type&& wrapper) : wrapper_(std::move(wrapper)), lock_(wrapper_.Get().GetLatch()) {}
+
+  LatchedBlock(LatchedBlock&&) = default;
+  LatchedBlock& operator=(LatchedBlock&&) = delete;
+
+  Block& Get() { return wrapper_.Get(); }
+
+  const Block& Get() const { return wrapper_.Get(); }
+
+ private:
+  wrapper_type wrapper_;
+  Lock lock_;
+};
+
+using ReadLatchedBlock = LatchedBlock<std::shared_lock<std::shared_mutex>>;
+using WriteLatchedBlock = LatchedBlock<std::unique_lock<std::shared_mutex>>;
+
+/*
+ * GetPinned的返回值，持有value所在叶子节点在cache中的引用计数和读latch，Value()直接指向block的buf，不发生拷贝
+ * 持有期间该block不会被淘汰也不会被修改，需要修改该block的写操作（包括分裂和合并）会等待其析构，其他block的写操作和check point不受影响，
+ * 因此使用者应尽快析构，并且不要在持有期间于同一个线程中对db进行写操作（可能需要修改同一个block）
+ */
+class PinnableValue {
+ public:
+  PinnableValue() = default;
+
+  PinnableValue(PinnableValue&&) = default;
+  PinnableValue& operator=(PinnableValue&&) = delete;
+
+  bool Exist() const noexcept { return block_.has_value(); }
+
+  // key不存在时返回空的view
+  std::string_view Value() const noexcept { return value_; }
+
+ private:
+  friend class BlockManager;
+
+  PinnableValue(ReadLatchedBlock&& block, std::string_view value) : block_(std::move(block)), value_(value) {}
+
+  std::optional<ReadLatchedBlock> block_;
+  std::string_view value_;
+};
+
+// Iterator的可选边界，迭代范围为[lower_bound, upper_bound)，没有设置表示不限制
+struct IteratorOption {
+  std::optional<std::string> lower_bound;
+  std::optional<std::string> upper_bound;
+};
+
+/*
+ * 沿着叶子节点的链表双向迭代，Key()/Value()指向迭代器保存的当前kv的拷贝，拷贝使用的缓冲区在迭代过程中复用
+ * 迭代器在两次调用之间不持有任何锁和引用计数，只在Seek/Next/Prev期间持有tree_latch_的共享锁以及当前叶子节点的引用计数和读latch，
+ * 因此迭代器存活期间不会阻塞写操作和check point，可以在同一个线程中对db进行写操作，也可以移动到其他线程中继续使用
+ * 迭代器记录定位时树结构的版本号，如果之后发生了分裂或者合并，Next/Prev从上一次返回的key重新查找
+ * 新建的迭代器没有定位，需要先调用Seek/SeekToFirst/SeekToLast
+ */
+class Iterator {
+ public:
+  Iterator(Iterator&&) = default;
+  Iterator& operator=(Iterator&&) = delete;
+
+  bool Valid() const noexcept { return valid_; }
+
+  void SeekToFirst();
+
+  void SeekToLast();
+
+  // 定位到第一个大于等于key的位置
+  void Seek(const std::string& key);
+
+  void Next();
+
+  void Prev();
+
+  // 调用方需要保证Valid()为true，返回的view在下一次移动迭代器之前有效
+  std::string_view Key() const noexcept { return key_; }
+
+  std::string_view Value() const noexcept { return value_; }
+
+ private:
+  friend class BlockManager;
+
+  Iterator(BlockManager& manager, IteratorOption option);
+
+  // 以下函数在持有tree_latch_的共享锁时调用
+
+  // 从上一次返回的key移动到下一个（forward为true）或者上一个位置
+  void Step(bool forward);
+
+  // 定位到第一个大于等于（start为GE）或者大于（start为GT）key的位置
+  void SeekAfter(const std::string& key, RangeStart start);
+
+  // 定位到最后一个小于key的位置
+  void SeekBefore(const std::string& key);
+
+  // 定位到index对应的叶子节点中下标为slot的位置，slot越界时沿着forward指定的方向移动到相邻的叶子节点
+  void SeekInLeaf(uint32_t index, size_t slot, bool forward);
+
+  // 定位到leaf中下标为slot的位置，拷贝对应的kv并记录当前的树结构版本号
+  void SetPosition(const ReadLatchedBlock& leaf, size_t slot);
+
+  // 从根节点开始沿着最左（first为true）或者最右的子节点向下查找叶子节点，树为空时返回0
+  uint32_t FindEdgeLeaf(bool first);
+
+  // 超出边界时置为无效
+  void CheckBound();
+
+  BlockManager& manager_;
+  IteratorOption option_;
+  bool valid_;
+  // 当前位置所在的叶子节点和下标，以及定位时的树结构版本号，版本号不变时叶子节点没有被释放，叶子节点之间的链接也没有改变
+  uint32_t leaf_;
+  size_t slot_;
+  uint64_t structure_version_;
+  std::string key_;
+  std::string value_;
+};
+
 class BlockManager {
  public:
   friend class Block;
+  friend class Iterator;
   friend class BlockBase;
   friend class SuperBlock;
 
@@ -129,17 +346,34 @@ class BlockManager {
   BPTREE_INTERFACE explicit BlockManager(BlockManagerOption option)
       : mode_(option.mode),
         comparator_(option.cmp),
-        block_cache_(option.cache_size),
+        key_kind_(option.cmp->GetKeyKind()),
+        buffer_pool_(block_size, linux_alignment, option.cache_size + buffer_pool_reserved_frames,
+                     option.buffer_pool_huge_page),
+        block_cache_(option.cache_size, option.cache_shard_count, option.cache_policy, option.inner_block_cache_size),
         db_name_(option.db_name),
         super_block_(*this, option.key_size, option.value_size),
-        wal_(CreateWalNameByDB(db_name_)),
+        wal_(CreateWalNameByDB(db_name_), option.wal_buffer_size),
         dw_(CreateDWfileNameByDB(db_name_)),
         create_checkpoint_per_op_(option.create_check_point_per_ops),
+        readahead_blocks_(option.readahead_blocks),
+        enable_key_filter_(option.enable_key_filter),
+        direct_io_(option.direct_io),
         sync_per_write_(option.sync_per_write),
-        unused_blocks_() {
+        group_commit_batch_size_(option.group_commit_batch_size),
+        group_commit_max_wait_(option.group_commit_max_wait_us),
+        unused_blocks_(),
+        tx_count_(0),
+        write_version_(0) {
     if (db_name_.empty() == true) {
       throw BptreeExecption("please specify the db's name");
     }
+    if (option.inner_block_cache_size > option.cache_size) {
+      throw BptreeExecption("inner_block_cache_size {} should not exceed cache_size {}", option.inner_block_cache_size,
+                            option.cache_size);
+    }
+    if (option.row_cache_bytes > 0) {
+      row_cache_ = std::make_unique<RowCache>(option.row_cache_bytes, option.cache_shard_count);
+    }
     block_cache_.SetFreeNotify([this](const uint32_t& key, Block& value) -> void { this->OnCacheDelete(key, value); });
     wal_.RegisterLogHandler(
         [this](uint64_t seq, MsgType type, const std::string log) -> void { this->HandleWal(seq, type, log); });
@@ -153,8 +387,10 @@ class BlockManager {
             "block manager construct error, key_size and value_size should not "
             "be 0");
       }
+      CheckKeyKind();
       util::CreateDir(db_name_);
-      f_ = FileHandler::CreateFile(CreateDbFileNameByDB(db_name_), FileType::NORMAL);
+      f_ = OpenDbFile(true);
+      f_.SetIoEngine(option.io_engine, option.io_queue_depth);
       wal_.OpenFile();
       dw_.OpenFile();
       if (option.double_write_turn_off == true) {
@@ -164,14 +400,16 @@ class BlockManager {
       auto root_block = std::unique_ptr<Block>(
           new Block(*this, super_block_.root_index_, 1, super_block_.key_size_, super_block_.value_size_));
       GetMetricSet().GetAs<Gauge>("dirty_block_count")->Add();
-      block_cache_.Insert(super_block_.root_index_, std::move(root_block));
+      block_cache_.Insert(super_block_.root_index_, std::move(root_block), true);
+      if (enable_key_filter_ == true) {
+        key_filter_ = std::make_unique<CuckooFilter>(0);
+      }
 
       uint64_t seq = wal_.RequestSeq();
       wal_.Begin(seq);
-      std::string redo_log =
+      LogHead redo_log =
           CreateAllocBlockWalLog(super_block_.root_index_, 1, super_block_.key_size_, super_block_.value_size_);
-      std::string undo_log = "";
-      wal_.WriteLog(seq, redo_log, undo_log);
+      wal_.WriteLog(seq, redo_log.View(), "");
       wal_.End(seq);
       wal_.Flush();
       FlushSuperBlockToFile();
@@ -180,18 +418,30 @@ class BlockManager {
       if (option.eflag == ExistFlag::ERROR) {
         throw BptreeExecption("db {} already exists", db_name_);
       }
-      f_ = FileHandler::OpenFile(CreateDbFileNameByDB(db_name_), FileType::NORMAL);
+      f_ = OpenDbFile(false);
+      f_.SetIoEngine(option.io_engine, option.io_queue_depth);
       wal_.OpenFile();
       dw_.OpenFile();
       if (option.double_write_turn_off == true) {
         dw_.TurnOff();
       }
       ParseSuperBlockFromFile();
+      CheckKeyKind();
       wal_.Recover();
-      // 这个时候cache中的block buf都已经通过wal日志恢复，但是kvview还没有变更，因此需要对cache中的block更新kvview
-      block_cache_.ForeachValueInCache([](const uint32_t& index, Block& block) { block.UpdateKvViewByBuf(); });
+      // wal日志恢复直接修改cache中block的buf，需要重新计算这些block的key前缀
+      block_cache_.ForeachValueInCache([](const uint32_t& index, Block& block) { block.RebuildAbbreviatedKeys(); });
+      if (enable_key_filter_ == true) {
+        InitKeyFilter();
+      } else {
+        // 关闭filter期间的修改不会记录到filter中，之后再开启时不能使用旧的filter
+        util::DeleteFile(CreateKeyFilterFileNameByDB(db_name_));
+      }
       // 生成一个快照
       CreateCheckPoint();
+      // wal恢复和check point都已经写回db文件，之后只读模式不再修改db文件中的block
+      if (option.mmap_read_only == true && mode_ == Mode::R) {
+        MapDbFile();
+      }
       BPTREE_LOG_INFO("open db {} succ", db_name_);
     }
   }
@@ -207,6 +457,34 @@ class BlockManager {
    * @note 用户需要有读权限，key的大小需要和构造时指定的key_size一致，否则抛出异常
    */
   BPTREE_INTERFACE std::string Get(const std::string& key) {
+    std::string value;
+    Get(key, &value);
+    return value;
+  }
+
+  /**
+   * @brief 接口函数，根据key在db中查询value，结果写入调用方提供的value中，可以复用其内存
+   * @return key是否存在，不存在时value被清空
+   * @note 同Get(key)
+   */
+  BPTREE_INTERFACE bool Get(const std::string& key, std::string* value) {
+    if (row_cache_ != nullptr && LookupRowCache(key, *value) == true) {
+      return true;
+    }
+    PinnableValue pinned = GetPinned(key);
+    value->assign(pinned.Value());
+    if (row_cache_ != nullptr && pinned.Exist() == true) {
+      // 持有叶子节点的读latch时填充，Update和Delete在持有写latch时使对应的行失效，因此不会填充过期的value
+      row_cache_->Insert(key, pinned.Value());
+    }
+    return pinned.Exist();
+  }
+
+  /**
+   * @brief 接口函数，根据key在db中查询value，返回的PinnableValue直接引用cache中的block，不拷贝value
+   * @note 同Get(key)，返回值的使用限制见PinnableValue
+   */
+  BPTREE_INTERFACE PinnableValue GetPinned(const std::string& key) {
     if (mode_ != Mode::R && mode_ != Mode::WR) {
       throw BptreeExecption("Permission denied");
     }
@@ -214,9 +492,73 @@ class BlockManager {
       throw BptreeExecption("wrong key length");
     }
     GetMetricSet().GetAs<Counter>("get_count")->Add();
-    auto block = GetBlock(super_block_.root_index_);
-    std::string result = block.Get().Get(key);
-    return result;
+    std::shared_lock<std::shared_mutex> tree_guard(tree_latch_);
+    if (KeyMayExist(key) == false) {
+      return PinnableValue();
+    }
+    auto leaf = FindLeafBlock<ReadLatchedBlock>(key);
+    if (leaf.has_value() == false) {
+      return PinnableValue();
+    }
+    std::string_view value;
+    if (leaf->Get().GetValueByKey(key, value) == false) {
+      return PinnableValue();
+    }
+    return PinnableValue(std::move(*leaf), value);
+  }
+
+  /**
+   * @brief 接口函数，批量查询，key按照顺序共享自上而下的查找路径，每个block只访问一次
+   * @param keys 需要查询的key，不要求有序，可以重复
+   * @return 与keys一一对应的value，不存在的key对应空字符串
+   * @note 同Get(key)。同一个内部节点下不在cache中的叶子节点会一起发起预读，使磁盘io可以并行
+   */
+  BPTREE_INTERFACE std::vector<std::string> MultiGet(std::span<const std::string> keys) {
+    if (mode_ != Mode::R && mode_ != Mode::WR) {
+      throw BptreeExecption("Permission denied");
+    }
+    for (auto& each : keys) {
+      if (each.size() != super_block_.key_size_) {
+        throw BptreeExecption("wrong key length");
+      }
+    }
+    GetMetricSet().GetAs<Counter>("multi_get_count")->Add();
+    std::vector<std::string> values(keys.size());
+    if (keys.empty() == true) {
+      return values;
+    }
+    std::shared_lock<std::shared_mutex> tree_guard(tree_latch_);
+    // filter确定不存在的key不参与查找
+    std::vector<size_t> order;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (KeyMayExist(keys[i]) == true) {
+        order.push_back(i);
+      }
+    }
+    if (order.empty() == true) {
+      return values;
+    }
+    std::sort(order.begin(), order.end(),
+              [&](size_t a, size_t b) -> bool { return GetComparator().Compare(keys[a], keys[b]) < 0; });
+    ReadLatchedBlock root(GetBlock(super_block_.root_index_));
+    MultiGetFromInnerBlock(root.Get(), keys, order, 0, order.size(), values);
+    return values;
+  }
+
+  /**
+   * @brief 接口函数，新建一个迭代器，使用方式和限制见Iterator
+   * @note 用户需要有读权限，边界key的大小需要和构造时指定的key_size一致，否则抛出异常
+   */
+  BPTREE_INTERFACE Iterator NewIterator(IteratorOption option = IteratorOption()) {
+    if (mode_ != Mode::R && mode_ != Mode::WR) {
+      throw BptreeExecption("Permission denied");
+    }
+    if ((option.lower_bound.has_value() && option.lower_bound->size() != super_block_.key_size_) ||
+        (option.upper_bound.has_value() && option.upper_bound->size() != super_block_.key_size_)) {
+      throw BptreeExecption("wrong key length");
+    }
+    GetMetricSet().GetAs<Counter>("new_iterator_count")->Add();
+    return Iterator(*this, std::move(option));
   }
 
   /**
@@ -225,11 +567,13 @@ class BlockManager {
 
    * @param key 范围查找的key
    * @param functor 选择functor
+   * @param start 起始位置，默认从等于key的位置开始
    * @return 查找到的key-value对
    * @note 用户需要有读权限，key的大小需要和构造时指定的key_size一致，否则抛出异常
    */
   BPTREE_INTERFACE std::vector<std::pair<std::string, std::string>> GetRange(
-      const std::string& key, std::function<GetRangeOption(const Entry& entry)> functor) {
+      const std::string& key, std::function<GetRangeOption(const Entry& entry)> functor,
+      RangeStart start = RangeStart::EQ) {
     if (mode_ != Mode::R && mode_ != Mode::WR) {
       throw BptreeExecption("Permission denied");
     }
@@ -237,19 +581,24 @@ class BlockManager {
       throw BptreeExecption("wrong key length");
     }
     GetMetricSet().GetAs<Counter>("get_range_count")->Add();
-    auto location = GetBlock(super_block_.root_index_).Get().GetBlockIndexContainKey(key);
-    BPTREE_LOG_DEBUG("get range, key == {}, find the location : {}, {}", key, location.first, location.second);
-    if (location.first == 0) {
+    // 扫描期间持有tree latch的共享锁，保证叶子节点之间的链接关系不会被分裂/合并操作修改
+    std::shared_lock<std::shared_mutex> tree_guard(tree_latch_);
+    std::optional<ReadLatchedBlock> block = FindLeafBlock<ReadLatchedBlock>(key);
+    if (block.has_value() == false) {
+      return {};
+    }
+    size_t view_index = SearchRangeStart(block->Get(), key, start);
+    BPTREE_LOG_DEBUG("get range, key == {}, find the location : {}, {}", key, block->Get().GetIndex(), view_index);
+    // 起始位置在当前叶子节点之后时，下面的循环会移动到下一个叶子节点
+    if (start == RangeStart::EQ && view_index == block->Get().GetKVCount()) {
       return {};
     }
     Counter scan("scan count");
+    LeafReadahead readahead(*this);
     std::vector<std::pair<std::string, std::string>> result;
-    uint32_t block_index = location.first;
-    uint32_t view_index = location.second;
-    while (block_index != 0) {
-      auto block = GetBlock(block_index);
-      for (size_t i = view_index; i < block.Get().GetKVView().size(); ++i) {
-        const Entry& entry = block.Get().GetViewByIndex(i);
+    while (true) {
+      for (size_t i = view_index; i < block->Get().GetKVCount(); ++i) {
+        Entry entry = block->Get().GetViewByIndex(i);
         GetRangeOption state = functor(entry);
         if (state == GetRangeOption::SKIP) {
           continue;
@@ -259,33 +608,925 @@ class BlockManager {
           return result;
         }
       }
-      // 下一个block
-      block_index = block.Get().GetNext();
-      view_index = 0;
-      scan.Add();
+      scan.Add();
+      // 下一个block，从左向右加锁，先持有下一个block的latch再释放当前block的latch
+      uint32_t next_index = block->Get().GetNext();
+      if (next_index == 0) {
+        break;
+      }
+      if (readahead.OnNext(next_index) == true) {
+        size_t count = block->Get().GetKVCount();
+        if (readahead.NeedFrontier() == true && count > 0) {
+          readahead.SetFrontier(block->Get().GetViewByIndex(count - 1).key_view);
+        }
+        if (readahead.NeedFrontier() == false) {
+          // 预读需要自上而下访问内部节点，先释放叶子节点的latch以符合加锁顺序，tree latch保证next链接不会改变
+          block.reset();
+          readahead.Fill(next_index);
+        }
+      }
+      ReadLatchedBlock next_block(GetBlock(next_index));
+      block.reset();
+      block.emplace(std::move(next_block));
+      view_index = 0;
+    }
+    BPTREE_LOG_DEBUG("get range, key == {}, scans {} blocks", key, scan.GetValue());
+    return result;
+  }
+
+  /**
+   * @brief 接口函数，创建一个快照，之后可以通过快照读取创建时刻的数据，快照存在期间不会阻塞写操作
+   * @return 快照，析构时释放
+   * @note 快照需要在BlockManager析构之前释放，快照存在期间被修改的block的旧版本会保存在内存中
+   */
+  BPTREE_INTERFACE std::shared_ptr<Snapshot> GetSnapshot() {
+    if (mode_ != Mode::R && mode_ != Mode::WR) {
+      throw BptreeExecption("Permission denied");
+    }
+    // 等待正在执行的写操作结束，此时所有已分配版本号的写操作都已经完成
+    std::unique_lock<std::shared_mutex> tree_guard(tree_latch_);
+    return std::make_shared<Snapshot>(version_store_, write_version_.load());
+  }
+
+  /**
+   * @brief 接口函数，在快照中根据key查询value
+   * @note 同Get(key)
+   */
+  BPTREE_INTERFACE std::string Get(const std::string& key, const std::shared_ptr<Snapshot>& snapshot) {
+    if (mode_ != Mode::R && mode_ != Mode::WR) {
+      throw BptreeExecption("Permission denied");
+    }
+    if (key.size() != super_block_.key_size_) {
+      throw BptreeExecption("wrong key length");
+    }
+    GetMetricSet().GetAs<Counter>("get_count")->Add();
+    uint64_t version = snapshot->GetVersion();
+    std::shared_lock<std::shared_mutex> tree_guard(tree_latch_);
+    uint32_t leaf_index = FindLeafBlockIndexOfVersion(key, version);
+    if (leaf_index == 0) {
+      return "";
+    }
+    return VisitBlockOfVersion(leaf_index, version, [&key](const Block& block) -> std::string {
+      size_t view_index = block.SearchKey(key);
+      if (view_index == block.GetKVCount()) {
+        return "";
+      }
+      return std::string(block.GetViewByIndex(view_index).value_view);
+    });
+  }
+
+  /**
+   * @brief 接口函数，在快照中进行范围查找
+   * @note 同GetRange(key, functor, start)，区别在于每扫描一个block就释放tree latch，因此长时间的扫描不会阻塞写操作
+   */
+  BPTREE_INTERFACE std::vector<std::pair<std::string, std::string>> GetRange(
+      const std::string& key, std::function<GetRangeOption(const Entry& entry)> functor,
+      const std::shared_ptr<Snapshot>& snapshot, RangeStart start = RangeStart::EQ) {
+    if (mode_ != Mode::R && mode_ != Mode::WR) {
+      throw BptreeExecption("Permission denied");
+    }
+    if (key.size() != super_block_.key_size_) {
+      throw BptreeExecption("wrong key length");
+    }
+    GetMetricSet().GetAs<Counter>("get_range_count")->Add();
+    uint64_t version = snapshot->GetVersion();
+    uint32_t block_index = 0;
+    {
+      std::shared_lock<std::shared_mutex> tree_guard(tree_latch_);
+      block_index = FindLeafBlockIndexOfVersion(key, version);
+    }
+    Counter scan("scan count");
+    std::vector<std::pair<std::string, std::string>> result;
+    bool first_block = true;
+    bool stop = false;
+    while (block_index != 0 && stop == false) {
+      std::shared_lock<std::shared_mutex> tree_guard(tree_latch_);
+      block_index = VisitBlockOfVersion(block_index, version, [&](const Block& block) -> uint32_t {
+        size_t view_index = 0;
+        if (first_block == true) {
+          first_block = false;
+          view_index = SearchRangeStart(block, key, start);
+          // 起始key不存在
+          if (start == RangeStart::EQ && view_index == block.GetKVCount()) {
+            stop = true;
+            return 0;
+          }
+        }
+        for (size_t i = view_index; i < block.GetKVCount(); ++i) {
+          Entry entry = block.GetViewByIndex(i);
+          GetRangeOption state = functor(entry);
+          if (state == GetRangeOption::SKIP) {
+            continue;
+          } else if (state == GetRangeOption::SELECT) {
+            result.push_back({std::string(entry.key_view), std::string(entry.value_view)});
+          } else {
+            stop = true;
+            return 0;
+          }
+        }
+        return block.GetNext();
+      });
+      scan.Add();
+    }
+    BPTREE_LOG_DEBUG("get range in snapshot {}, key == {}, scans {} blocks", version, key, scan.GetValue());
+    return result;
+  }
+
+  /**
+   * @brief 接口函数，将key-value插入db
+   * @param key 用户指定的key
+   * @param value 用户指定的value
+   * @param seq 事务编号，用于将多个读写操作组合成单个事务进行wal记录，用户使用默认值即可
+   * @return
+   *      - true 插入成功
+   *      - false key已经在db中存在，插入失败
+   * @note 用户需要有写权限，key和value的大小需要和构造时指定的key_size和value_size一致，否则抛出异常
+   */
+  BPTREE_INTERFACE bool Insert(const std::string& key, const std::string& value, uint64_t seq = no_wal_sequence) {
+    if (mode_ != Mode::W && mode_ != Mode::WR) {
+      throw BptreeExecption("Permission denied");
+    }
+    if (key.size() != super_block_.key_size_ || value.size() != super_block_.value_size_) {
+      throw BptreeExecption("wrong kv length");
+    }
+    GetMetricSet().GetAs<Counter>("insert_count")->Add();
+    // 首先尝试不会引起分裂的插入（与其他读写操作并发执行），失败后持有tree latch的独占锁执行插入
+    std::optional<bool> result = InsertWithoutSplit(key, value, seq);
+    if (result.has_value() == false) {
+      result = InsertExclusively(key, value, seq);
+    }
+    if (seq == no_wal_sequence) {
+      AfterCommitTx();
+    }
+    return result.value();
+  }
+
+  /**
+   * @brief 接口函数，删除key指定的kv对
+   * @param key 用户指定的key
+   * @param seq 事务编号，用于将多个读写操作组合成单个事务进行wal记录，用户使用默认值即可
+   * @return
+   *      - 空字符串 指定的key在db中不存在
+   *      - 非空字符串，删除掉的value值
+   * @note 用户需要有写权限，key的大小需要和构造时指定的key_size一致，否则抛出异常
+   */
+  BPTREE_INTERFACE std::string Delete(const std::string& key, uint64_t seq = no_wal_sequence) {
+    if (mode_ != Mode::W && mode_ != Mode::WR) {
+      throw BptreeExecption("Permission denied");
+    }
+    if (key.size() != super_block_.key_size_) {
+      throw BptreeExecption("wrong key length");
+    }
+    GetMetricSet().GetAs<Counter>("delete_count")->Add();
+    // 首先尝试不会引起合并的删除（与其他读写操作并发执行），失败后持有tree latch的独占锁执行删除
+    std::optional<std::string> result = DeleteWithoutMerge(key, seq);
+    if (result.has_value() == false) {
+      result = DeleteExclusively(key, seq);
+    }
+    if (seq == no_wal_sequence) {
+      AfterCommitTx();
+    }
+    return result.value();
+  }
+
+  /**
+   * @brief 接口函数，将db中的key对应的值更新为value
+   * @param key 用户指定的key
+   * @param value 用户指定的value
+   * @param seq 事务编号，用于将多个读写操作组合成单个事务进行wal记录，用户使用默认值即可
+   * @return
+   *      - 空字符串 指定的key在db中不存在
+   *      - 非空字符串，更新前的value值
+   * @note 用户需要有写权限，key和value的大小需要和构造时指定的key_size和value_size一致，否则抛出异常
+   */
+  BPTREE_INTERFACE std::string Update(const std::string& key, const std::string& value,
+                                      uint64_t seq = no_wal_sequence) {
+    if (mode_ != Mode::W && mode_ != Mode::WR) {
+      throw BptreeExecption("Permission denied");
+    }
+    if (key.size() != super_block_.key_size_) {
+      throw BptreeExecption("wrong key length");
+    }
+    GetMetricSet().GetAs<Counter>("update_count")->Add();
+    std::string old_v;
+    {
+      // update只修改叶子节点，不会改变树的结构
+      std::shared_lock<std::shared_mutex> tree_guard(tree_latch_);
+      WriteVersionGuard version_guard(write_version_);
+      auto leaf = FindLeafBlock<WriteLatchedBlock>(key);
+      if (leaf.has_value() == true) {
+        uint64_t sequence = seq;
+        if (sequence == no_wal_sequence) {
+          sequence = wal_.RequestSeq();
+          wal_.Begin(sequence);
+        }
+        old_v = leaf->Get().Update(key, value, sequence).old_v_;
+        // 在释放latch之前写入事务结束日志，保证修改同一个block的事务的日志顺序与修改顺序一致
+        if (seq == no_wal_sequence) {
+          wal_.End(sequence);
+        }
+      }
+    }
+    if (seq == no_wal_sequence) {
+      AfterCommitTx();
+    }
+    return old_v;
+  }
+
+  BPTREE_INTERFACE void PrintOption() const {
+    BPTREE_LOG_INFO("db name                  : {}", db_name_);
+    BPTREE_LOG_INFO("mode                     : {}", ModeStr(mode_));
+    BPTREE_LOG_INFO("cache size               : {}", block_cache_.GetCapacity());
+    BPTREE_LOG_INFO("cache shard count        : {}", block_cache_.GetShardCount());
+    BPTREE_LOG_INFO("cache policy             : {}", CachePolicyStr(block_cache_.GetPolicy()));
+    BPTREE_LOG_INFO("inner block cache size   : {}", block_cache_.GetHighPriorityCapacity());
+    BPTREE_LOG_INFO("key size                 : {}", super_block_.key_size_);
+    BPTREE_LOG_INFO("value size               : {}", super_block_.value_size_);
+    BPTREE_LOG_INFO("create checkpoint per op : {}", create_checkpoint_per_op_);
+    BPTREE_LOG_INFO("readahead blocks         : {}", readahead_blocks_);
+    BPTREE_LOG_INFO("io engine                : {}", IoEngineStr(f_.GetIoEngine()));
+    BPTREE_LOG_INFO("key filter               : {}", enable_key_filter_ ? "true" : "false");
+    BPTREE_LOG_INFO("mmap read only           : {}", mapped_db_.Mapped() ? "true" : "false");
+    BPTREE_LOG_INFO("direct io                : {}", direct_io_ ? "true" : "false");
+    BPTREE_LOG_INFO("buffer pool capacity     : {}", buffer_pool_.Capacity());
+    BPTREE_LOG_INFO("row cache bytes          : {}", row_cache_ == nullptr ? 0 : row_cache_->GetCapacity());
+    BPTREE_LOG_INFO("sync per write           : {}", sync_per_write_ ? "true" : "false");
+    BPTREE_LOG_INFO("group commit batch size  : {}", group_commit_batch_size_);
+    BPTREE_LOG_INFO("group commit max wait us : {}", group_commit_max_wait_.count());
+    BPTREE_LOG_INFO("wal buffer size          : {}", wal_.GetBufferSize());
+  }
+
+  BPTREE_INTERFACE void PrintRootBlock() {
+    std::shared_lock<std::shared_mutex> tree_guard(tree_latch_);
+    auto root_block = GetBlock(super_block_.root_index_);
+    root_block.Get().Print();
+  }
+
+  BPTREE_INTERFACE void PrintBlockByIndex(uint32_t index) {
+    if (index == 0) {
+      PrintSuperBlockInfo();
+      return;
+    }
+    if (super_block_.current_max_block_index_ < index) {
+      throw BptreeExecption("request block's index invalid : {}", index);
+    }
+    std::shared_lock<std::shared_mutex> tree_guard(tree_latch_);
+    auto block = GetBlock(index);
+    block.Get().Print();
+  }
+
+  BPTREE_INTERFACE void PrintCacheInfo() { block_cache_.PrintInfo(); }
+
+  BPTREE_INTERFACE const BlockBufferPool& GetBufferPool() const noexcept { return buffer_pool_; }
+
+  BPTREE_INTERFACE void PrintMetricSet() { metric_set_.Print(); }
+
+  BPTREE_INTERFACE void PrintSuperBlockInfo() {
+    BPTREE_LOG_INFO("-----begin super block print-----");
+    BPTREE_LOG_INFO("root_index : {}", super_block_.root_index_);
+    BPTREE_LOG_INFO("key size and value size : {} {}", super_block_.key_size_, super_block_.value_size_);
+    BPTREE_LOG_INFO("free block size : {}", super_block_.free_block_size_);
+    BPTREE_LOG_INFO("total block size : {}", super_block_.current_max_block_index_ + 1);
+    double tmp = double(super_block_.free_block_size_) / double(super_block_.current_max_block_index_ + 1);
+    BPTREE_LOG_INFO("free_block_size / total_block_size : {}", tmp);
+    BPTREE_LOG_INFO("------end super block print------");
+  }
+
+  FaultInjection& GetFaultInjection() { return fj_; }
+
+  WriteAheadLog& GetWal() { return wal_; }
+
+  MetricSet& GetMetricSet() { return metric_set_; }
+
+  const Comparator& GetComparator() { return *comparator_.get(); }
+
+  KeyKind GetKeyKind() const noexcept { return key_kind_; }
+
+  typename ShardedCache<uint32_t, Block>::Wrapper GetBlock(uint32_t index) {
+    auto wrapper = block_cache_.Get(index);
+    if (wrapper.Exist() == true) {
+      return wrapper;
+    }
+    // 同一个block的加载过程需要串行化，否则多个线程会重复加载，并且可能将已经被淘汰刷盘的block的旧版本插入cache
+    std::lock_guard<std::mutex> guard(load_latches_[index % load_latches_.size()]);
+    wrapper = block_cache_.Get(index);
+    if (wrapper.Exist() == true) {
+      return wrapper;
+    }
+    // 淘汰回调在释放cache分片的锁之后才刷盘，刷盘完成之前从文件中读到的是旧版本
+    block_cache_.WaitForEviction(index);
+    GetMetricSet().GetAs<Counter>("load_block_count")->Add();
+    auto block = LoadBlock(index);
+    // 内部节点位于每次查找的路径上，优先保留在cache中
+    bool inner = block->GetHeight() > 0;
+    if (inner == true) {
+      GetMetricSet().GetAs<Counter>("load_inner_block_count")->Add();
+    }
+    return block_cache_.GetOrInsert(index, std::move(block), inner);
+  }
+
+  // 当前线程正在执行的写操作的版本号，不在写操作中时为0
+  static uint64_t& CurrentWriteVersion() noexcept {
+    static thread_local uint64_t version = 0;
+    return version;
+  }
+
+  /**
+   * @brief block被修改之前调用，如果有快照需要block修改前的数据，则保存修改前的镜像
+   * @note 调用方持有block的独占latch或者tree_latch_的独占锁
+   */
+  void BeforeBlockModify(Block& block) {
+    uint64_t version = CurrentWriteVersion();
+    // 不在写操作中（构造、恢复等流程），或者本次写操作已经处理过这个block
+    if (version == 0 || block.GetVersion() == version) {
+      return;
+    }
+    LatchForExclusiveWrite(block);
+    uint64_t block_version = block.GetVersion();
+    // 需要在CreateDataView之前更新，因为CreateDataView会再次调用SetDirty
+    block.SetVersion(version);
+    if (version_store_.NeedToSave(block_version) == false) {
+      return;
+    }
+    std::string view = block.CreateDataView();
+    char* buf = buffer_pool_.Allocate();
+    memcpy(buf, view.data(), block_size);
+    auto image = std::make_shared<Block>(*this, buf);
+    bool succ = image->Parse();
+    if (succ == false) {
+      throw BptreeExecption("parse block {}'s image fail", block.GetIndex());
+    }
+    GetMetricSet().GetAs<Counter>("save_block_version_count")->Add();
+    version_store_.Save(block.GetIndex(), version, std::move(image));
+  }
+
+  // 持有tree_latch_的独占锁的写操作已经获得写latch的block，不在这类写操作中时为nullptr，见ExclusiveLatchGuard
+  using ExclusiveLatches = std::unordered_map<uint32_t, WriteLatchedBlock>;
+  static ExclusiveLatches*& CurrentExclusiveLatches() noexcept {
+    static thread_local ExclusiveLatches* latches = nullptr;
+    return latches;
+  }
+
+  /**
+   * @brief 持有tree_latch_的独占锁的写操作第一次修改block之前调用，获得block的写latch并保持到写操作结束
+   * @note 此时只有PinnableValue可能持有block的读latch，并且不会在持有期间等待其他latch，因此可以按照任意顺序加锁
+   */
+  void LatchForExclusiveWrite(const Block& block) {
+    ExclusiveLatches* latches = CurrentExclusiveLatches();
+    if (latches == nullptr || latches->count(block.GetIndex()) > 0) {
+      return;
+    }
+    auto wrapper = block_cache_.Get(block.GetIndex());
+    // 不在cache中的block（从空闲链表中取出的block）不会被PinnableValue持有
+    if (wrapper.Exist() == false) {
+      return;
+    }
+    latches->try_emplace(block.GetIndex(), std::move(wrapper));
+  }
+
+  uint32_t GetRootIndex() const noexcept { return super_block_.root_index_; }
+
+  uint32_t GetMaxBlockIndex() const noexcept { return super_block_.current_max_block_index_; }
+
+ private:
+  /*
+   * 并发控制：
+   * tree_latch_保护树的结构，不会引起分裂/合并的读写操作持有共享锁，并在block上使用latch crabbing：
+   *   - 读操作从根节点开始持有block的共享latch，获得子节点的latch之后释放父节点的latch
+   *   - 写操作持有block的独占latch，当确定祖先节点不会被修改时释放祖先节点的latch
+   * 如果写操作在叶子节点发现需要分裂/合并，则释放所有latch，持有tree_latch_的独占锁之后重新执行，
+   * 这种情况下没有其他线程访问树，因此不需要block latch。
+   * 加锁顺序：tree_latch_ -> 自上而下的block latch -> 同一层自左向右的block latch，因此不会死锁
+   */
+
+  // 返回叶子节点中范围查找的起始下标，没有满足条件的元素时返回GetKVCount()
+  size_t SearchRangeStart(const Block& block, const std::string& key, RangeStart start) const {
+    if (start == RangeStart::GE) {
+      return block.SearchTheFirstGEKey(key);
+    } else if (start == RangeStart::GT) {
+      return block.SearchTheFirstGTKey(key);
+    }
+    return block.SearchKey(key);
+  }
+
+  // 持有tree_latch_的共享锁时调用，自上而下持有内部节点的共享latch，返回包含key的叶子节点（使用LatchedBlockType加锁）
+  // 如果key大于树中所有的key，返回std::nullopt
+  template <typename LatchedBlockType>
+  std::optional<LatchedBlockType> FindLeafBlock(const std::string& key) {
+    std::optional<ReadLatchedBlock> block;
+    block.emplace(GetBlock(super_block_.root_index_));
+    while (true) {
+      // 根节点的高度至少为1
+      assert(block->Get().GetHeight() > 0);
+      size_t child = block->Get().SearchTheFirstGEKey(key);
+      if (child == block->Get().GetKVCount()) {
+        return std::nullopt;
+      }
+      uint32_t child_index = block->Get().GetChildIndex(child);
+      if (block->Get().GetHeight() == 1) {
+        return std::optional<LatchedBlockType>(std::in_place, GetBlock(child_index));
+      }
+      ReadLatchedBlock child_block(GetBlock(child_index));
+      block.reset();
+      block.emplace(std::move(child_block));
+    }
+  }
+
+  // 持有tree_latch_的共享锁和block的读latch时调用，在block下查找order[begin, end)对应的key（order按照key有序）
+  // 子节点按照从左到右的顺序加latch，符合加锁顺序
+  void MultiGetFromInnerBlock(const Block& block, std::span<const std::string> keys, const std::vector<size_t>& order,
+                              size_t begin, size_t end, std::vector<std::string>& values) {
+    assert(block.GetHeight() > 0);
+    // 按照子节点的max key将有序的key划分到各个子节点
+    std::vector<std::tuple<uint32_t, size_t, size_t>> children;
+    size_t i = begin;
+    while (i < end) {
+      size_t child = block.SearchTheFirstGEKey(keys[order[i]]);
+      if (child == block.GetKVCount()) {
+        // 剩余的key都大于树中所有的key
+        break;
+      }
+      std::string_view max_key = block.GetViewByIndex(child).key_view;
+      size_t j = i + 1;
+      while (j < end && GetComparator().Compare(keys[order[j]], max_key) <= 0) {
+        ++j;
+      }
+      children.emplace_back(block.GetChildIndex(child), i, j);
+      i = j;
+    }
+    if (block.GetHeight() == 1 && children.size() > 1) {
+      std::vector<uint32_t> indices;
+      for (auto& [index, child_begin, child_end] : children) {
+        indices.push_back(index);
+      }
+      PrefetchBlocks(indices);
+    }
+    for (auto& [index, child_begin, child_end] : children) {
+      ReadLatchedBlock child(GetBlock(index));
+      if (child.Get().GetHeight() > 0) {
+        MultiGetFromInnerBlock(child.Get(), keys, order, child_begin, child_end, values);
+        continue;
+      }
+      for (size_t k = child_begin; k < child_end; ++k) {
+        std::string_view value;
+        if (child.Get().GetValueByKey(keys[order[k]], value) == true) {
+          values[order[k]].assign(value);
+        }
+      }
+    }
+  }
+
+  /*
+   * 对indices中不在cache中的block发起预读，indices中只保留实际发起预读的block
+   * 使用io_uring时在当前线程上通过一次批量读取同步加载到cache中（不是异步预读，返回时读取已经完成），
+   * 否则通知内核预读，之后GetBlock中的同步读取可以命中page cache
+   * 批量加载的数量不超过cache容量的1/4，避免预读的block互相淘汰，超出的部分同样只通知内核预读
+   */
+  void PrefetchBlocks(std::vector<uint32_t>& indices) {
+    std::erase_if(indices, [this](uint32_t index) { return block_cache_.Contains(index); });
+    GetMetricSet().GetAs<Counter>("prefetch_block_count")->Add(indices.size());
+    // 映射的block加载时不读取文件，只需要通知内核预读映射的页
+    if (mapped_db_.Mapped() == true) {
+      for (auto index : indices) {
+        mapped_db_.Prefetch(block_size, static_cast<size_t>(index) * block_size);
+      }
+      return;
+    }
+    size_t load_count = 0;
+    if (f_.GetIoEngine() == IoEngine::IO_URING) {
+      load_count = std::min(indices.size(), block_cache_.GetCapacity() / 4);
+      LoadBlocks(std::span<const uint32_t>(indices.data(), load_count));
+    }
+    // direct io绕过page cache，通知内核预读没有意义
+    if (direct_io_ == true) {
+      return;
+    }
+    for (size_t i = load_count; i < indices.size(); ++i) {
+      f_.Prefetch(block_size, static_cast<size_t>(indices[i]) * block_size);
+    }
+  }
+
+  // 批量读取不在cache中的block并插入cache，加载过程与GetBlock相同，持有对应的加载锁
+  void LoadBlocks(std::span<const uint32_t> indices) {
+    // 按照加载锁的下标递增的顺序加锁，GetBlock只持有一个加载锁，因此不会死锁
+    std::vector<size_t> latches;
+    for (auto index : indices) {
+      latches.push_back(index % load_latches_.size());
+    }
+    std::sort(latches.begin(), latches.end());
+    latches.erase(std::unique(latches.begin(), latches.end()), latches.end());
+    std::vector<std::unique_lock<std::mutex>> guards;
+    for (auto each : latches) {
+      guards.emplace_back(load_latches_[each]);
+    }
+    std::vector<uint32_t> missing;
+    std::vector<IoRequest> requests;
+    for (auto index : indices) {
+      // 加锁之前可能已经被其他线程加载
+      if (block_cache_.Contains(index) == true) {
+        continue;
+      }
+      // 见GetBlock
+      block_cache_.WaitForEviction(index);
+      char* buf = buffer_pool_.Allocate();
+      missing.push_back(index);
+      requests.push_back(IoRequest{buf, block_size, static_cast<size_t>(index) * block_size});
+    }
+    try {
+      f_.ReadBatch(requests);
+    } catch (...) {
+      for (auto& each : requests) {
+        buffer_pool_.Release(each.buf);
+      }
+      throw;
+    }
+    for (size_t i = 0; i < missing.size(); ++i) {
+      GetMetricSet().GetAs<Counter>("load_block_count")->Add();
+      std::unique_ptr<Block> block;
+      try {
+        block = ParseLoadedBlock(missing[i], requests[i].buf);
+      } catch (...) {
+        // requests[i].buf由解析失败的block持有并在析构时归还，之后的buf还没有交给任何block
+        for (size_t j = i + 1; j < requests.size(); ++j) {
+          buffer_pool_.Release(requests[j].buf);
+        }
+        throw;
+      }
+      bool inner = block->GetHeight() > 0;
+      if (inner == true) {
+        GetMetricSet().GetAs<Counter>("load_inner_block_count")->Add();
+      }
+      // 持有加载锁并且已经确认不在cache中，直接插入；不经过引用计数，预读的block在2Q中仍然进入probation_
+      block_cache_.Insert(missing[i], std::move(block), inner);
+    }
+  }
+
+  // 与GetPinned一样检查权限和key的长度，命中时计入get_count
+  bool LookupRowCache(const std::string& key, std::string& value) {
+    if (mode_ != Mode::R && mode_ != Mode::WR) {
+      throw BptreeExecption("Permission denied");
+    }
+    if (key.size() != super_block_.key_size_) {
+      throw BptreeExecption("wrong key length");
+    }
+    if (row_cache_->Lookup(key, value) == false) {
+      GetMetricSet().GetAs<Counter>("row_cache_miss_count")->Add();
+      return false;
+    }
+    GetMetricSet().GetAs<Counter>("get_count")->Add();
+    GetMetricSet().GetAs<Counter>("row_cache_hit_count")->Add();
+    return true;
+  }
+
+  // 叶子节点中key对应的value被修改或者删除时调用，调用方持有叶子节点的写latch或者tree_latch_的独占锁
+  void InvalidateRow(std::string_view key) {
+    if (row_cache_ != nullptr) {
+      row_cache_->Erase(key);
+    }
+  }
+
+  // 持有tree_latch_时调用，返回false表示key一定不存在
+  bool KeyMayExist(const std::string& key) {
+    if (key_filter_ == nullptr || key_filter_->MayContain(key) == true) {
+      return true;
+    }
+    GetMetricSet().GetAs<Counter>("key_filter_skip_count")->Add();
+    return false;
+  }
+
+  // 插入和删除成功之后、释放tree_latch_之前调用
+  void AddToKeyFilter(const std::string& key) {
+    if (key_filter_ != nullptr) {
+      key_filter_->Add(key);
+    }
+  }
+
+  void RemoveFromKeyFilter(const std::string& key) {
+    if (key_filter_ != nullptr) {
+      key_filter_->Remove(key);
+    }
+  }
+
+  /*
+   * 构造过程中wal恢复之后调用，加载上一个check point持久化的filter
+   * check point之后的修改只记录在wal中，因此将恢复过程中修改过的叶子节点中的key重新加入filter，重复加入的key只会导致误判
+   * filter文件不存在或者损坏时遍历所有叶子节点重新构建
+   */
+  void InitKeyFilter() {
+    std::string file_name = CreateKeyFilterFileNameByDB(db_name_);
+    if (util::FileNotExist(file_name) == false) {
+      std::string data(std::filesystem::file_size(file_name), '\0');
+      FileHandler f = FileHandler::OpenFile(file_name);
+      f.Read(data.data(), data.size(), 0);
+      key_filter_ = CuckooFilter::Deserialize(data);
+      if (key_filter_ == nullptr) {
+        BPTREE_LOG_WARN("key filter file {} is broken, rebuild it", file_name);
+      }
+    }
+    if (key_filter_ == nullptr || key_filter_->Overflowed() == true) {
+      RebuildKeyFilter();
+    } else {
+      std::sort(recovered_blocks_.begin(), recovered_blocks_.end());
+      recovered_blocks_.erase(std::unique(recovered_blocks_.begin(), recovered_blocks_.end()), recovered_blocks_.end());
+      for (auto index : recovered_blocks_) {
+        // 被回滚的分配操作对应的block不存在
+        if (index == 0 || index > super_block_.current_max_block_index_) {
+          continue;
+        }
+        auto block = GetBlock(index);
+        if (block.Get().GetHeight() != 0) {
+          continue;
+        }
+        for (size_t i = 0; i < block.Get().GetKVCount(); ++i) {
+          key_filter_->Add(block.Get().GetViewByIndex(i).key_view);
+        }
+      }
+    }
+    recovered_blocks_.clear();
+    recovered_blocks_.shrink_to_fit();
+  }
+
+  // 没有其他线程访问树时调用（构造或者生成check point期间），遍历所有叶子节点重新构建filter
+  void RebuildKeyFilter() {
+    BPTREE_LOG_INFO("begin to rebuild key filter");
+    GetMetricSet().GetAs<Counter>("key_filter_rebuild_count")->Add();
+    // 通过内部节点统计叶子节点的数量，按照叶子节点全满估计filter的容量
+    size_t leaf_count = 0;
+    uint32_t first_leaf = 0;
+    CountLeafBlocks(super_block_.root_index_, leaf_count, first_leaf);
+    size_t capacity = 0;
+    if (first_leaf != 0) {
+      capacity = leaf_count * GetBlock(first_leaf).Get().GetMaxEntrySize();
+    }
+    auto filter = std::make_unique<CuckooFilter>(capacity);
+    for (uint32_t index = first_leaf; index != 0;) {
+      auto block = GetBlock(index);
+      for (size_t i = 0; i < block.Get().GetKVCount(); ++i) {
+        filter->Add(block.Get().GetViewByIndex(i).key_view);
+      }
+      index = block.Get().GetNext();
+    }
+    key_filter_ = std::move(filter);
+    BPTREE_LOG_INFO("rebuild key filter succ, {} keys, {} buckets", key_filter_->Size(), key_filter_->BucketCount());
+  }
+
+  void CountLeafBlocks(uint32_t index, size_t& leaf_count, uint32_t& first_leaf) {
+    auto block = GetBlock(index);
+    assert(block.Get().GetHeight() > 0);
+    for (size_t i = 0; i < block.Get().GetKVCount(); ++i) {
+      uint32_t child = block.Get().GetChildIndex(i);
+      if (block.Get().GetHeight() > 1) {
+        CountLeafBlocks(child, leaf_count, first_leaf);
+        continue;
+      }
+      leaf_count += 1;
+      if (first_leaf == 0) {
+        first_leaf = child;
+      }
+    }
+  }
+
+  // 先写入临时文件再重命名，崩溃时保留上一次完整的filter
+  void SaveKeyFilter() {
+    std::string data = key_filter_->Serialize();
+    std::string file_name = CreateKeyFilterFileNameByDB(db_name_);
+    std::string tmp_file_name = file_name + ".tmp";
+    util::DeleteFile(tmp_file_name);
+    {
+      FileHandler f = FileHandler::CreateFile(tmp_file_name);
+      f.Write(data.data(), data.size());
+      f.Flush();
+    }
+    util::RenameFile(tmp_file_name, file_name);
+  }
+
+  // buf池在cache_size之外额外容纳的frame数量，用于super block、空闲block、快照保存的block镜像以及正在加载的block
+  static constexpr size_t buffer_pool_reserved_frames = 64;
+
+  // 范围查找连续访问这么多个后继叶子节点之后开始预读，避免短的范围查找发起无用的预读
+  static constexpr size_t readahead_trigger_blocks = 2;
+
+  // 一次范围查找中的预读状态，析构时统计没有被访问到的预读
+  // 补充预读计划在范围查找的线程上进行，IO_URING时是一次同步的批量读取，以一次较长的停顿换取之后多个叶子节点命中cache
+  class LeafReadahead {
+   public:
+    explicit LeafReadahead(BlockManager& manager) : manager_(manager) {}
+
+    ~LeafReadahead() {
+      for (auto& [index, prefetched] : planned_) {
+        if (prefetched == true) {
+          manager_.GetMetricSet().GetAs<Counter>("readahead_wasted_count")->Add();
+        }
+      }
+    }
+
+    // 范围查找从当前叶子节点移动到next_index之前调用，返回是否需要补充预读计划
+    bool OnNext(uint32_t next_index) {
+      followed_ += 1;
+      if (planned_.empty() == false) {
+        auto [index, prefetched] = planned_.front();
+        if (index != next_index) {
+          // 预读计划按照父节点中的key顺序生成，与next链接不一致时只影响预读效果，丢弃计划并从当前叶子节点重新开始
+          planned_.clear();
+          frontier_.clear();
+          started_ = false;
+          return false;
+        }
+        planned_.pop_front();
+        if (prefetched == true) {
+          manager_.GetMetricSet().GetAs<Counter>("readahead_hit_count")->Add();
+        }
+      }
+      // 计划中的节点消耗掉一半之后再补充，使每次自上而下的查找可以补充多个叶子节点
+      return manager_.readahead_blocks_ > 0 && end_ == false && followed_ >= readahead_trigger_blocks &&
+             planned_.size() <= manager_.readahead_blocks_ / 2;
+    }
+
+    // 第一次补充预读计划之前需要设置为当前叶子节点的最大key
+    bool NeedFrontier() const noexcept { return frontier_.empty(); }
+
+    void SetFrontier(std::string_view key) { frontier_.assign(key); }
+
+    /*
+     * 持有tree_latch_的共享锁并且没有持有任何block的latch时调用（自上而下访问内部节点）
+     * 找到第一个key大于frontier_的叶子节点，将其及之后的叶子节点加入预读计划，直到计划中的节点数量达到readahead_blocks_
+     * tree latch保证叶子节点之间的链接关系不变，因此父节点中子节点的顺序与next链接的顺序一致
+     */
+    void Fill(uint32_t next_index) {
+      while (planned_.size() < manager_.readahead_blocks_) {
+        std::optional<ReadLatchedBlock> block;
+        block.emplace(manager_.GetBlock(manager_.super_block_.root_index_));
+        size_t child = 0;
+        while (true) {
+          child = block->Get().SearchTheFirstGTKey(frontier_);
+          if (child == block->Get().GetKVCount()) {
+            // 已经到达最后一个叶子节点
+            end_ = true;
+            return;
+          }
+          if (block->Get().GetHeight() == 1) {
+            break;
+          }
+          ReadLatchedBlock child_block(manager_.GetBlock(block->Get().GetChildIndex(child)));
+          block.reset();
+          block.emplace(std::move(child_block));
+        }
+        const Block& parent = block->Get();
+        std::vector<uint32_t> indices;
+        for (; child < parent.GetKVCount() && planned_.size() + indices.size() < manager_.readahead_blocks_; ++child) {
+          uint32_t index = parent.GetChildIndex(child);
+          frontier_.assign(parent.GetViewByIndex(child).key_view);
+          // 父节点中的max key可能大于叶子节点中实际的最大key，因此第一次查找可能定位到当前叶子节点，
+          // 跳过next_index及之前的节点，即将同步读取的next_index也不需要预读
+          if (started_ == false) {
+            started_ = index == next_index;
+            continue;
+          }
+          indices.push_back(index);
+        }
+        std::vector<uint32_t> prefetched = indices;
+        manager_.PrefetchBlocks(prefetched);
+        for (auto index : indices) {
+          bool found = std::find(prefetched.begin(), prefetched.end(), index) != prefetched.end();
+          planned_.emplace_back(index, found);
+        }
+      }
+    }
+
+   private:
+    BlockManager& manager_;
+    // 已经沿着next链接访问的叶子节点数量
+    size_t followed_ = 0;
+    // 按照链表顺序排列的预读计划，second表示是否实际发起了预读（已经在cache中的节点不需要预读）
+    std::deque<std::pair<uint32_t, bool>> planned_;
+    // 最后一个加入预读计划的叶子节点在父节点中的key
+    std::string frontier_;
+    // 预读计划是否已经越过了第一次补充时的next_index
+    bool started_ = false;
+    bool end_ = false;
+  };
+
+  // 释放path中除最后一个block之外的所有latch
+  void ReleaseAncestors(std::vector<WriteLatchedBlock>& path) {
+    if (path.size() <= 1) {
+      return;
+    }
+    WriteLatchedBlock last(std::move(path.back()));
+    path.clear();
+    path.push_back(std::move(last));
+  }
+
+  // 持有tree_latch_的共享锁时调用，以版本号为version的快照视图访问index对应的block，返回func的返回值
+  template <typename Func>
+  std::invoke_result_t<Func, const Block&> VisitBlockOfVersion(uint32_t index, uint64_t version, Func&& func) {
+    auto image = version_store_.Find(index, version);
+    if (image == nullptr) {
+      ReadLatchedBlock block(GetBlock(index));
+      // 持有latch之后需要再次查找，因为在此之前block可能被其他写操作修改
+      image = version_store_.Find(index, version);
+      if (image == nullptr) {
+        return func(static_cast<const Block&>(block.Get()));
+      }
+    }
+    return func(*image);
+  }
+
+  // 持有tree_latch_的共享锁时调用，返回在版本号为version的快照中包含key的叶子节点的index，不存在返回0
+  uint32_t FindLeafBlockIndexOfVersion(const std::string& key, uint64_t version) {
+    uint32_t index = super_block_.root_index_;
+    while (true) {
+      auto [is_leaf, next_index] =
+          VisitBlockOfVersion(index, version, [&](const Block& block) -> std::pair<bool, uint32_t> {
+            if (block.GetHeight() == 0) {
+              return {true, index};
+            }
+            size_t child = block.SearchTheFirstGEKey(key);
+            if (child == block.GetKVCount()) {
+              return {true, 0};
+            }
+            return {false, block.GetChildIndex(child)};
+          });
+      if (is_leaf == true) {
+        return next_index;
+      }
+      index = next_index;
     }
-    BPTREE_LOG_DEBUG("get range, key == {}, scans {} blocks", key, scan.GetValue());
-    return result;
   }
 
+  // 为当前线程的写操作分配版本号，析构时清除
+  class WriteVersionGuard {
+   public:
+    explicit WriteVersionGuard(std::atomic<uint64_t>& write_version) {
+      CurrentWriteVersion() = write_version.fetch_add(1) + 1;
+    }
+
+    ~WriteVersionGuard() { CurrentWriteVersion() = 0; }
+  };
+
+  // 持有tree_latch_的独占锁的写操作使用，析构时释放写操作期间获得的所有block的写latch，见LatchForExclusiveWrite
+  class ExclusiveLatchGuard {
+   public:
+    ExclusiveLatchGuard() { CurrentExclusiveLatches() = &latches_; }
+
+    ~ExclusiveLatchGuard() { CurrentExclusiveLatches() = nullptr; }
+
+   private:
+    ExclusiveLatches latches_;
+  };
+
   /**
-   * @brief 接口函数，将key-value插入db
-   * @param key 用户指定的key
-   * @param value 用户指定的value
-   * @param seq 事务编号，用于将多个读写操作组合成单个事务进行wal记录，用户使用默认值即可
-   * @return
-   *      - true 插入成功
-   *      - false key已经在db中存在，插入失败
-   * @note 用户需要有写权限，key和value的大小需要和构造时指定的key_size和value_size一致，否则抛出异常
+   * @brief 持有tree_latch_的共享锁执行插入，如果插入会导致分裂则不做任何修改并返回std::nullopt
+   * @note 路径上的内部节点只有在需要更新max key时才会被修改，其余祖先节点在获得子节点的latch后即可释放
    */
-  BPTREE_INTERFACE bool Insert(const std::string& key, const std::string& value, uint64_t seq = no_wal_sequence) {
-    if (mode_ != Mode::W && mode_ != Mode::WR) {
-      throw BptreeExecption("Permission denied");
+  std::optional<bool> InsertWithoutSplit(const std::string& key, const std::string& value, uint64_t seq) {
+    std::shared_lock<std::shared_mutex> tree_guard(tree_latch_);
+    WriteVersionGuard version_guard(write_version_);
+    std::vector<WriteLatchedBlock> path;
+    path.emplace_back(GetBlock(super_block_.root_index_));
+    bool ancestor_modified = false;
+    while (path.back().Get().GetHeight() > 0) {
+      Block& block = path.back().Get();
+      if (block.GetKVCount() == 0) {
+        return std::nullopt;
+      }
+      size_t child = block.SearchTheFirstGEKey(key);
+      if (child == block.GetKVCount()) {
+        // 需要更新本节点的max key
+        ancestor_modified = true;
+        child = block.GetKVCount() - 1;
+      }
+      path.emplace_back(GetBlock(block.GetChildIndex(child)));
+      if (ancestor_modified == false) {
+        ReleaseAncestors(path);
+      }
     }
-    if (key.size() != super_block_.key_size_ || value.size() != super_block_.value_size_) {
-      throw BptreeExecption("wrong kv length");
+    Block& leaf = path.back().Get();
+    if (leaf.SearchKey(key) != leaf.GetKVCount()) {
+      return false;
     }
-    GetMetricSet().GetAs<Counter>("insert_count")->Add();
+    if (leaf.IsFull() == true) {
+      return std::nullopt;
+    }
+    uint64_t sequence = seq;
+    if (sequence == no_wal_sequence) {
+      sequence = wal_.RequestSeq();
+      wal_.Begin(sequence);
+    }
+    InsertInfo info = path.front().Get().Insert(key, value, sequence);
+    assert(info.state_ == InsertInfo::State::Ok);
+    if (seq == no_wal_sequence) {
+      wal_.End(sequence);
+    }
+    // 在释放tree latch之前更新filter，保证check point时持久化的filter包含所有已经完成的插入
+    AddToKeyFilter(key);
+    return true;
+  }
+
+  bool InsertExclusively(const std::string& key, const std::string& value, uint64_t seq) {
+    std::unique_lock<std::shared_mutex> tree_guard(tree_latch_);
+    structure_version_ += 1;
+    ExclusiveLatchGuard latch_guard;
+    WriteVersionGuard version_guard(write_version_);
     uint64_t sequence = seq;
     if (sequence == no_wal_sequence) {
       sequence = wal_.RequestSeq();
@@ -304,140 +1545,80 @@ class BlockManager {
     }
     if (seq == no_wal_sequence) {
       wal_.End(sequence);
-      AfterCommitTx();
+    }
+    if (result == true) {
+      AddToKeyFilter(key);
     }
     return result;
   }
 
   /**
-   * @brief 接口函数，删除key指定的kv对
-   * @param key 用户指定的key
-   * @param seq 事务编号，用于将多个读写操作组合成单个事务进行wal记录，用户使用默认值即可
-   * @return
-   *      - 空字符串 指定的key在db中不存在
-   *      - 非空字符串，删除掉的value值
-   * @note 用户需要有写权限，key的大小需要和构造时指定的key_size一致，否则抛出异常
+   * @brief 持有tree_latch_的共享锁执行删除，如果删除会导致合并则不做任何修改并返回std::nullopt
+   * @note 当key等于某个内部节点中子节点的max key时，该内部节点需要在删除后更新max key，因此不能提前释放
    */
-  BPTREE_INTERFACE std::string Delete(const std::string& key, uint64_t seq = no_wal_sequence) {
-    if (mode_ != Mode::W && mode_ != Mode::WR) {
-      throw BptreeExecption("Permission denied");
+  std::optional<std::string> DeleteWithoutMerge(const std::string& key, uint64_t seq) {
+    std::shared_lock<std::shared_mutex> tree_guard(tree_latch_);
+    WriteVersionGuard version_guard(write_version_);
+    std::vector<WriteLatchedBlock> path;
+    path.emplace_back(GetBlock(super_block_.root_index_));
+    bool ancestor_modified = false;
+    while (path.back().Get().GetHeight() > 0) {
+      Block& block = path.back().Get();
+      size_t child = block.SearchTheFirstGEKey(key);
+      if (child == block.GetKVCount()) {
+        return "";
+      }
+      if (GetComparator().Compare(block.GetViewByIndex(child).key_view, key) == 0) {
+        ancestor_modified = true;
+      }
+      path.emplace_back(GetBlock(block.GetChildIndex(child)));
+      if (ancestor_modified == false) {
+        ReleaseAncestors(path);
+      }
     }
-    if (key.size() != super_block_.key_size_) {
-      throw BptreeExecption("wrong key length");
+    Block& leaf = path.back().Get();
+    size_t size = leaf.GetKVCount();
+    if (leaf.SearchKey(key) == size) {
+      return "";
+    }
+    if ((size - 1) * 2 < leaf.GetMaxEntrySize()) {
+      return std::nullopt;
     }
     uint64_t sequence = seq;
     if (sequence == no_wal_sequence) {
       sequence = wal_.RequestSeq();
       wal_.Begin(sequence);
     }
-    GetMetricSet().GetAs<Counter>("delete_count")->Add();
-    // 根节点的merge信息不处理
-    auto ret = GetBlock(super_block_.root_index_).Get().Delete(key, sequence);
+    DeleteInfo info = path.front().Get().Delete(key, sequence);
+    assert(info.state_ == DeleteInfo::State::Ok);
     if (seq == no_wal_sequence) {
       wal_.End(sequence);
-      AfterCommitTx();
     }
-    return ret.old_v_;
+    RemoveFromKeyFilter(key);
+    return info.old_v_;
   }
 
-  /**
-   * @brief 接口函数，将db中的key对应的值更新为value
-   * @param key 用户指定的key
-   * @param value 用户指定的value
-   * @param seq 事务编号，用于将多个读写操作组合成单个事务进行wal记录，用户使用默认值即可
-   * @return
-   *      - 空字符串 指定的key在db中不存在
-   *      - 非空字符串，更新前的value值
-   * @note 用户需要有写权限，key和value的大小需要和构造时指定的key_size和value_size一致，否则抛出异常
-   */
-  BPTREE_INTERFACE std::string Update(const std::string& key, const std::string& value,
-                                      uint64_t seq = no_wal_sequence) {
-    if (mode_ != Mode::W && mode_ != Mode::WR) {
-      throw BptreeExecption("Permission denied");
-    }
-    if (key.size() != super_block_.key_size_) {
-      throw BptreeExecption("wrong key length");
-    }
+  std::string DeleteExclusively(const std::string& key, uint64_t seq) {
+    std::unique_lock<std::shared_mutex> tree_guard(tree_latch_);
+    structure_version_ += 1;
+    ExclusiveLatchGuard latch_guard;
+    WriteVersionGuard version_guard(write_version_);
     uint64_t sequence = seq;
     if (sequence == no_wal_sequence) {
       sequence = wal_.RequestSeq();
       wal_.Begin(sequence);
     }
-    GetMetricSet().GetAs<Counter>("update_count")->Add();
-    auto ret = GetBlock(super_block_.root_index_).Get().Update(key, value, sequence);
+    // 根节点的merge信息不处理
+    auto ret = GetBlock(super_block_.root_index_).Get().Delete(key, sequence);
     if (seq == no_wal_sequence) {
       wal_.End(sequence);
-      AfterCommitTx();
-    }
-    return ret.old_v_;
-  }
-
-  BPTREE_INTERFACE void PrintOption() const {
-    BPTREE_LOG_INFO("db name                  : {}", db_name_);
-    BPTREE_LOG_INFO("mode                     : {}", ModeStr(mode_));
-    BPTREE_LOG_INFO("cache size               : {}", block_cache_.GetCapacity());
-    BPTREE_LOG_INFO("key size                 : {}", super_block_.key_size_);
-    BPTREE_LOG_INFO("value size               : {}", super_block_.value_size_);
-    BPTREE_LOG_INFO("create checkpoint per op : {}", create_checkpoint_per_op_);
-    BPTREE_LOG_INFO("sync per write           : {}", sync_per_write_ ? "true" : "false");
-  }
-
-  BPTREE_INTERFACE void PrintRootBlock() {
-    auto root_block = GetBlock(super_block_.root_index_);
-    root_block.Get().Print();
-  }
-
-  BPTREE_INTERFACE void PrintBlockByIndex(uint32_t index) {
-    if (index == 0) {
-      PrintSuperBlockInfo();
-      return;
     }
-    if (super_block_.current_max_block_index_ < index) {
-      throw BptreeExecption("request block's index invalid : {}", index);
-    }
-    auto block = GetBlock(index);
-    block.Get().Print();
-  }
-
-  BPTREE_INTERFACE void PrintCacheInfo() { block_cache_.PrintInfo(); }
-
-  BPTREE_INTERFACE void PrintMetricSet() { metric_set_.Print(); }
-
-  BPTREE_INTERFACE void PrintSuperBlockInfo() {
-    BPTREE_LOG_INFO("-----begin super block print-----");
-    BPTREE_LOG_INFO("root_index : {}", super_block_.root_index_);
-    BPTREE_LOG_INFO("key size and value size : {} {}", super_block_.key_size_, super_block_.value_size_);
-    BPTREE_LOG_INFO("free block size : {}", super_block_.free_block_size_);
-    BPTREE_LOG_INFO("total block size : {}", super_block_.current_max_block_index_ + 1);
-    double tmp = double(super_block_.free_block_size_) / double(super_block_.current_max_block_index_ + 1);
-    BPTREE_LOG_INFO("free_block_size / total_block_size : {}", tmp);
-    BPTREE_LOG_INFO("------end super block print------");
-  }
-
-  FaultInjection& GetFaultInjection() { return fj_; }
-
-  WriteAheadLog& GetWal() { return wal_; }
-
-  MetricSet& GetMetricSet() { return metric_set_; }
-
-  const Comparator& GetComparator() { return *comparator_.get(); }
-
-  typename LRUCache<uint32_t, Block>::Wrapper GetBlock(uint32_t index) {
-    auto wrapper = block_cache_.Get(index);
-    if (wrapper.Exist() == false) {
-      GetMetricSet().GetAs<Counter>("load_block_count")->Add();
-      auto block = LoadBlock(index);
-      block_cache_.Insert(index, std::move(block));
-      return block_cache_.Get(index);
+    if (ret.old_v_.empty() == false) {
+      RemoveFromKeyFilter(key);
     }
-    return wrapper;
+    return ret.old_v_;
   }
 
-  uint32_t GetRootIndex() const noexcept { return super_block_.root_index_; }
-
-  uint32_t GetMaxBlockIndex() const noexcept { return super_block_.current_max_block_index_; }
-
- private:
   std::pair<uint32_t, uint32_t> BlockSplit(const Block* block, uint64_t sequence) {
     BPTREE_LOG_DEBUG("block split begin");
     GetMetricSet().GetAs<Counter>("block_split_count")->Add();
@@ -446,14 +1627,14 @@ class BlockManager {
     auto new_block_1 = GetBlock(new_block_1_index);
     auto new_block_2 = GetBlock(new_block_2_index);
     // 在插入之前记录旧的数据快照, 作为undo log
-    std::string block_1_undo, block_2_undo;
+    LogHead block_1_undo, block_2_undo;
     if (sequence != no_wal_sequence) {
       block_1_undo = CreateResetBlockWalLog(new_block_1_index, new_block_1.Get().GetHeight(), super_block_.key_size_,
                                             super_block_.value_size_);
       block_2_undo = CreateResetBlockWalLog(new_block_2_index, new_block_2.Get().GetHeight(), super_block_.key_size_,
                                             super_block_.value_size_);
     }
-    size_t half_count = block->GetKVView().size() / 2;
+    size_t half_count = block->GetKVCount() / 2;
     for (size_t i = 0; i < half_count; ++i) {
       bool succ = new_block_1.Get().AppendKv(block->GetViewByIndex(i).key_view, block->GetViewByIndex(i).value_view,
                                              no_wal_sequence);
@@ -461,7 +1642,7 @@ class BlockManager {
         throw BptreeExecption("block broken (spliting)", i);
       }
     }
-    for (int i = half_count; i < block->GetKVView().size(); ++i) {
+    for (int i = half_count; i < block->GetKVCount(); ++i) {
       bool succ = new_block_2.Get().AppendKv(block->GetViewByIndex(i).key_view, block->GetViewByIndex(i).value_view,
                                              no_wal_sequence);
       if (succ == false) {
@@ -470,10 +1651,12 @@ class BlockManager {
     }
     // 插入之后记录新的数据快照，作为redo log
     if (sequence != no_wal_sequence) {
-      std::string block_1_redo = CreateBlockViewWalLog(new_block_1_index, new_block_1.Get().CreateDataView());
-      std::string block_2_redo = CreateBlockViewWalLog(new_block_2_index, new_block_2.Get().CreateDataView());
-      auto log_num_1 = wal_.WriteLog(sequence, block_1_redo, block_1_undo);
-      auto log_num_2 = wal_.WriteLog(sequence, block_2_redo, block_2_undo);
+      std::string view_1 = new_block_1.Get().CreateDataView();
+      std::string view_2 = new_block_2.Get().CreateDataView();
+      LogHead block_1_redo = CreateBlockViewWalLog(new_block_1_index);
+      LogHead block_2_redo = CreateBlockViewWalLog(new_block_2_index);
+      auto log_num_1 = wal_.WriteLog(sequence, LogPayload(block_1_redo.View(), view_1), block_1_undo.View());
+      auto log_num_2 = wal_.WriteLog(sequence, LogPayload(block_2_redo.View(), view_2), block_2_undo.View());
       new_block_1.Get().UpdateLogNumber(log_num_1);
       new_block_2.Get().UpdateLogNumber(log_num_2);
     }
@@ -511,18 +1694,18 @@ class BlockManager {
     GetMetricSet().GetAs<Counter>("block_merge_count")->Add();
     uint32_t new_block_index = AllocNewBlock(b1->GetHeight(), sequence);
     auto new_block = GetBlock(new_block_index);
-    std::string block_undo;
+    std::string undo_view;
     if (sequence != no_wal_sequence) {
-      block_undo = CreateBlockViewWalLog(new_block_index, new_block.Get().CreateDataView());
+      undo_view = new_block.Get().CreateDataView();
     }
-    for (size_t i = 0; i < b1->GetKVView().size(); ++i) {
+    for (size_t i = 0; i < b1->GetKVCount(); ++i) {
       bool succ =
           new_block.Get().AppendKv(b1->GetViewByIndex(i).key_view, b1->GetViewByIndex(i).value_view, no_wal_sequence);
       if (succ == false) {
         throw BptreeExecption("block broken (merging)");
       }
     }
-    for (size_t i = 0; i < b2->GetKVView().size(); ++i) {
+    for (size_t i = 0; i < b2->GetKVCount(); ++i) {
       bool succ =
           new_block.Get().AppendKv(b2->GetViewByIndex(i).key_view, b2->GetViewByIndex(i).value_view, no_wal_sequence);
       if (succ == false) {
@@ -530,39 +1713,39 @@ class BlockManager {
       }
     }
     if (sequence != no_wal_sequence) {
-      std::string block_redo = CreateBlockViewWalLog(new_block_index, new_block.Get().CreateDataView());
-      auto log_num = wal_.WriteLog(sequence, block_redo, block_undo);
+      std::string redo_view = new_block.Get().CreateDataView();
+      LogHead head = CreateBlockViewWalLog(new_block_index);
+      auto log_num = wal_.WriteLog(sequence, LogPayload(head.View(), redo_view), LogPayload(head.View(), undo_view));
       new_block.Get().UpdateLogNumber(log_num);
     }
     BPTREE_LOG_DEBUG("block merge, from {} and {} to {}", b1->GetIndex(), b2->GetIndex(), new_block_index);
     return new_block_index;
   }
 
-  std::string CreateAllocBlockWalLog(uint32_t index, uint32_t height, uint32_t key_size, uint32_t value_size) {
-    std::string result;
-    util::StringAppender(result, detail::LogTypeToUint8T(detail::LogType::BLOCK_ALLO));
-    util::StringAppender(result, index);
-    util::StringAppender(result, height);
-    util::StringAppender(result, key_size);
-    util::StringAppender(result, value_size);
+  LogHead CreateAllocBlockWalLog(uint32_t index, uint32_t height, uint32_t key_size, uint32_t value_size) {
+    LogHead result;
+    result.AppendByte(detail::LogTypeToUint8T(detail::LogType::COMPACT_BLOCK_ALLO))
+        .AppendVarint(index)
+        .AppendVarint(height)
+        .AppendVarint(key_size)
+        .AppendVarint(value_size);
     return result;
   }
 
-  std::string CreateResetBlockWalLog(uint32_t index, uint32_t height, uint32_t key_size, uint32_t value_size) {
-    std::string result;
-    util::StringAppender(result, detail::LogTypeToUint8T(detail::LogType::BLOCK_RESET));
-    util::StringAppender(result, index);
-    util::StringAppender(result, height);
-    util::StringAppender(result, key_size);
-    util::StringAppender(result, value_size);
+  LogHead CreateResetBlockWalLog(uint32_t index, uint32_t height, uint32_t key_size, uint32_t value_size) {
+    LogHead result;
+    result.AppendByte(detail::LogTypeToUint8T(detail::LogType::COMPACT_BLOCK_RESET))
+        .AppendVarint(index)
+        .AppendVarint(height)
+        .AppendVarint(key_size)
+        .AppendVarint(value_size);
     return result;
   }
 
-  std::string CreateBlockViewWalLog(uint32_t index, const std::string& view) {
-    std::string result;
-    util::StringAppender(result, detail::LogTypeToUint8T(detail::LogType::BLOCK_VIEW));
-    util::StringAppender(result, index);
-    util::StringAppender(result, view);
+  // block的数据快照作为LogPayload的数据部分
+  LogHead CreateBlockViewWalLog(uint32_t index) {
+    LogHead result;
+    result.AppendByte(detail::LogTypeToUint8T(detail::LogType::COMPACT_BLOCK_VIEW)).AppendVarint(index);
     return result;
   }
 
@@ -577,14 +1760,13 @@ class BlockManager {
       auto new_block =
           std::unique_ptr<Block>(new Block(*this, result, height, super_block_.key_size_, super_block_.value_size_));
       if (sequence != no_wal_sequence) {
-        std::string redo_log = CreateAllocBlockWalLog(result, height, super_block_.key_size_, super_block_.value_size_);
-        std::string undo_log = "";
-        auto log_number = wal_.WriteLog(sequence, redo_log, undo_log);
+        LogHead redo_log = CreateAllocBlockWalLog(result, height, super_block_.key_size_, super_block_.value_size_);
+        auto log_number = wal_.WriteLog(sequence, redo_log.View(), "");
         new_block->UpdateLogNumber(log_number);
       }
       BPTREE_LOG_DEBUG("alloc new block {}", result);
       GetMetricSet().GetAs<Gauge>("dirty_block_count")->Add();
-      block_cache_.Insert(result, std::move(new_block));
+      block_cache_.Insert(result, std::move(new_block), height > 0);
       return result;
     } else {
       return ReuseFreeBlock(height, sequence);
@@ -604,21 +1786,23 @@ class BlockManager {
     assert(super_block_.free_block_size_ > 0);
     super_block_.SetFreeBlockSize(super_block_.free_block_size_ - 1, sequence);
 
-    std::string redo_log, undo_log;
+    LogHead redo_log;
+    std::string undo_view;
     if (sequence != no_wal_sequence) {
       redo_log = CreateResetBlockWalLog(result, height, super_block_.key_size_, super_block_.value_size_);
-      undo_log = CreateBlockViewWalLog(result, block->CreateDataView());
+      undo_view = block->CreateDataView();
     }
 
     block->SetClean();
     block.reset(new Block(*this, result, height, super_block_.key_size_, super_block_.value_size_));
 
     if (sequence != no_wal_sequence) {
-      auto log_number = wal_.WriteLog(sequence, redo_log, undo_log);
+      LogHead undo_head = CreateBlockViewWalLog(result);
+      auto log_number = wal_.WriteLog(sequence, redo_log.View(), LogPayload(undo_head.View(), undo_view));
       block->UpdateLogNumber(log_number);
     }
     GetMetricSet().GetAs<Gauge>("dirty_block_count")->Add();
-    block_cache_.Insert(result, std::move(block));
+    block_cache_.Insert(result, std::move(block), height > 0);
     return result;
   }
 
@@ -640,6 +1824,10 @@ class BlockManager {
     // 在wal层面，不需要有block删除的概念，因为block的删除只是把元数据字段中的next free index设置为新值而已
     block.Get().SetNextFreeIndex(super_block_.free_block_head_, sequence);
     block.UnBind();
+    // 释放之后的block不会再被PinnableValue持有，释放写latch以便移出cache
+    if (CurrentExclusiveLatches() != nullptr) {
+      CurrentExclusiveLatches()->erase(index);
+    }
     super_block_.SetFreeBlockHead(index, sequence);
     super_block_.SetFreeBlockSize(super_block_.free_block_size_ + 1, sequence);
     auto unused_block = block_cache_.Move(index);
@@ -648,9 +1836,34 @@ class BlockManager {
     BPTREE_LOG_DEBUG("dealloc block {}", index);
   }
 
+  // 文件系统不支持O_DIRECT时打开失败，此时退化为普通读写
+  FileHandler OpenDbFile(bool create) {
+    std::string file_name = CreateDbFileNameByDB(db_name_);
+    if (direct_io_ == true) {
+      try {
+        return create == true ? FileHandler::CreateFile(file_name, FileType::DIRECT)
+                              : FileHandler::OpenFile(file_name, FileType::DIRECT);
+      } catch (const BptreeExecption& e) {
+        BPTREE_LOG_WARN("{}, fall back to buffered io", e.what());
+        direct_io_ = false;
+      }
+      // 内核在创建文件之后才检查是否支持O_DIRECT，失败时文件可能已经被创建
+      if (create == true) {
+        util::DeleteFile(file_name);
+      }
+    }
+    return create == true ? FileHandler::CreateFile(file_name, FileType::NORMAL)
+                          : FileHandler::OpenFile(file_name, FileType::NORMAL);
+  }
+
   char* ReadBlockFromFile(uint32_t index) {
-    char* buf = new ((std::align_val_t)linux_alignment) char[block_size];
-    f_.Read(buf, block_size, index * block_size);
+    char* buf = buffer_pool_.Allocate();
+    try {
+      f_.Read(buf, block_size, index * block_size);
+    } catch (...) {
+      buffer_pool_.Release(buf);
+      throw;
+    }
     return buf;
   }
 
@@ -665,6 +1878,8 @@ class BlockManager {
     bool succ = block_cache_.Clear();
     assert(succ == true);
     FlushUnusedBlockToFile();
+    // cache中引用映射的block已经全部析构
+    mapped_db_.Unmap();
     f_.Close();
     dw_.Close();
     auto& cond = GetFaultInjection().GetTheLastCheckPointFailCondition();
@@ -672,6 +1887,9 @@ class BlockManager {
       BPTREE_LOG_WARN("fault injection : the last check point fail");
       std::exit(-1);
     }
+    if (key_filter_ != nullptr) {
+      SaveKeyFilter();
+    }
     // 正常关闭的情况下执行到这里，所有block都刷到了磁盘，所以可以安全的删除wal日志
     wal_.ResetLogFile();
   }
@@ -683,6 +1901,8 @@ class BlockManager {
       BPTREE_LOG_DEBUG("block {} flush to disk, dirty", index);
       // 确保block上所有修改操作对应的日志已经持久化到磁盘
       this->wal_.EnsureLogFlush(block.GetLogNumber());
+      // 不同cache分片的淘汰可能并发执行，double write文件只有一个写入位置，因此需要串行化
+      std::lock_guard<std::mutex> guard(flush_latch_);
       this->dw_.WriteBlock(block);
       this->FlushBlockToFile(block);
     } else {
@@ -756,7 +1976,43 @@ class BlockManager {
 
   // 读到后进行crc校验，如果失败则从dw文件中恢复
   std::unique_ptr<Block> LoadBlock(uint32_t index) {
-    char* buf = ReadBlockFromFile(index);
+    if (index < mapped_block_count_) {
+      return LoadMappedBlock(index);
+    }
+    return ParseLoadedBlock(index, ReadBlockFromFile(index));
+  }
+
+  void MapDbFile() {
+    mapped_db_.Map(CreateDbFileNameByDB(db_name_));
+    mapped_block_count_ = mapped_db_.Size() / block_size;
+    mapped_verified_ = std::make_unique<std::atomic<bool>[]>(mapped_block_count_);
+    BPTREE_LOG_INFO("mmap db file succ, {} blocks", mapped_block_count_);
+  }
+
+  // 只读模式下block直接引用映射的页，不分配buf也不拷贝数据，每个block只在第一次加载时校验crc
+  std::unique_ptr<Block> LoadMappedBlock(uint32_t index) {
+    GetMetricSet().GetAs<Counter>("mmap_load_block_count")->Add();
+    char* buf = const_cast<char*>(mapped_db_.Data()) + static_cast<size_t>(index) * block_size;
+    bool verified = mapped_verified_[index].load(std::memory_order_acquire);
+    auto block = std::unique_ptr<Block>(new Block(*this, buf, false));
+    // 旧版本链表格式的block需要原地转换格式，映射的页不能修改，读取到单独分配的buf中解析
+    block->UpdateMeta();
+    if (block->IsLinkedEntryFormat() == true) {
+      GetMetricSet().GetAs<Counter>("mmap_legacy_block_count")->Add();
+      block->SetClean();
+      return ParseLoadedBlock(index, ReadBlockFromFile(index));
+    }
+    if (block->Parse(verified == false) == true) {
+      mapped_verified_[index].store(true, std::memory_order_release);
+      return block;
+    }
+    // 映射的页不能修改，校验失败时读取到单独分配的buf中，由ParseLoadedBlock从double write文件中恢复
+    block->SetClean();
+    return ParseLoadedBlock(index, ReadBlockFromFile(index));
+  }
+
+  // buf为从文件中读取的index对应的block数据，所有权转移给返回的block
+  std::unique_ptr<Block> ParseLoadedBlock(uint32_t index, char* buf) {
     std::unique_ptr<Block> new_block = std::unique_ptr<Block>(new Block(*this, buf));
     bool succ = new_block->Parse();
     if (succ == false) {
@@ -779,60 +2035,64 @@ class BlockManager {
     size_t offset = 0;
     uint8_t wal_type = util::StringParser<uint8_t>(log, offset);
     switch (wal_type) {
-      case detail::LogTypeToUint8T(detail::LogType::SUPER_META): {
+      case detail::LogTypeToUint8T(detail::LogType::COMPACT_SUPER_META): {
         BPTREE_LOG_DEBUG("handle super meta log");
-        uint32_t index = util::StringParser<uint32_t>(log, offset);
-        std::string meta_name = util::StringParser(log, offset);
-        uint32_t value = util::StringParser<uint32_t>(log, offset);
+        auto field = static_cast<detail::MetaField>(util::StringParser<uint8_t>(log, offset));
+        uint32_t value = static_cast<uint32_t>(util::VarintParser(log, offset));
         assert(offset == log.size());
-        super_block_.HandleWAL(meta_name, value);
+        super_block_.HandleWAL(field, value);
         break;
       }
-      case detail::LogTypeToUint8T(detail::LogType::BLOCK_META): {
+      case detail::LogTypeToUint8T(detail::LogType::COMPACT_BLOCK_META): {
         BPTREE_LOG_DEBUG("handle block meta log");
-        uint32_t index = util::StringParser<uint32_t>(log, offset);
-        std::string meta_name = util::StringParser(log, offset);
-        uint32_t value = util::StringParser<uint32_t>(log, offset);
+        uint32_t index = static_cast<uint32_t>(util::VarintParser(log, offset));
+        auto field = static_cast<detail::MetaField>(util::StringParser<uint8_t>(log, offset));
+        uint32_t value = static_cast<uint32_t>(util::VarintParser(log, offset));
         assert(offset == log.size());
-        HandleBlockMetaUpdateWal(sequence, index, meta_name, value);
+        HandleBlockMetaUpdateWal(sequence, index, field, value);
         break;
       }
-      case detail::LogTypeToUint8T(detail::LogType::BLOCK_DATA): {
+      case detail::LogTypeToUint8T(detail::LogType::COMPACT_BLOCK_DATA): {
         BPTREE_LOG_DEBUG("handle block data log");
-        uint32_t index = util::StringParser<uint32_t>(log, offset);
-        uint32_t region_offset = util::StringParser<uint32_t>(log, offset);
-        std::string region = util::StringParser(log, offset);
-        assert(offset == log.size());
-        HandleBlockDataUpdateWal(sequence, index, region_offset, region);
+        uint32_t index = static_cast<uint32_t>(util::VarintParser(log, offset));
+        uint32_t region_offset = static_cast<uint32_t>(util::VarintParser(log, offset));
+        HandleBlockDataUpdateWal(sequence, index, region_offset, std::string_view(log).substr(offset));
         break;
       }
-      case detail::LogTypeToUint8T(detail::LogType::BLOCK_ALLO): {
-        BPTREE_LOG_DEBUG("handle block_alloc log");
-        uint32_t index = util::StringParser<uint32_t>(log, offset);
-        uint32_t height = util::StringParser<uint32_t>(log, offset);
-        uint32_t key_size = util::StringParser<uint32_t>(log, offset);
-        uint32_t value_size = util::StringParser<uint32_t>(log, offset);
+      case detail::LogTypeToUint8T(detail::LogType::COMPACT_BLOCK_ALLO):
+      case detail::LogTypeToUint8T(detail::LogType::COMPACT_BLOCK_RESET): {
+        BPTREE_LOG_DEBUG("handle block_alloc/block_reset log");
+        uint32_t index = static_cast<uint32_t>(util::VarintParser(log, offset));
+        uint32_t height = static_cast<uint32_t>(util::VarintParser(log, offset));
+        uint32_t key_size = static_cast<uint32_t>(util::VarintParser(log, offset));
+        uint32_t value_size = static_cast<uint32_t>(util::VarintParser(log, offset));
         assert(offset == log.size());
-        HandleBlockAllocWal(sequence, index, height, key_size, value_size);
+        if (wal_type == detail::LogTypeToUint8T(detail::LogType::COMPACT_BLOCK_ALLO)) {
+          HandleBlockAllocWal(sequence, index, height, key_size, value_size);
+        } else {
+          HandleBlockResetWal(sequence, index, height, key_size, value_size);
+        }
         break;
       }
-      case detail::LogTypeToUint8T(detail::LogType::BLOCK_RESET): {
-        BPTREE_LOG_DEBUG("handle block_reset log");
-        uint32_t index = util::StringParser<uint32_t>(log, offset);
-        uint32_t height = util::StringParser<uint32_t>(log, offset);
-        uint32_t key_size = util::StringParser<uint32_t>(log, offset);
-        uint32_t value_size = util::StringParser<uint32_t>(log, offset);
-        assert(offset == log.size());
-        HandleBlockResetWal(sequence, index, height, key_size, value_size);
+      case detail::LogTypeToUint8T(detail::LogType::COMPACT_BLOCK_VIEW): {
+        BPTREE_LOG_DEBUG("handle block view log");
+        uint32_t index = static_cast<uint32_t>(util::VarintParser(log, offset));
+        HandleBlockViewWal(sequence, index, std::string_view(log).substr(offset));
         break;
       }
+      // 以下为旧版本的日志格式，只由链表格式的block产生，其中的偏移量和元数据字段针对的是旧的block布局，
+      // 而block加载时会被转换为slotted page格式，回放会破坏block的内容。这是wal中第一条被回放的数据日志，
+      // 此时还没有加载和转换任何block，直接拒绝打开，db文件和wal文件保持不变
+      case detail::LogTypeToUint8T(detail::LogType::SUPER_META):
+      case detail::LogTypeToUint8T(detail::LogType::BLOCK_META):
+      case detail::LogTypeToUint8T(detail::LogType::BLOCK_DATA):
+      case detail::LogTypeToUint8T(detail::LogType::BLOCK_ALLO):
+      case detail::LogTypeToUint8T(detail::LogType::BLOCK_RESET):
       case detail::LogTypeToUint8T(detail::LogType::BLOCK_VIEW): {
-        BPTREE_LOG_DEBUG("handle block view log");
-        uint32_t index = util::StringParser<uint32_t>(log, offset);
-        std::string view = util::StringParser(log, offset);
-        assert(offset == log.size());
-        HandleBlockViewWal(sequence, index, view);
-        break;
+        throw BptreeExecption(
+            "wal {} contains logs of the legacy block format that can't be replayed, please close the db with the "
+            "previous version cleanly before opening it with this version",
+            CreateWalNameByDB(db_name_));
       }
       default: {
         throw BptreeExecption("invalid wal type : {}", wal_type);
@@ -840,15 +2100,24 @@ class BlockManager {
     }
   }
 
+  // 记录恢复过程中修改过的block，见InitKeyFilter
+  void RecordRecoveredBlock(uint32_t index) {
+    if (enable_key_filter_ == true) {
+      recovered_blocks_.push_back(index);
+    }
+  }
+
   void HandleBlockAllocWal(uint64_t sequence, uint32_t index, uint32_t height, uint32_t key_size, uint32_t value_size) {
+    RecordRecoveredBlock(index);
     assert(key_size == super_block_.key_size_ && value_size == super_block_.value_size_);
     auto block = std::unique_ptr<Block>(new Block(*this, index, height, key_size, value_size));
     // index block之前就不存在，因此不可能在cache中，直接插入
     assert(block_cache_.Get(index).Exist() == false);
-    block_cache_.Insert(index, std::move(block));
+    block_cache_.Insert(index, std::move(block), height > 0);
   }
 
   void HandleBlockResetWal(uint64_t sequence, uint32_t index, uint32_t height, uint32_t key_size, uint32_t value_size) {
+    RecordRecoveredBlock(index);
     assert(key_size == super_block_.key_size_ && value_size == super_block_.value_size_);
     auto block = std::unique_ptr<Block>(new Block(*this, index, height, key_size, value_size));
     // 直接将之前的版本删除，新建一个新的block代替即可。
@@ -858,31 +2127,39 @@ class BlockManager {
     }
     tmp.UnBind();
     block_cache_.Delete(index, false);
-    block_cache_.Insert(index, std::move(block));
+    block_cache_.Insert(index, std::move(block), height > 0);
   }
 
-  void HandleBlockMetaUpdateWal(uint64_t sequence, uint32_t index, const std::string& name, uint32_t value) {
+  void HandleBlockMetaUpdateWal(uint64_t sequence, uint32_t index, detail::MetaField field, uint32_t value) {
+    RecordRecoveredBlock(index);
     auto wrapper = GetBlock(index);
-    wrapper.Get().HandleMetaUpdateWal(name, value);
+    wrapper.Get().HandleMetaUpdateWal(field, value);
   }
 
-  void HandleBlockDataUpdateWal(uint64_t sequence, uint32_t index, uint32_t offset, const std::string& region) {
+  void HandleBlockDataUpdateWal(uint64_t sequence, uint32_t index, uint32_t offset, std::string_view region) {
+    RecordRecoveredBlock(index);
     auto wrapper = GetBlock(index);
     wrapper.Get().HandleDataUpdateWal(offset, region);
   }
 
-  void HandleBlockViewWal(uint64_t sequence, uint32_t index, const std::string& view) {
+  void HandleBlockViewWal(uint64_t sequence, uint32_t index, std::string_view view) {
+    RecordRecoveredBlock(index);
     auto wrapper = GetBlock(index);
     wrapper.Get().HandleViewWal(view);
   }
 
   void AfterCommitTx() {
     if (sync_per_write_ == true) {
-      wal_.Flush();
+      size_t batch = wal_.GroupSync(group_commit_batch_size_, group_commit_max_wait_);
+      if (batch > 0) {
+        GetMetricSet().GetAs<Counter>("group_commit_sync_count")->Add();
+        GetMetricSet().GetAs<Counter>("group_commit_tx_count")->Add(batch);
+      }
     }
-    static uint64_t tx_count = 0;
-    tx_count += 1;
+    uint64_t tx_count = tx_count_.fetch_add(1) + 1;
     if (tx_count % create_checkpoint_per_op_ == 0) {
+      // 生成check point期间不能有其他线程访问树
+      std::unique_lock<std::shared_mutex> tree_guard(tree_latch_);
       CreateCheckPoint();
     }
   }
@@ -891,43 +2168,102 @@ class BlockManager {
   void CreateCheckPoint() {
     BPTREE_LOG_INFO("begin to create chcek point");
     GetMetricSet().GetAs<Counter>("create_checkpoint_count")->Add();
+    if (key_filter_ != nullptr && key_filter_->Overflowed() == true) {
+      RebuildKeyFilter();
+    }
     // 所有wal日志刷盘
     wal_.Flush();
     FlushSuperBlockToFile();
-    block_cache_.ForeachValueInCache([this](const uint32_t& key, Block& block) {
-      bool dirty = block.Flush();
-      if (dirty == true) {
-        this->dw_.WriteBlock(block);
-        this->FlushBlockToFile(block);
+    // double write文件只有一个写入位置，每个block需要依次写入；关闭double write时所有脏block可以批量写回
+    bool batch = dw_.TurnedOff() == true && !GetFaultInjection().GetPartialWriteCondition();
+    std::vector<IoRequest> requests;
+    auto flush = [this, batch, &requests](Block& block) {
+      if (batch == true) {
+        requests.push_back(IoRequest{block.GetBuf(), block_size, static_cast<size_t>(block.GetIndex()) * block_size});
+        return;
       }
-    });
-    unused_blocks_.ForeachUnusedBlocks([this](uint32_t key, Block& block) {
+      this->dw_.WriteBlock(block);
+      this->FlushBlockToFile(block);
+    };
+    // 持有tree_latch_的独占锁时只有PinnableValue可能持有block，Flush只修改buf中的元数据和crc，不影响其读取的value
+    block_cache_.ForeachValueInCache(
+        [&flush](const uint32_t& key, Block& block) {
+          bool dirty = block.Flush();
+          if (dirty == true) {
+            flush(block);
+          }
+        },
+        true);
+    unused_blocks_.ForeachUnusedBlocks([&flush](uint32_t key, Block& block) {
       bool dirty = block.Flush(false);
       if (dirty == true) {
-        this->dw_.WriteBlock(block);
-        this->FlushBlockToFile(block);
+        flush(block);
       }
     });
+    // 生成check point期间没有其他线程访问树，block不会被修改或者淘汰
+    f_.WriteBatch(requests);
     // 所有block刷盘
     f_.Flush();
+    // 在重置wal文件之前持久化filter，崩溃恢复时旧的filter加上wal中修改过的block同样是完整的
+    if (key_filter_ != nullptr) {
+      SaveKeyFilter();
+    }
     // 重置wal文件
     wal_.ResetLogFile();
     BPTREE_LOG_DEBUG("create check point succ");
   }
 
+  // 内置的整数key要求key_size与整数的长度一致
+  void CheckKeyKind() const {
+    size_t key_size = 0;
+    if (key_kind_ == KeyKind::BIG_ENDIAN_UINT32) {
+      key_size = sizeof(uint32_t);
+    } else if (key_kind_ == KeyKind::BIG_ENDIAN_UINT64) {
+      key_size = sizeof(uint64_t);
+    }
+    if (key_size != 0 && super_block_.key_size_ != key_size) {
+      throw BptreeExecption("comparator {} requires key size {}, but the key size is {}",
+                            comparator_->ComparatorName(), key_size, super_block_.key_size_);
+    }
+  }
+
   void RegisterMetrics() {
     // 接口计数
     metric_set_.CreateMetric<Counter>("get_count");
     metric_set_.CreateMetric<Counter>("get_range_count");
+    metric_set_.CreateMetric<Counter>("multi_get_count");
+    metric_set_.CreateMetric<Counter>("new_iterator_count");
     metric_set_.CreateMetric<Counter>("insert_count");
     metric_set_.CreateMetric<Counter>("update_count");
     metric_set_.CreateMetric<Counter>("delete_count");
     // 从文件中读取block的数量
     metric_set_.CreateMetric<Counter>("load_block_count");
+    // 从文件中读取内部节点的数量，即内部节点的cache miss次数
+    metric_set_.CreateMetric<Counter>("load_inner_block_count");
+    // MultiGet和范围查找中发起预读的block数量
+    metric_set_.CreateMetric<Counter>("prefetch_block_count");
+    // 范围查找访问到的已预读叶子节点数量
+    metric_set_.CreateMetric<Counter>("readahead_hit_count");
+    // 范围查找结束时仍未访问到的已预读叶子节点数量
+    metric_set_.CreateMetric<Counter>("readahead_wasted_count");
+    // Get和MultiGet中被key filter过滤掉的key数量
+    metric_set_.CreateMetric<Counter>("key_filter_skip_count");
+    metric_set_.CreateMetric<Counter>("key_filter_rebuild_count");
+    // 只读模式下直接引用映射页的block加载次数，包含在load_block_count中
+    metric_set_.CreateMetric<Counter>("mmap_load_block_count");
+    // 只读模式下因旧版本链表格式而读取到单独分配的buf中的block加载次数，包含在mmap_load_block_count中
+    metric_set_.CreateMetric<Counter>("mmap_legacy_block_count");
+    metric_set_.CreateMetric<Counter>("row_cache_hit_count");
+    metric_set_.CreateMetric<Counter>("row_cache_miss_count");
+    // 组提交执行fdatasync的次数，以及这些同步覆盖的写操作数量，两者的比值为平均每组的大小
+    metric_set_.CreateMetric<Counter>("group_commit_sync_count");
+    metric_set_.CreateMetric<Counter>("group_commit_tx_count");
     //
     metric_set_.CreateMetric<Counter>("flush_block_count");
     // 生成check_point的数量
     metric_set_.CreateMetric<Counter>("create_checkpoint_count");
+    // 为快照保存的block旧版本的数量
+    metric_set_.CreateMetric<Counter>("save_block_version_count");
     metric_set_.CreateMetric<Counter>("block_split_count");
     metric_set_.CreateMetric<Counter>("root_block_split_count");
     metric_set_.CreateMetric<Counter>("block_merge_count");
@@ -939,7 +2275,16 @@ class BlockManager {
  private:
   Mode mode_;
   std::shared_ptr<Comparator> comparator_;
-  LRUCache<uint32_t, Block> block_cache_;
+  // 构造时从comparator_获取，block内的查找根据该值选择内联的比较实现
+  KeyKind key_kind_;
+  // 所有block的buf都从这里分配，需要在所有block之后析构
+  BlockBufferPool buffer_pool_;
+  // 只读模式下映射的db文件，cache中的block可能引用其中的页，因此需要在block_cache_之后析构
+  MappedFile mapped_db_;
+  size_t mapped_block_count_ = 0;
+  // 映射中每个block是否已经通过crc校验
+  std::unique_ptr<std::atomic<bool>[]> mapped_verified_;
+  ShardedCache<uint32_t, Block> block_cache_;
   std::string db_name_;
   SuperBlock super_block_;
   FileHandler f_;
@@ -949,7 +2294,231 @@ class BlockManager {
   // 记录运行过程中各项指标信息
   MetricSet metric_set_;
   size_t create_checkpoint_per_op_;
+  size_t readahead_blocks_;
+  bool enable_key_filter_;
+  // 没有开启key filter时为nullptr，只在没有其他线程访问树时被替换（构造或者生成check point期间）
+  std::unique_ptr<CuckooFilter> key_filter_;
+  // wal恢复过程中修改过的block，见InitKeyFilter
+  std::vector<uint32_t> recovered_blocks_;
+  // 没有开启row cache时为nullptr
+  std::unique_ptr<RowCache> row_cache_;
+  // 打开文件失败时被修改为false，见OpenDbFile
+  bool direct_io_;
   bool sync_per_write_;
+  size_t group_commit_batch_size_;
+  std::chrono::microseconds group_commit_max_wait_;
   UnusedBlocks unused_blocks_;
+  std::atomic<uint64_t> tx_count_;
+  // 见上方关于并发控制的注释
+  std::shared_mutex tree_latch_;
+  // 树结构的版本号，持有tree_latch_的独占锁的写操作（可能分裂或者合并）将其加1，由tree_latch_保护，见Iterator
+  uint64_t structure_version_ = 0;
+  // 按照block index分片的加载锁，见GetBlock
+  std::array<std::mutex, 64> load_latches_;
+  // 串行化淘汰block时的刷盘操作，见OnCacheDelete
+  std::mutex flush_latch_;
+  // 最后一个被分配的写操作版本号，见BlockVersionStore
+  std::atomic<uint64_t> write_version_;
+  BlockVersionStore version_store_;
 };
+
+inline Iterator::Iterator(BlockManager& manager, IteratorOption option)
+    : manager_(manager), option_(std::move(option)), valid_(false), leaf_(0), slot_(0), structure_version_(0) {}
+
+inline void Iterator::SeekToFirst() {
+  if (option_.lower_bound.has_value()) {
+    Seek(*option_.lower_bound);
+    return;
+  }
+  std::shared_lock<std::shared_mutex> tree_guard(manager_.tree_latch_);
+  valid_ = false;
+  uint32_t leaf = FindEdgeLeaf(true);
+  if (leaf != 0) {
+    SeekInLeaf(leaf, 0, true);
+  }
+  CheckBound();
+}
+
+inline void Iterator::SeekToLast() {
+  std::shared_lock<std::shared_mutex> tree_guard(manager_.tree_latch_);
+  valid_ = false;
+  if (option_.upper_bound.has_value()) {
+    SeekBefore(*option_.upper_bound);
+  } else {
+    uint32_t leaf = FindEdgeLeaf(false);
+    if (leaf != 0) {
+      SeekInLeaf(leaf, std::numeric_limits<size_t>::max(), false);
+    }
+  }
+  CheckBound();
+}
+
+inline void Iterator::Seek(const std::string& key) {
+  if (key.size() != manager_.super_block_.key_size_) {
+    throw BptreeExecption("wrong key length");
+  }
+  std::shared_lock<std::shared_mutex> tree_guard(manager_.tree_latch_);
+  valid_ = false;
+  const std::string* target = &key;
+  if (option_.lower_bound.has_value() && manager_.GetComparator().Compare(key, *option_.lower_bound) < 0) {
+    target = &*option_.lower_bound;
+  }
+  SeekAfter(*target, RangeStart::GE);
+  CheckBound();
+}
+
+inline void Iterator::Next() {
+  assert(Valid());
+  std::shared_lock<std::shared_mutex> tree_guard(manager_.tree_latch_);
+  Step(true);
+  CheckBound();
+}
+
+inline void Iterator::Prev() {
+  assert(Valid());
+  std::shared_lock<std::shared_mutex> tree_guard(manager_.tree_latch_);
+  Step(false);
+  CheckBound();
+}
+
+inline void Iterator::Step(bool forward) {
+  valid_ = false;
+  if (manager_.structure_version_ != structure_version_) {
+    // 上一次定位之后发生了分裂或者合并，leaf_可能已经被释放，从上一次返回的key重新查找
+    if (forward == true) {
+      SeekAfter(key_, RangeStart::GT);
+    } else {
+      SeekBefore(key_);
+    }
+    return;
+  }
+  std::optional<ReadLatchedBlock> leaf(std::in_place, manager_.GetBlock(leaf_));
+  const Block& block = leaf->Get();
+  const Comparator& cmp = manager_.GetComparator();
+  size_t count = block.GetKVCount();
+  // 叶子节点没有插入或者删除时上一次返回的key仍然位于slot_，否则重新查找第一个大于等于它的位置
+  size_t pos = slot_;
+  bool equal = pos < count && block.GetViewByIndex(pos).key_view == key_;
+  if (equal == false) {
+    pos = block.SearchTheFirstGEKey(key_);
+    equal = pos < count && cmp.Compare(block.GetViewByIndex(pos).key_view, key_) == 0;
+  }
+  if (forward == true) {
+    size_t slot = equal == true ? pos + 1 : pos;
+    if (slot < count) {
+      SetPosition(*leaf, slot);
+      return;
+    }
+    uint32_t next = block.GetNext();
+    leaf.reset();
+    SeekInLeaf(next, 0, true);
+  } else {
+    if (pos > 0) {
+      SetPosition(*leaf, pos - 1);
+      return;
+    }
+    uint32_t prev = block.GetPrev();
+    leaf.reset();
+    SeekInLeaf(prev, std::numeric_limits<size_t>::max(), false);
+  }
+}
+
+inline void Iterator::SeekAfter(const std::string& key, RangeStart start) {
+  std::optional<ReadLatchedBlock> leaf = manager_.FindLeafBlock<ReadLatchedBlock>(key);
+  if (leaf.has_value() == false) {
+    return;
+  }
+  size_t slot = manager_.SearchRangeStart(leaf->Get(), key, start);
+  if (slot < leaf->Get().GetKVCount()) {
+    SetPosition(*leaf, slot);
+    return;
+  }
+  // 当前叶子节点中没有满足条件的元素，移动到下一个叶子节点
+  uint32_t next = leaf->Get().GetNext();
+  leaf.reset();
+  SeekInLeaf(next, 0, true);
+}
+
+inline void Iterator::SeekBefore(const std::string& key) {
+  std::optional<ReadLatchedBlock> leaf = manager_.FindLeafBlock<ReadLatchedBlock>(key);
+  if (leaf.has_value() == false) {
+    // key大于树中所有的key，定位到最后一个元素
+    uint32_t last = FindEdgeLeaf(false);
+    if (last != 0) {
+      SeekInLeaf(last, std::numeric_limits<size_t>::max(), false);
+    }
+    return;
+  }
+  size_t slot = leaf->Get().SearchTheFirstGEKey(key);
+  if (slot > 0) {
+    SetPosition(*leaf, slot - 1);
+    return;
+  }
+  uint32_t prev = leaf->Get().GetPrev();
+  leaf.reset();
+  SeekInLeaf(prev, std::numeric_limits<size_t>::max(), false);
+}
+
+inline void Iterator::SeekInLeaf(uint32_t index, size_t slot, bool forward) {
+  // 持有tree_latch_的共享锁时叶子节点之间的链接不会改变，每次只需要持有一个叶子节点
+  while (index != 0) {
+    ReadLatchedBlock block(manager_.GetBlock(index));
+    size_t count = block.Get().GetKVCount();
+    if (count > 0) {
+      if (forward == true && slot < count) {
+        SetPosition(block, slot);
+        return;
+      }
+      if (forward == false) {
+        SetPosition(block, slot < count ? slot : count - 1);
+        return;
+      }
+    }
+    index = forward == true ? block.Get().GetNext() : block.Get().GetPrev();
+    slot = forward == true ? 0 : std::numeric_limits<size_t>::max();
+  }
+}
+
+inline void Iterator::SetPosition(const ReadLatchedBlock& leaf, size_t slot) {
+  Entry entry = leaf.Get().GetViewByIndex(slot);
+  // key和value的长度固定，第一次拷贝之后不再分配内存
+  key_.assign(entry.key_view);
+  value_.assign(entry.value_view);
+  leaf_ = leaf.Get().GetIndex();
+  slot_ = slot;
+  structure_version_ = manager_.structure_version_;
+  valid_ = true;
+}
+
+inline uint32_t Iterator::FindEdgeLeaf(bool first) {
+  std::optional<ReadLatchedBlock> block;
+  block.emplace(manager_.GetBlock(manager_.super_block_.root_index_));
+  while (block->Get().GetHeight() > 0) {
+    size_t count = block->Get().GetKVCount();
+    if (count == 0) {
+      return 0;
+    }
+    uint32_t child_index = block->Get().GetChildIndex(first == true ? 0 : count - 1);
+    if (block->Get().GetHeight() == 1) {
+      return child_index;
+    }
+    ReadLatchedBlock child(manager_.GetBlock(child_index));
+    block.reset();
+    block.emplace(std::move(child));
+  }
+  return 0;
+}
+
+inline void Iterator::CheckBound() {
+  if (Valid() == false) {
+    return;
+  }
+  const Comparator& cmp = manager_.GetComparator();
+  if (option_.upper_bound.has_value() && cmp.Compare(Key(), *option_.upper_bound) >= 0) {
+    valid_ = false;
+  } else if (option_.lower_bound.has_value() && cmp.Compare(Key(), *option_.lower_bound) < 0) {
+    valid_ = false;
+  }
+}
+
 }  // namespace bptree
\ No newline at end of file
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace bptree {
+
+/*
+ * 固定容量的block buf池，以slab为单位通过mmap申请内存，每个slab切分为多个frame_size大小的frame
+ * 被释放的frame直接用于下一次分配，slab只在池析构时归还给系统，因此cache置换过程中不再有malloc/free和缺页中断，内存占用是稳定的
+ * frame耗尽时从堆上分配，释放时根据地址区分
+ * 线程安全
+ */
+class BlockBufferPool {
+ public:
+  // 每个slab的大小，等于x86_64上大页的大小
+  static constexpr size_t slab_size = 2 * 1024 * 1024;
+
+  /**
+   * @brief 构造一个最多容纳capacity个frame的池，slab在需要时才申请
+   * @param frame_size 每个frame的大小，需要是alignment的整数倍
+   * @param alignment frame的对齐要求，不能超过页的大小
+   * @param huge_page 是否尝试使用大页（先尝试MAP_HUGETLB，失败时使用普通页并通过madvise建议内核使用透明大页）
+   */
+  BlockBufferPool(size_t frame_size, size_t alignment, size_t capacity, bool huge_page)
+      : frame_size_(frame_size),
+        alignment_(alignment),
+        frames_per_slab_(slab_size / frame_size),
+        huge_page_(huge_page),
+        heap_alloc_count_(0),
+        huge_page_slab_count_(0) {
+    assert(frame_size % alignment == 0 && slab_size % frame_size == 0);
+    max_slab_count_ = (capacity + frames_per_slab_ - 1) / frames_per_slab_;
+  }
+
+  BlockBufferPool(const BlockBufferPool&) = delete;
+  BlockBufferPool& operator=(const BlockBufferPool&) = delete;
+
+  char* Allocate() {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (free_frames_.empty() == true && slabs_.size() < max_slab_count_) {
+        AddSlab();
+      }
+      if (free_frames_.empty() == false) {
+        char* frame = free_frames_.back();
+        free_frames_.pop_back();
+        return frame;
+      }
+    }
+    heap_alloc_count_.fetch_add(1, std::memory_order_relaxed);
+    return new ((std::align_val_t)alignment_) char[frame_size_];
+  }
+
+  void Release(char* frame) noexcept {
+    if (frame == nullptr) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (InSlab(frame) == true) {
+        free_frames_.push_back(frame);
+        return;
+      }
+    }
+    operator delete[](frame, (std::align_val_t)alignment_);
+  }
+
+  // 池中最多容纳的frame数量
+  size_t Capacity() const noexcept { return max_slab_count_ * frames_per_slab_; }
+
+  // 已经从系统申请的frame数量
+  size_t SlabFrameCount() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return slabs_.size() * frames_per_slab_;
+  }
+
+  size_t FreeFrameCount() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return free_frames_.size();
+  }
+
+  // 池中的frame耗尽时从堆上分配的次数
+  size_t HeapAllocCount() const noexcept { return heap_alloc_count_.load(std::memory_order_relaxed); }
+
+  // 通过MAP_HUGETLB申请的slab数量
+  size_t HugePageSlabCount() const noexcept { return huge_page_slab_count_.load(std::memory_order_relaxed); }
+
+  ~BlockBufferPool() {
+    for (auto slab : slabs_) {
+      munmap(slab, slab_size);
+    }
+  }
+
+ private:
+  // 持有mutex_时调用，申请失败时不做任何修改，之后的分配从堆上进行
+  void AddSlab() {
+    void* slab = MAP_FAILED;
+    if (huge_page_ == true) {
+      slab = mmap(nullptr, slab_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (slab != MAP_FAILED) {
+        huge_page_slab_count_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    if (slab == MAP_FAILED) {
+      slab = mmap(nullptr, slab_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (slab == MAP_FAILED) {
+        max_slab_count_ = slabs_.size();
+        return;
+      }
+      if (huge_page_ == true) {
+        madvise(slab, slab_size, MADV_HUGEPAGE);
+      }
+    }
+    char* begin = static_cast<char*>(slab);
+    // 按照地址有序，释放时二分查找frame所属的slab
+    slabs_.insert(std::upper_bound(slabs_.begin(), slabs_.end(), begin), begin);
+    // 所有frame都被释放时free_frames_也不需要扩容，Release中不会重新分配内存
+    free_frames_.reserve(slabs_.size() * frames_per_slab_);
+    // 逆序放入，先分配地址较小的frame
+    for (size_t i = frames_per_slab_; i > 0; --i) {
+      free_frames_.push_back(begin + (i - 1) * frame_size_);
+    }
+  }
+
+  bool InSlab(const char* frame) const noexcept {
+    auto it = std::upper_bound(slabs_.begin(), slabs_.end(), frame);
+    if (it == slabs_.begin()) {
+      return false;
+    }
+    --it;
+    return frame < *it + slab_size;
+  }
+
+  const size_t frame_size_;
+  const size_t alignment_;
+  const size_t frames_per_slab_;
+  const bool huge_page_;
+  size_t max_slab_count_;
+  mutable std::mutex mutex_;
+  std::vector<char*> slabs_;
+  std::vector<char*> free_frames_;
+  std::atomic<size_t> heap_alloc_count_;
+  std::atomic<size_t> huge_page_slab_count_;
+};
+
+/*
+ * 回收固定大小的对象内存，用于频繁构造和析构的对象（例如cache中的Block），最多缓存max_free个空闲对象
+ * 线程安全
+ */
+class ObjectFreeList {
+ public:
+  ObjectFreeList(size_t object_size, size_t max_free) : object_size_(object_size), max_free_(max_free) {
+    // Release中不会重新分配内存
+    free_.reserve(max_free_);
+  }
+
+  ObjectFreeList(const ObjectFreeList&) = delete;
+  ObjectFreeList& operator=(const ObjectFreeList&) = delete;
+
+  void* Allocate(size_t size) {
+    assert(size == object_size_);
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (free_.empty() == false) {
+        void* ptr = free_.back();
+        free_.pop_back();
+        return ptr;
+      }
+    }
+    return ::operator new(size);
+  }
+
+  void Release(void* ptr) noexcept {
+    if (ptr == nullptr) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      if (free_.size() < max_free_) {
+        free_.push_back(ptr);
+        return;
+      }
+    }
+    ::operator delete(ptr);
+  }
+
+  size_t FreeCount() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return free_.size();
+  }
+
+  ~ObjectFreeList() {
+    for (auto each : free_) {
+      ::operator delete(each);
+    }
+  }
+
+ private:
+  const size_t object_size_;
+  const size_t max_free_;
+  mutable std::mutex mutex_;
+  std::vector<void*> free_;
+};
+
+}  // namespace bptree
@@ -1,11 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
 #include <functional>
 #include <iostream>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <source_location>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "bptree/exception.h"
 #include "bptree/log.h"
@@ -13,28 +20,68 @@
 
 namespace bptree {
 
-/* class LRUCache 注释
- * 该类采用基于LRU算法进行数据缓存
- * 数据成员为两个链表：(in_use_和lru_list_)和一个map(cache_)，两个链表中仅存储key信息；两个链表的长度之和应该等于map.size()
- * 采用引用计数的方法管理被用户持有的Value，当没有用户持有时首先将Value对应的Key插入lru_list_链表中，当lru_list_链表长度到达上限时从末尾开始执行clean操作
+enum class CachePolicy {
+  LRU,
+  CLOCK,
+  TWO_QUEUE,
+};
+
+inline const char* CachePolicyStr(CachePolicy policy) {
+  if (policy == CachePolicy::LRU) {
+    return "LRU";
+  } else if (policy == CachePolicy::CLOCK) {
+    return "CLOCK";
+  } else if (policy == CachePolicy::TWO_QUEUE) {
+    return "2Q";
+  }
+  return nullptr;
+}
+
+/* class CacheShard 注释
+ * cache的基类，负责管理map(cache_)、互斥锁、引用计数以及淘汰回调，淘汰策略由子类通过OnAdd/OnPin/OnUnpin/OnRemove/SelectVictim实现
+ * 采用引用计数的方法管理被用户持有的Value，没有被持有的元素可以被淘汰，当可以被淘汰的元素数量超过容量时执行淘汰
  * 可以通过SetFreeNotify接口注册清理前的回调函数，便于执行某些不适合放在析构函数中的操作
- * Get接口返回的是一个Wrapper类，该类基于RALL机制管理Value对象的引用计数，并且该类不支持copy和move
+ * Get接口返回的是一个Wrapper类，该类基于RALL机制管理Value对象的引用计数，并且该类不支持copy
+ * 所有接口都是线程安全的，内部使用一把互斥锁保护map和淘汰策略的数据结构，子类的接口在持有锁的情况下执行
+ * 被淘汰的元素在持有锁时从map中摘除，释放锁之后再调用free_notify_并析构，回调（例如刷盘）不会阻塞同一分片上的其他操作；
+ * 回调完成之前这些key记录在evicting_中，重新加载之前需要调用WaitForEviction等待回调完成
+ * 引用计数为原子变量，Wrapper释放引用时只有计数降为0才需要加锁
+ * 插入时可以将元素标记为高优先级，可淘汰的高优先级元素由基类的high_pri_list_按照LRU顺序管理，不经过淘汰策略；
+ * 只有当高优先级元素的数量超过high_pri_capacity_，或者没有其他可淘汰元素时才会淘汰高优先级元素
  */
 template <typename Key, typename Value>
-class LRUCache {
+class CacheShard {
  public:
-  using iter_type = typename std::list<Key>::iterator;
   struct Entry {
     std::unique_ptr<Value> value;
-    iter_type iter;
-    size_t use_ref_;
-
-    Entry() : value(nullptr), iter(), use_ref_(0) {}
+    std::atomic<size_t> use_ref_;
+    // 没有被持有，可以被淘汰。use_ref_降为0之后，在Release获得锁之前evictable仍然为false
+    bool evictable;
+    // 以下字段由淘汰策略使用
+    // LRU : 元素在lru_list_或者in_use_中的位置
+    typename std::list<Key>::iterator iter;
+    // CLOCK : 元素所在的frame以及访问标志
+    size_t frame;
+    bool referenced;
+    // 2Q : 元素是否在热数据队列中
+    bool hot;
+    // 高优先级元素不经过淘汰策略，iter为元素在high_pri_list_或者high_pri_in_use_中的位置
+    bool high_priority;
+
+    Entry()
+        : value(nullptr),
+          use_ref_(0),
+          evictable(false),
+          iter(),
+          frame(0),
+          referenced(false),
+          hot(false),
+          high_priority(false) {}
   };
 
   class Wrapper {
    public:
-    Wrapper(LRUCache<Key, Value>* cache, const Key& key, Entry* v)
+    Wrapper(CacheShard<Key, Value>* cache, const Key& key, Entry* v)
         : holder_(cache), key_(key), value_(v), unbinded_(false) {
       if (value_ != nullptr) {
         assert(value_->use_ref_ > 0);
@@ -71,17 +118,12 @@ class LRUCache {
       if (Exist() == false || unbinded_ == true) {
         return;
       }
-      assert(value_->use_ref_ > 0);
-      value_->use_ref_ -= 1;
-      if (value_->use_ref_ == 0) {
-        //从in_use_链表中移除，插入lru链表首部
-        holder_->MoveInUseToLruList(key_, *value_);
-      }
+      holder_->Release(key_, *value_);
       unbinded_ = true;
     }
 
    private:
-    LRUCache<Key, Value>* holder_;
+    CacheShard<Key, Value>* holder_;
     Key key_;
     // 持有无序map元素的引用和指针是安全的，只有对应的元素被删除才会导致失效， from
     // https://en.cppreference.com/w/cpp/container/unordered_map
@@ -91,151 +133,682 @@ class LRUCache {
 
   using free_functor = std::function<void(const Key& key, Value& value)>;
 
-  explicit LRUCache(uint32_t capacity) : capacity_(capacity) {}
+  /**
+   * @param capacity 可淘汰元素的最大数量
+   * @param high_pri_capacity 为高优先级元素保留的容量，包含在capacity中，为0时不区分优先级
+   */
+  explicit CacheShard(uint32_t capacity, uint32_t high_pri_capacity = 0)
+      : capacity_(capacity), high_pri_capacity_(std::min(high_pri_capacity, capacity)), evictable_count_(0) {}
+
+  CacheShard(const CacheShard&) = delete;
+  CacheShard& operator=(const CacheShard&) = delete;
+
+  virtual ~CacheShard() = default;
 
   void SetFreeNotify(const free_functor& f) { free_notify_ = f; }
 
   Wrapper Get(const Key& key) {
-    if (cache_.count(key) == 0) {
+    std::lock_guard<std::mutex> guard(mut_);
+    auto it = cache_.find(key);
+    if (it == cache_.end()) {
       return Wrapper(this, key, nullptr);
-    } else {
-      Entry& entry = cache_[key];
-      if (entry.use_ref_ == 0) {
-        lru_list_.erase(entry.iter);
-        in_use_.insert(in_use_.begin(), key);
-        entry.iter = in_use_.begin();
-        entry.use_ref_ = 1;
-      } else {
-        entry.use_ref_ += 1;
-      }
-      return Wrapper(this, key, &entry);
     }
+    Pin(it->first, it->second);
+    return Wrapper(this, key, &it->second);
   }
 
-  void Insert(const Key& key, std::unique_ptr<Value>&& v) {
-    if (cache_.count(key) != 0) {
-      throw BptreeExecption("an existing key was inserted in cache ");
-    }
-    Entry entry;
-    entry.use_ref_ = 0;
-    lru_list_.insert(lru_list_.begin(), key);
-    entry.iter = lru_list_.begin();
-    entry.value = std::move(v);
-    cache_[key] = std::move(entry);
+  // 只查询key是否在cache中，不增加引用计数，也不影响淘汰顺序
+  bool Contains(const Key& key) {
+    std::lock_guard<std::mutex> guard(mut_);
+    return cache_.find(key) != cache_.end();
+  }
+
+  // 等待key对应的淘汰回调执行完成，之后才能从其他地方重新加载该key对应的value
+  void WaitForEviction(const Key& key) {
+    std::unique_lock<std::mutex> guard(mut_);
+    evict_cv_.wait(guard, [&]() { return evicting_.count(key) == 0; });
+  }
 
-    while (lru_list_.size() > capacity_) {
-      uint32_t remove_key = lru_list_.back();
-      assert(cache_.count(remove_key) != 0);
-      Entry& entry = cache_[remove_key];
-      assert(entry.use_ref_ == 0);
-      if (free_notify_) {
-        free_notify_(remove_key, *entry.value.get());
+  void Insert(const Key& key, std::unique_ptr<Value>&& v, bool high_priority = false) {
+    std::vector<Victim> victims;
+    {
+      std::lock_guard<std::mutex> guard(mut_);
+      auto [it, succ] = cache_.try_emplace(key);
+      if (succ == false) {
+        throw BptreeExecption("an existing key was inserted in cache ");
       }
-      cache_.erase(remove_key);
-      lru_list_.pop_back();
+      Entry& entry = it->second;
+      entry.value = std::move(v);
+      entry.evictable = true;
+      evictable_count_ += 1;
+      Add(it->first, entry, high_priority);
+      Evict(victims);
     }
+    FreeVictims(victims);
+  }
+
+  /**
+   * @brief 如果key已经在cache中，返回已有的value并丢弃v，否则插入v。两种情况下返回的Wrapper都持有引用计数
+   * @note 与先Insert再Get相比，插入的value在返回之前不会被其他线程淘汰
+   * @note high_priority只对新插入的元素生效
+   */
+  Wrapper GetOrInsert(const Key& key, std::unique_ptr<Value>&& v, bool high_priority = false) {
+    std::lock_guard<std::mutex> guard(mut_);
+    auto [it, succ] = cache_.try_emplace(key);
+    Entry& entry = it->second;
+    if (succ == true) {
+      entry.value = std::move(v);
+      entry.evictable = false;
+      entry.use_ref_.fetch_add(1);
+      Add(it->first, entry, high_priority);
+    } else {
+      Pin(it->first, entry);
+    }
+    return Wrapper(this, key, &entry);
   }
 
   bool Delete(const Key& key, bool notify) {
-    if (cache_.count(key) != 0) {
-      Entry& entry = cache_[key];
-      if (entry.use_ref_ != 0) {
-        BPTREE_LOG_WARN("cache delete error, key == {} already in use, use_ref == {}", key, entry.use_ref_);
-        return false;
-      }
-      lru_list_.erase(entry.iter);
-      if (free_notify_ && notify) {
-        free_notify_(key, *entry.value.get());
+    std::vector<Victim> victims;
+    {
+      std::lock_guard<std::mutex> guard(mut_);
+      auto it = cache_.find(key);
+      if (it != cache_.end()) {
+        Entry& entry = it->second;
+        if (entry.evictable == false) {
+          BPTREE_LOG_WARN("cache delete error, key == {} already in use, use_ref == {}", key, entry.use_ref_.load());
+          return false;
+        }
+        Unlink(it, notify, victims);
       }
-      cache_.erase(key);
     }
+    FreeVictims(victims);
     return true;
   }
 
+  // 调用方保证key对应的元素不会再被新的使用者持有，已有的使用者可能还没有释放引用计数，等待其释放之后再移出
   std::unique_ptr<Value> Move(const Key& key) {
-    assert(cache_.count(key) > 0);
-    assert(cache_[key].use_ref_ == 0);
-    Entry& entry = cache_[key];
-    lru_list_.erase(entry.iter);
-    auto result = std::move(entry.value);
-    cache_.erase(key);
+    std::unique_lock<std::mutex> guard(mut_);
+    move_waiters_ += 1;
+    unpin_cv_.wait(guard, [&]() {
+      auto it = cache_.find(key);
+      assert(it != cache_.end());
+      return it->second.evictable;
+    });
+    move_waiters_ -= 1;
+    auto it = cache_.find(key);
+    auto result = std::move(it->second.value);
+    Remove(it);
     return result;
   }
 
-  void ForeachValueInCache(const std::function<void(const Key& key, Value&)>& handler) {
-    if (in_use_.empty() == false) {
-      throw BptreeExecption("lrucache's ForeachValueInCache is called when in_use_.empty() == false");
+  // allow_in_use为true时调用方保证正在被使用的元素在handler执行期间只会被读取
+  void ForeachValueInCache(const std::function<void(const Key& key, Value&)>& handler, bool allow_in_use = false) {
+    std::lock_guard<std::mutex> guard(mut_);
+    if (allow_in_use == false && evictable_count_ != cache_.size()) {
+      throw BptreeExecption("cache's ForeachValueInCache is called when some values are in use");
     }
     for (auto& each : cache_) {
       handler(each.first, *each.second.value.get());
     }
   }
 
+  // Wrapper释放引用计数时调用，引用计数为0时元素变为可淘汰状态
+  void Release(const Key& key, Entry& entry) {
+    size_t old_ref = entry.use_ref_.fetch_sub(1);
+    assert(old_ref > 0);
+    if (old_ref > 1) {
+      return;
+    }
+    std::vector<Victim> victims;
+    {
+      std::lock_guard<std::mutex> guard(mut_);
+      // 在获得锁之前，其他线程可能已经重新持有并释放了该元素，元素甚至可能已经被淘汰，因此不能再使用entry，需要重新查找
+      auto it = cache_.find(key);
+      if (it != cache_.end() && it->second.use_ref_.load() == 0 && it->second.evictable == false) {
+        it->second.evictable = true;
+        evictable_count_ += 1;
+        if (it->second.high_priority == true) {
+          high_pri_list_.splice(high_pri_list_.begin(), high_pri_in_use_, it->second.iter);
+        } else {
+          OnUnpin(it->first, it->second);
+        }
+        if (move_waiters_ > 0) {
+          unpin_cv_.notify_all();
+        }
+        Evict(victims);
+      }
+    }
+    FreeVictims(victims);
+  }
+
+  virtual void PrintInfo() const {
+    std::lock_guard<std::mutex> guard(mut_);
+    BPTREE_LOG_INFO("---begin to print block_cache's info---");
+    BPTREE_LOG_INFO("the count of values in use is {}", cache_.size() - evictable_count_);
+    BPTREE_LOG_INFO("the count of evictable values is {}", evictable_count_);
+    BPTREE_LOG_INFO("the count of evictable high priority values is {}", high_pri_list_.size());
+    BPTREE_LOG_INFO("the size of the map cache is {}", cache_.size());
+    BPTREE_LOG_INFO("----end to print block_cache's info----");
+  }
+
+  // 清空没有被使用的元素，如果还有在被使用的元素，返回false，否则返回true。
+  bool Clear() {
+    std::vector<Victim> victims;
+    bool empty = false;
+    {
+      std::lock_guard<std::mutex> guard(mut_);
+      while (evictable_count_ > 0) {
+        EvictOne(victims);
+      }
+      empty = cache_.empty();
+    }
+    FreeVictims(victims);
+    return empty;
+  }
+
+  size_t GetEntrySize() const {
+    std::lock_guard<std::mutex> guard(mut_);
+    return cache_.size();
+  }
+
+  size_t GetCapacity() const { return capacity_; }
+
+  size_t GetHighPriorityCapacity() const { return high_pri_capacity_; }
+
+ protected:
+  // 以下接口在持有mut_的情况下被调用，高优先级元素不会经过这些接口
+  // 元素加入cache，此时evictable已经设置
+  virtual void OnAdd(const Key& key, Entry& entry) = 0;
+  // 元素由可淘汰状态变为被持有状态
+  virtual void OnPin(const Key& key, Entry& entry) = 0;
+  // 元素由被持有状态变为可淘汰状态
+  virtual void OnUnpin(const Key& key, Entry& entry) = 0;
+  // 元素从cache中删除，此时元素一定处于可淘汰状态
+  virtual void OnRemove(const Key& key, Entry& entry) = 0;
+  // 选择一个可淘汰的元素，调用方保证至少存在一个可淘汰的元素
+  virtual Key SelectVictim() = 0;
+
+  using map_type = std::unordered_map<Key, Entry>;
+
+  map_type cache_;
+  uint32_t capacity_;
+  uint32_t high_pri_capacity_;
+  // 包含可淘汰的高优先级元素
+  size_t evictable_count_;
+  mutable std::mutex mut_;
+
+  // 有些资源不便于在析构函数中释放，可以通过注册本callback进行处理
+  free_functor free_notify_;
+
+ private:
+  // 已经从map中摘除，等待执行回调和析构的元素
+  struct Victim {
+    Key key;
+    std::unique_ptr<Value> value;
+    bool notify;
+  };
+  void Add(const Key& key, Entry& entry, bool high_priority) {
+    entry.high_priority = high_priority == true && high_pri_capacity_ > 0;
+    if (entry.high_priority == false) {
+      OnAdd(key, entry);
+      return;
+    }
+    auto& list = entry.evictable == true ? high_pri_list_ : high_pri_in_use_;
+    list.insert(list.begin(), key);
+    entry.iter = list.begin();
+  }
+
+  void Pin(const Key& key, Entry& entry) {
+    if (entry.evictable == true) {
+      entry.evictable = false;
+      evictable_count_ -= 1;
+      if (entry.high_priority == true) {
+        high_pri_in_use_.splice(high_pri_in_use_.begin(), high_pri_list_, entry.iter);
+      } else {
+        OnPin(key, entry);
+      }
+    }
+    entry.use_ref_.fetch_add(1);
+  }
+
+  void Remove(typename map_type::iterator it) {
+    assert(it->second.evictable == true);
+    if (it->second.high_priority == true) {
+      high_pri_list_.erase(it->second.iter);
+    } else {
+      OnRemove(it->first, it->second);
+    }
+    evictable_count_ -= 1;
+    cache_.erase(it);
+  }
+
+  // 高优先级元素超出保留的容量，或者没有其他可淘汰元素时，淘汰最久未使用的高优先级元素，否则由淘汰策略选择
+  Key SelectVictimByPriority() {
+    if (high_pri_list_.empty() == false &&
+        (high_pri_list_.size() > high_pri_capacity_ || high_pri_list_.size() == evictable_count_)) {
+      return high_pri_list_.back();
+    }
+    return SelectVictim();
+  }
+
+  // 持有mut_时调用，将元素从map中摘除并放入victims
+  void Unlink(typename map_type::iterator it, bool notify, std::vector<Victim>& victims) {
+    notify = notify && free_notify_;
+    if (notify == true) {
+      evicting_.insert(it->first);
+    }
+    victims.push_back(Victim{it->first, std::move(it->second.value), notify});
+    Remove(it);
+  }
+
+  void EvictOne(std::vector<Victim>& victims) {
+    Key remove_key = SelectVictimByPriority();
+    auto it = cache_.find(remove_key);
+    assert(it != cache_.end());
+    assert(it->second.use_ref_ == 0);
+    Unlink(it, true, victims);
+  }
+
+  // 淘汰元素直到可淘汰元素的数量不超过capacity_
+  void Evict(std::vector<Victim>& victims) {
+    assert(capacity_ > 0);
+    while (evictable_count_ > capacity_) {
+      EvictOne(victims);
+    }
+  }
+
+  // 不持有mut_时调用，对被摘除的元素执行回调并析构，回调抛出的第一个异常在所有元素处理完之后重新抛出
+  void FreeVictims(std::vector<Victim>& victims) {
+    if (victims.empty() == true) {
+      return;
+    }
+    std::exception_ptr error;
+    bool notified = false;
+    for (auto& each : victims) {
+      if (each.notify == true) {
+        notified = true;
+        try {
+          free_notify_(each.key, *each.value.get());
+        } catch (...) {
+          if (!error) {
+            error = std::current_exception();
+          }
+        }
+      }
+      each.value.reset();
+    }
+    if (notified == true) {
+      {
+        std::lock_guard<std::mutex> guard(mut_);
+        for (auto& each : victims) {
+          if (each.notify == true) {
+            evicting_.erase(evicting_.find(each.key));
+          }
+        }
+      }
+      evict_cv_.notify_all();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  // 可淘汰的高优先级元素，按照最近使用的顺序排列
+  std::list<Key> high_pri_list_;
+  std::list<Key> high_pri_in_use_;
+  // 已经被摘除但是淘汰回调还没有执行完成的key
+  std::unordered_multiset<Key> evicting_;
+  std::condition_variable evict_cv_;
+  // 等待元素变为可淘汰状态的Move调用数量，见Move
+  size_t move_waiters_ = 0;
+  std::condition_variable unpin_cv_;
+};
+
+/* class LRUCache 注释
+ * 该类采用基于LRU算法进行数据缓存
+ * 数据成员为两个链表：(in_use_和lru_list_)，两个链表中仅存储key信息；两个链表的长度之和应该等于map.size()
+ * 当没有用户持有时首先将Value对应的Key插入lru_list_链表首部，当lru_list_链表长度到达上限时从末尾开始执行clean操作
+ * 元素在两个链表之间通过splice移动，不会分配新的链表节点
+ */
+template <typename Key, typename Value>
+class LRUCache : public CacheShard<Key, Value> {
+ public:
+  using base_type = CacheShard<Key, Value>;
+  using Entry = typename base_type::Entry;
+  using Wrapper = typename base_type::Wrapper;
+
+  explicit LRUCache(uint32_t capacity, uint32_t high_pri_capacity = 0) : base_type(capacity, high_pri_capacity) {}
+
   void ForeachValueInTheReverseOrderOfLRUList(const std::function<bool(const Key& key, Value&)>& handler) {
+    std::lock_guard<std::mutex> guard(this->mut_);
     Counter visit_count("visit_count");
     for (auto it = lru_list_.rbegin(); it != lru_list_.rend(); ++it) {
       visit_count.Add();
-      bool cont = handler(*it, *cache_[*it].value.get());
+      bool cont = handler(*it, *this->cache_[*it].value.get());
       if (cont == false) {
         break;
       }
     }
   }
 
-  void MoveInUseToLruList(Key key, Entry& entry) {
-    assert(entry.use_ref_ == 0);
-    in_use_.erase(entry.iter);
-    lru_list_.insert(lru_list_.begin(), key);
-    entry.iter = lru_list_.begin();
-    assert(capacity_ > 0);
-    // todo 执行lru逻辑
-    while (lru_list_.size() > capacity_) {
-      uint32_t remove_key = lru_list_.back();
-      assert(cache_.count(remove_key) != 0);
-      Entry& entry = cache_[remove_key];
-      assert(entry.use_ref_ == 0);
-      if (free_notify_) {
-        free_notify_(remove_key, *entry.value.get());
+  void PrintInfo() const override {
+    std::lock_guard<std::mutex> guard(this->mut_);
+    BPTREE_LOG_INFO("---begin to print block_cache's info---");
+    BPTREE_LOG_INFO("the length of the list in_use is {}", in_use_.size());
+    BPTREE_LOG_INFO("the length of the list lru is {}", lru_list_.size());
+    BPTREE_LOG_INFO("the size of the map cache is {}", this->cache_.size());
+    BPTREE_LOG_INFO("----end to print block_cache's info----");
+  }
+
+ protected:
+  void OnAdd(const Key& key, Entry& entry) override {
+    auto& list = entry.evictable == true ? lru_list_ : in_use_;
+    list.insert(list.begin(), key);
+    entry.iter = list.begin();
+  }
+
+  void OnPin(const Key& key, Entry& entry) override { in_use_.splice(in_use_.begin(), lru_list_, entry.iter); }
+
+  //从in_use_链表中移除，插入lru链表首部
+  void OnUnpin(const Key& key, Entry& entry) override { lru_list_.splice(lru_list_.begin(), in_use_, entry.iter); }
+
+  void OnRemove(const Key& key, Entry& entry) override { lru_list_.erase(entry.iter); }
+
+  Key SelectVictim() override { return lru_list_.back(); }
+
+ private:
+  std::list<Key> lru_list_;
+  std::list<Key> in_use_;
+};
+
+/* class ClockCache 注释
+ * 该类采用CLOCK(second chance)算法进行数据缓存
+ * 所有元素存储在frames_数组中，每个元素有一个访问标志，元素被释放时设置访问标志，命中时只需要修改引用计数，不涉及链表操作和内存分配
+ * 淘汰时指针(hand_)循环扫描frames_，跳过被持有的元素，清除访问标志为true的元素的标志，淘汰第一个访问标志为false的元素
+ * frames_的大小初始化为容量，只有被持有的元素过多时才会扩容
+ */
+template <typename Key, typename Value>
+class ClockCache : public CacheShard<Key, Value> {
+ public:
+  using base_type = CacheShard<Key, Value>;
+  using Entry = typename base_type::Entry;
+  using Wrapper = typename base_type::Wrapper;
+
+  explicit ClockCache(uint32_t capacity, uint32_t high_pri_capacity = 0)
+      : base_type(capacity, high_pri_capacity), hand_(0) {
+    frames_.reserve(capacity + 1);
+  }
+
+  void PrintInfo() const override {
+    std::lock_guard<std::mutex> guard(this->mut_);
+    BPTREE_LOG_INFO("---begin to print block_cache's info---");
+    BPTREE_LOG_INFO("the count of frames is {}, free frames is {}", frames_.size(), free_frames_.size());
+    BPTREE_LOG_INFO("the count of evictable values is {}", this->evictable_count_);
+    BPTREE_LOG_INFO("the size of the map cache is {}", this->cache_.size());
+    BPTREE_LOG_INFO("----end to print block_cache's info----");
+  }
+
+ protected:
+  void OnAdd(const Key& key, Entry& entry) override {
+    if (free_frames_.empty() == true) {
+      entry.frame = frames_.size();
+      frames_.push_back(Frame{key, &entry});
+    } else {
+      entry.frame = free_frames_.back();
+      free_frames_.pop_back();
+      frames_[entry.frame] = Frame{key, &entry};
+    }
+    entry.referenced = false;
+  }
+
+  void OnPin(const Key& key, Entry& entry) override {}
+
+  void OnUnpin(const Key& key, Entry& entry) override { entry.referenced = true; }
+
+  void OnRemove(const Key& key, Entry& entry) override {
+    frames_[entry.frame].entry = nullptr;
+    free_frames_.push_back(entry.frame);
+  }
+
+  Key SelectVictim() override {
+    // 至少存在一个可淘汰的元素，因此最多扫描两轮
+    while (true) {
+      Frame& frame = frames_[hand_];
+      hand_ = hand_ + 1 == frames_.size() ? 0 : hand_ + 1;
+      if (frame.entry == nullptr || frame.entry->evictable == false) {
+        continue;
       }
-      cache_.erase(remove_key);
-      lru_list_.pop_back();
+      if (frame.entry->referenced == true) {
+        frame.entry->referenced = false;
+        continue;
+      }
+      return frame.key;
     }
   }
 
-  void PrintInfo() const {
+ private:
+  struct Frame {
+    Key key;
+    Entry* entry;
+  };
+
+  std::vector<Frame> frames_;
+  std::vector<size_t> free_frames_;
+  size_t hand_;
+};
+
+/* class TwoQueueCache 注释
+ * 该类采用2Q算法进行数据缓存，防止一次性的顺序扫描（例如大范围的GetRange）淘汰被频繁访问的元素（例如根节点和内部节点）
+ * 可淘汰的元素分布在两个LRU链表中：
+ *   - probation_ : 只被访问过一次的元素，容量超过总容量的1/4时优先从这里淘汰
+ *   - main_ : 被释放之后再次被访问的元素
+ * 从probation_中淘汰的key记录在ghost_中，如果这些key很快再次被插入，说明它们不是一次性访问，直接进入main_
+ */
+template <typename Key, typename Value>
+class TwoQueueCache : public CacheShard<Key, Value> {
+ public:
+  using base_type = CacheShard<Key, Value>;
+  using Entry = typename base_type::Entry;
+  using Wrapper = typename base_type::Wrapper;
+
+  explicit TwoQueueCache(uint32_t capacity, uint32_t high_pri_capacity = 0)
+      : base_type(capacity, high_pri_capacity),
+        probation_capacity_(std::max<size_t>(1, capacity / 4)),
+        ghost_capacity_(std::max<size_t>(1, capacity / 2)) {}
+
+  void PrintInfo() const override {
+    std::lock_guard<std::mutex> guard(this->mut_);
     BPTREE_LOG_INFO("---begin to print block_cache's info---");
     BPTREE_LOG_INFO("the length of the list in_use is {}", in_use_.size());
-    BPTREE_LOG_INFO("the length of the list lru is {}", lru_list_.size());
-    BPTREE_LOG_INFO("the size of the map cache is {}", cache_.size());
+    BPTREE_LOG_INFO("the length of the list probation is {}", probation_.size());
+    BPTREE_LOG_INFO("the length of the list main is {}", main_.size());
+    BPTREE_LOG_INFO("the length of the list ghost is {}", ghost_.size());
+    BPTREE_LOG_INFO("the size of the map cache is {}", this->cache_.size());
     BPTREE_LOG_INFO("----end to print block_cache's info----");
   }
 
-  // 清空没有被使用的元素，如果还有在被使用的元素，返回false，否则返回true。
-  bool Clear() {
-    for (auto& each : lru_list_) {
-      assert(cache_.count(each) != 0);
-      assert(cache_[each].use_ref_ == 0);
-      if (free_notify_) {
-        free_notify_(each, *cache_[each].value.get());
+ protected:
+  void OnAdd(const Key& key, Entry& entry) override {
+    auto ghost = ghost_index_.find(key);
+    entry.hot = ghost != ghost_index_.end();
+    if (entry.hot == true) {
+      ghost_.erase(ghost->second);
+      ghost_index_.erase(ghost);
+    }
+    entry.referenced = false;
+    auto& list = entry.evictable == false ? in_use_ : (entry.hot == true ? main_ : probation_);
+    list.insert(list.begin(), key);
+    entry.iter = list.begin();
+  }
+
+  void OnPin(const Key& key, Entry& entry) override {
+    in_use_.splice(in_use_.begin(), entry.hot == true ? main_ : probation_, entry.iter);
+    // 被释放过的元素再次被访问，进入热数据队列
+    if (entry.referenced == true) {
+      entry.hot = true;
+    }
+  }
+
+  void OnUnpin(const Key& key, Entry& entry) override {
+    entry.referenced = true;
+    auto& list = entry.hot == true ? main_ : probation_;
+    list.splice(list.begin(), in_use_, entry.iter);
+  }
+
+  void OnRemove(const Key& key, Entry& entry) override { (entry.hot == true ? main_ : probation_).erase(entry.iter); }
+
+  Key SelectVictim() override {
+    if (probation_.empty() == false && (probation_.size() > probation_capacity_ || main_.empty() == true)) {
+      Key key = probation_.back();
+      AddGhost(key);
+      return key;
+    }
+    return main_.back();
+  }
+
+ private:
+  void AddGhost(const Key& key) {
+    if (ghost_index_.count(key) != 0) {
+      return;
+    }
+    ghost_.push_front(key);
+    ghost_index_[key] = ghost_.begin();
+    if (ghost_.size() > ghost_capacity_) {
+      ghost_index_.erase(ghost_.back());
+      ghost_.pop_back();
+    }
+  }
+
+  size_t probation_capacity_;
+  size_t ghost_capacity_;
+  std::list<Key> probation_;
+  std::list<Key> main_;
+  std::list<Key> in_use_;
+  std::list<Key> ghost_;
+  std::unordered_map<Key, typename std::list<Key>::iterator> ghost_index_;
+};
+
+/* class ShardedCache 注释
+ * 将key按照hash值划分到多个分片中，每个分片有独立的锁，容量平均分配给各个分片，分片的淘汰策略由CachePolicy指定
+ * 接口与CacheShard一致，淘汰回调（SetFreeNotify）的语义不变，但是不同分片的回调可能在不同线程中并发执行
+ */
+template <typename Key, typename Value>
+class ShardedCache {
+ public:
+  using shard_type = CacheShard<Key, Value>;
+  using Wrapper = typename shard_type::Wrapper;
+  using free_functor = typename shard_type::free_functor;
+
+  /**
+   * @param capacity 总容量
+   * @param shard_count 分片数量，会被调整为2的幂，并保证每个分片的容量不小于min_capacity_per_shard
+   * @param policy 淘汰策略
+   * @param high_pri_capacity 为高优先级元素保留的总容量，包含在capacity中，与capacity一样平均分配给各个分片
+   */
+  ShardedCache(uint32_t capacity, uint32_t shard_count, CachePolicy policy = CachePolicy::LRU,
+               uint32_t high_pri_capacity = 0)
+      : capacity_(capacity),
+        high_pri_capacity_(std::min(high_pri_capacity, capacity)),
+        shard_mask_(0),
+        policy_(policy) {
+    uint32_t count = 1;
+    while (count * 2 <= shard_count && capacity / (count * 2) >= min_capacity_per_shard) {
+      count *= 2;
+    }
+    shard_mask_ = count - 1;
+    for (uint32_t i = 0; i < count; ++i) {
+      // 前capacity % count个分片多分配一个，保证总容量不变
+      uint32_t shard_capacity = capacity / count + (i < capacity % count ? 1 : 0);
+      uint32_t shard_high_pri_capacity = high_pri_capacity_ / count + (i < high_pri_capacity_ % count ? 1 : 0);
+      if (policy == CachePolicy::CLOCK) {
+        shards_.push_back(std::make_unique<ClockCache<Key, Value>>(shard_capacity, shard_high_pri_capacity));
+      } else if (policy == CachePolicy::TWO_QUEUE) {
+        shards_.push_back(std::make_unique<TwoQueueCache<Key, Value>>(shard_capacity, shard_high_pri_capacity));
+      } else {
+        shards_.push_back(std::make_unique<LRUCache<Key, Value>>(shard_capacity, shard_high_pri_capacity));
       }
-      cache_.erase(each);
     }
-    lru_list_.clear();
-    return in_use_.empty();
   }
 
-  size_t GetEntrySize() const { return cache_.size(); }
+  void SetFreeNotify(const free_functor& f) {
+    for (auto& each : shards_) {
+      each->SetFreeNotify(f);
+    }
+  }
+
+  Wrapper Get(const Key& key) { return GetShard(key).Get(key); }
+
+  bool Contains(const Key& key) { return GetShard(key).Contains(key); }
+
+  void WaitForEviction(const Key& key) { GetShard(key).WaitForEviction(key); }
+
+  void Insert(const Key& key, std::unique_ptr<Value>&& v, bool high_priority = false) {
+    GetShard(key).Insert(key, std::move(v), high_priority);
+  }
+
+  Wrapper GetOrInsert(const Key& key, std::unique_ptr<Value>&& v, bool high_priority = false) {
+    return GetShard(key).GetOrInsert(key, std::move(v), high_priority);
+  }
+
+  bool Delete(const Key& key, bool notify) { return GetShard(key).Delete(key, notify); }
+
+  std::unique_ptr<Value> Move(const Key& key) { return GetShard(key).Move(key); }
+
+  void ForeachValueInCache(const std::function<void(const Key& key, Value&)>& handler, bool allow_in_use = false) {
+    for (auto& each : shards_) {
+      each->ForeachValueInCache(handler, allow_in_use);
+    }
+  }
+
+  void PrintInfo() const {
+    BPTREE_LOG_INFO("block_cache has {} shards, policy : {}, high priority capacity : {}", shards_.size(),
+                    CachePolicyStr(policy_), high_pri_capacity_);
+    for (auto& each : shards_) {
+      each->PrintInfo();
+    }
+  }
+
+  // 清空所有分片中没有被使用的元素，如果还有在被使用的元素，返回false，否则返回true。
+  bool Clear() {
+    bool result = true;
+    for (auto& each : shards_) {
+      result = each->Clear() && result;
+    }
+    return result;
+  }
+
+  size_t GetEntrySize() const {
+    size_t result = 0;
+    for (auto& each : shards_) {
+      result += each->GetEntrySize();
+    }
+    return result;
+  }
 
   size_t GetCapacity() const { return capacity_; }
 
+  size_t GetHighPriorityCapacity() const { return high_pri_capacity_; }
+
+  size_t GetShardCount() const { return shards_.size(); }
+
+  CachePolicy GetPolicy() const { return policy_; }
+
  private:
-  std::unordered_map<Key, Entry> cache_;
-  std::list<Key> lru_list_;
-  std::list<Key> in_use_;
-  uint32_t capacity_;
+  // 分片过小会导致热点数据集中的分片频繁淘汰
+  static constexpr uint32_t min_capacity_per_shard = 16;
+
+  // std::hash对整数是恒等映射，直接取低位时按固定步长分配的block编号会集中在少数分片中，
+  // 乘以64位奇数常数之后取高32位，使key的每一位都参与分片的选择
+  shard_type& GetShard(const Key& key) {
+    uint64_t hash = static_cast<uint64_t>(std::hash<Key>()(key)) * 0x9E3779B97F4A7C15ULL;
+    return *shards_[static_cast<uint32_t>(hash >> 32) & shard_mask_];
+  }
 
-  // 有些资源不便于在析构函数中释放，可以通过注册本callback进行处理
-  free_functor free_notify_;
+  uint32_t capacity_;
+  uint32_t high_pri_capacity_;
+  uint32_t shard_mask_;
+  CachePolicy policy_;
+  std::vector<std::unique_ptr<shard_type>> shards_;
 };
 
 }  // namespace bptree
\ No newline at end of file
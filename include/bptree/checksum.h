@@ -0,0 +1,178 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+namespace bptree {
+namespace checksum {
+
+/*
+ * CRC32C(Castagnoli)校验，block和wal日志使用该校验码
+ * 支持SSE4.2和PCLMUL的cpu上使用crc32指令计算，较长的buffer分为三段交错计算，最后通过PCLMUL合并
+ * 其他平台使用slicing-by-8查表实现，具体实现在第一次调用时根据cpu特性选择
+ */
+
+namespace detail {
+
+constexpr uint32_t crc32c_poly = 0x82F63B78;
+
+constexpr std::array<std::array<uint32_t, 256>, 8> CreateCrc32cTable() {
+  std::array<std::array<uint32_t, 256>, 8> table{};
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t crc = i;
+    for (int j = 0; j < 8; ++j) {
+      crc = (crc & 1) ? (crc >> 1) ^ crc32c_poly : crc >> 1;
+    }
+    table[0][i] = crc;
+  }
+  for (uint32_t i = 0; i < 256; ++i) {
+    for (size_t k = 1; k < 8; ++k) {
+      table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+    }
+  }
+  return table;
+}
+
+inline constexpr std::array<std::array<uint32_t, 256>, 8> crc32c_table = CreateCrc32cTable();
+
+// 以下函数的crc参数和返回值都是没有取反的中间状态
+inline uint32_t ExtendPortable(uint32_t crc, const char* data, size_t n) noexcept {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  while (n >= 8) {
+    uint32_t low = 0;
+    uint32_t high = 0;
+    memcpy(&low, p, sizeof(low));
+    memcpy(&high, p + 4, sizeof(high));
+    low ^= crc;
+    crc = crc32c_table[7][low & 0xFF] ^ crc32c_table[6][(low >> 8) & 0xFF] ^ crc32c_table[5][(low >> 16) & 0xFF] ^
+          crc32c_table[4][low >> 24] ^ crc32c_table[3][high & 0xFF] ^ crc32c_table[2][(high >> 8) & 0xFF] ^
+          crc32c_table[1][(high >> 16) & 0xFF] ^ crc32c_table[0][high >> 24];
+    p += 8;
+    n -= 8;
+  }
+  while (n > 0) {
+    crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p) & 0xFF];
+    ++p;
+    --n;
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+
+// 三段交错计算时每一段的长度
+constexpr size_t crc32c_stride = 1024;
+
+// 返回x^n mod P（bit反转表示），用于计算PCLMUL合并时的常量
+constexpr uint32_t XPowModP(size_t n) {
+  uint32_t result = 0x80000000;
+  for (size_t i = 0; i < n; ++i) {
+    result = (result & 1) ? (result >> 1) ^ crc32c_poly : result >> 1;
+  }
+  return result;
+}
+
+// crc32指令计算的是V * x^32 mod P，PCLMUL的乘积在bit反转表示下多乘了一个x，因此常量为x^(8 * stride - 33)
+inline constexpr uint32_t crc32c_stride_shift = XPowModP(8 * crc32c_stride - 33);
+
+// 相当于在crc之后追加crc32c_stride个0字节
+__attribute__((target("sse4.2,pclmul"))) inline uint32_t ShiftStrideSse42(uint32_t crc) noexcept {
+  __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128(static_cast<int>(crc)),
+                                         _mm_cvtsi32_si128(static_cast<int>(crc32c_stride_shift)), 0x00);
+  return static_cast<uint32_t>(_mm_crc32_u64(0, static_cast<uint64_t>(_mm_cvtsi128_si64(product))));
+}
+
+__attribute__((target("sse4.2,pclmul"))) inline uint32_t ExtendSse42(uint32_t crc, const char* data,
+                                                                     size_t n) noexcept {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  while (n > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+    crc = _mm_crc32_u8(crc, *p);
+    ++p;
+    --n;
+  }
+  // crc32指令的延迟为3个周期，三段互不依赖的数据交错计算可以充分利用流水线
+  uint64_t crc0 = crc;
+  while (n >= 3 * crc32c_stride) {
+    uint64_t crc1 = 0;
+    uint64_t crc2 = 0;
+    for (size_t i = 0; i < crc32c_stride; i += 8) {
+      uint64_t v0, v1, v2;
+      memcpy(&v0, p + i, sizeof(v0));
+      memcpy(&v1, p + crc32c_stride + i, sizeof(v1));
+      memcpy(&v2, p + 2 * crc32c_stride + i, sizeof(v2));
+      crc0 = _mm_crc32_u64(crc0, v0);
+      crc1 = _mm_crc32_u64(crc1, v1);
+      crc2 = _mm_crc32_u64(crc2, v2);
+    }
+    uint32_t tmp = ShiftStrideSse42(static_cast<uint32_t>(crc0)) ^ static_cast<uint32_t>(crc1);
+    crc0 = ShiftStrideSse42(tmp) ^ static_cast<uint32_t>(crc2);
+    p += 3 * crc32c_stride;
+    n -= 3 * crc32c_stride;
+  }
+  while (n >= 8) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    crc0 = _mm_crc32_u64(crc0, v);
+    p += 8;
+    n -= 8;
+  }
+  crc = static_cast<uint32_t>(crc0);
+  while (n > 0) {
+    crc = _mm_crc32_u8(crc, *p);
+    ++p;
+    --n;
+  }
+  return crc;
+}
+
+#endif
+
+}  // namespace detail
+
+inline uint32_t Crc32cPortable(const char* data, size_t n) noexcept {
+  return ~detail::ExtendPortable(0xFFFFFFFF, data, n);
+}
+
+inline bool Crc32cHardwareSupported() noexcept {
+#if defined(__x86_64__)
+  static const bool supported = __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul");
+  return supported;
+#else
+  return false;
+#endif
+}
+
+#if defined(__x86_64__)
+// 调用方需要保证Crc32cHardwareSupported()为true
+inline uint32_t Crc32cHardware(const char* data, size_t n) noexcept {
+  return ~detail::ExtendSse42(0xFFFFFFFF, data, n);
+}
+#endif
+
+using crc32c_func = uint32_t (*)(const char* data, size_t n) noexcept;
+
+inline crc32c_func SelectCrc32c() noexcept {
+#if defined(__x86_64__)
+  if (Crc32cHardwareSupported() == true) {
+    return Crc32cHardware;
+  }
+#endif
+  return Crc32cPortable;
+}
+
+inline const char* Crc32cImplStr() noexcept { return Crc32cHardwareSupported() == true ? "sse4.2" : "portable"; }
+
+inline uint32_t Crc32c(const char* data, size_t n) noexcept {
+  static const crc32c_func func = SelectCrc32c();
+  return func(data, n);
+}
+
+}  // namespace checksum
+}  // namespace bptree
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "bptree/checksum.h"
+#include "bptree/util.h"
+
+namespace bptree {
+
+/*
+ * 记录db中所有key的cuckoo filter，Get在查找树之前先查询filter，filter确定key不存在时直接返回
+ * 每个bucket有4个slot，每个slot存储key的16位指纹（0表示空slot），key的两个候选bucket满足 i2 = i1 ^ hash(指纹)，
+ * 因此踢出元素时只需要指纹就可以计算另一个候选bucket，删除时只删除一个相同的指纹（要求删除的key之前被插入过）
+ * 插入失败（filter过满）时进入溢出状态，此后MayContain总是返回true，由使用者重新构建
+ * 线程安全，查询之间不互斥
+ */
+class CuckooFilter {
+ public:
+  static constexpr size_t slots_per_bucket = 4;
+  // 插入时最多踢出的次数
+  static constexpr size_t max_kicks = 500;
+
+  /**
+   * @brief 构造可以容纳capacity个key的filter，bucket数量为2的幂，负载因子不超过0.8
+   */
+  explicit CuckooFilter(size_t capacity) : count_(0), overflow_(false), rng_(0x9E3779B97F4A7C15ULL) {
+    size_t bucket_count = 1024;
+    while (bucket_count * slots_per_bucket * 4 < capacity * 5) {
+      bucket_count *= 2;
+    }
+    table_.resize(bucket_count * slots_per_bucket, 0);
+    mask_ = bucket_count - 1;
+  }
+
+  CuckooFilter(const CuckooFilter&) = delete;
+  CuckooFilter& operator=(const CuckooFilter&) = delete;
+
+  // 返回false时key一定不存在
+  bool MayContain(std::string_view key) const {
+    uint64_t hash = Hash(key);
+    uint16_t fp = Fingerprint(hash);
+    size_t i1 = hash & mask_;
+    std::shared_lock<std::shared_mutex> guard(mutex_);
+    if (overflow_ == true) {
+      return true;
+    }
+    return BucketContains(i1, fp) || BucketContains(AltIndex(i1, fp), fp);
+  }
+
+  void Add(std::string_view key) {
+    uint64_t hash = Hash(key);
+    uint16_t fp = Fingerprint(hash);
+    size_t index = hash & mask_;
+    std::unique_lock<std::shared_mutex> guard(mutex_);
+    if (overflow_ == true) {
+      return;
+    }
+    count_ += 1;
+    if (InsertToBucket(index, fp) == true || InsertToBucket(AltIndex(index, fp), fp) == true) {
+      return;
+    }
+    for (size_t kick = 0; kick < max_kicks; ++kick) {
+      if ((NextRandom() & 1) != 0) {
+        index = AltIndex(index, fp);
+      }
+      // 与bucket中随机的一个指纹交换，然后将被踢出的指纹放入它的另一个候选bucket
+      uint16_t& slot = table_[index * slots_per_bucket + NextRandom() % slots_per_bucket];
+      std::swap(fp, slot);
+      index = AltIndex(index, fp);
+      if (InsertToBucket(index, fp) == true) {
+        return;
+      }
+    }
+    // 最后被踢出的指纹丢失，filter不再可用
+    overflow_ = true;
+  }
+
+  // 删除key的一个指纹，要求key之前通过Add插入过
+  void Remove(std::string_view key) {
+    uint64_t hash = Hash(key);
+    uint16_t fp = Fingerprint(hash);
+    size_t i1 = hash & mask_;
+    std::unique_lock<std::shared_mutex> guard(mutex_);
+    if (overflow_ == true) {
+      return;
+    }
+    if (RemoveFromBucket(i1, fp) == true || RemoveFromBucket(AltIndex(i1, fp), fp) == true) {
+      count_ -= 1;
+    }
+  }
+
+  bool Overflowed() const {
+    std::shared_lock<std::shared_mutex> guard(mutex_);
+    return overflow_;
+  }
+
+  // 插入的指纹数量（包括重复插入的key）
+  size_t Size() const {
+    std::shared_lock<std::shared_mutex> guard(mutex_);
+    return count_;
+  }
+
+  size_t BucketCount() const noexcept { return mask_ + 1; }
+
+  // 格式：magic | bucket_count | count | overflow | table | crc32c
+  std::string Serialize() const {
+    std::shared_lock<std::shared_mutex> guard(mutex_);
+    std::string result;
+    util::StringAppender(result, cuckoo_filter_magic);
+    util::StringAppender(result, static_cast<uint64_t>(mask_ + 1));
+    util::StringAppender(result, static_cast<uint64_t>(count_));
+    util::StringAppender(result, static_cast<uint8_t>(overflow_ == true ? 1 : 0));
+    result.append(reinterpret_cast<const char*>(table_.data()), table_.size() * sizeof(uint16_t));
+    util::StringAppender(result, checksum::Crc32c(result.data(), result.size()));
+    return result;
+  }
+
+  // 数据不完整或者校验失败时返回nullptr
+  static std::unique_ptr<CuckooFilter> Deserialize(const std::string& data) {
+    size_t header_size = sizeof(uint32_t) + 2 * sizeof(uint64_t) + sizeof(uint8_t);
+    if (data.size() < header_size + sizeof(uint32_t)) {
+      return nullptr;
+    }
+    size_t offset = data.size() - sizeof(uint32_t);
+    uint32_t crc = util::StringParser<uint32_t>(data, offset);
+    if (crc != checksum::Crc32c(data.data(), data.size() - sizeof(uint32_t))) {
+      return nullptr;
+    }
+    offset = 0;
+    uint32_t magic = util::StringParser<uint32_t>(data, offset);
+    uint64_t bucket_count = util::StringParser<uint64_t>(data, offset);
+    uint64_t count = util::StringParser<uint64_t>(data, offset);
+    uint8_t overflow = util::StringParser<uint8_t>(data, offset);
+    if (magic != cuckoo_filter_magic || bucket_count == 0 || (bucket_count & (bucket_count - 1)) != 0 ||
+        data.size() != header_size + bucket_count * slots_per_bucket * sizeof(uint16_t) + sizeof(uint32_t)) {
+      return nullptr;
+    }
+    std::unique_ptr<CuckooFilter> filter(new CuckooFilter(0));
+    filter->table_.resize(bucket_count * slots_per_bucket);
+    memcpy(filter->table_.data(), &data[offset], filter->table_.size() * sizeof(uint16_t));
+    filter->mask_ = bucket_count - 1;
+    filter->count_ = count;
+    filter->overflow_ = overflow != 0;
+    return filter;
+  }
+
+  // MurmurHash64A，持久化的filter依赖该函数，不能修改
+  static uint64_t Hash(std::string_view key) noexcept {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    uint64_t h = 0x5bd1e995ULL ^ (key.size() * m);
+    size_t n = key.size() / 8;
+    for (size_t i = 0; i < n; ++i) {
+      uint64_t k = 0;
+      memcpy(&k, key.data() + i * 8, sizeof(k));
+      k *= m;
+      k ^= k >> r;
+      k *= m;
+      h ^= k;
+      h *= m;
+    }
+    const unsigned char* tail = reinterpret_cast<const unsigned char*>(key.data() + n * 8);
+    switch (key.size() & 7) {
+      case 7:
+        h ^= uint64_t(tail[6]) << 48;
+        [[fallthrough]];
+      case 6:
+        h ^= uint64_t(tail[5]) << 40;
+        [[fallthrough]];
+      case 5:
+        h ^= uint64_t(tail[4]) << 32;
+        [[fallthrough]];
+      case 4:
+        h ^= uint64_t(tail[3]) << 24;
+        [[fallthrough]];
+      case 3:
+        h ^= uint64_t(tail[2]) << 16;
+        [[fallthrough]];
+      case 2:
+        h ^= uint64_t(tail[1]) << 8;
+        [[fallthrough]];
+      case 1:
+        h ^= uint64_t(tail[0]);
+        h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+  }
+
+ private:
+  static constexpr uint32_t cuckoo_filter_magic = 0x434B4631;
+
+  // 指纹取hash的高16位，与bucket下标使用的低位无关，0表示空slot
+  static uint16_t Fingerprint(uint64_t hash) noexcept {
+    uint16_t fp = static_cast<uint16_t>(hash >> 48);
+    return fp == 0 ? 1 : fp;
+  }
+
+  size_t AltIndex(size_t index, uint16_t fp) const noexcept {
+    return (index ^ static_cast<size_t>(fp * 0x5bd1e995ULL)) & mask_;
+  }
+
+  bool BucketContains(size_t index, uint16_t fp) const noexcept {
+    const uint16_t* bucket = &table_[index * slots_per_bucket];
+    return bucket[0] == fp || bucket[1] == fp || bucket[2] == fp || bucket[3] == fp;
+  }
+
+  bool InsertToBucket(size_t index, uint16_t fp) noexcept {
+    uint16_t* bucket = &table_[index * slots_per_bucket];
+    for (size_t i = 0; i < slots_per_bucket; ++i) {
+      if (bucket[i] == 0) {
+        bucket[i] = fp;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool RemoveFromBucket(size_t index, uint16_t fp) noexcept {
+    uint16_t* bucket = &table_[index * slots_per_bucket];
+    for (size_t i = 0; i < slots_per_bucket; ++i) {
+      if (bucket[i] == fp) {
+        bucket[i] = 0;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint64_t NextRandom() noexcept {
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 7;
+    rng_ ^= rng_ << 17;
+    return rng_;
+  }
+
+  mutable std::shared_mutex mutex_;
+  std::vector<uint16_t> table_;
+  size_t mask_;
+  size_t count_;
+  bool overflow_;
+  uint64_t rng_;
+};
+
+}  // namespace bptree
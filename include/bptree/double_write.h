@@ -26,6 +26,8 @@ class DoubleWrite {
 
   void TurnOff() { turn_off_ = true; }
 
+  bool TurnedOff() const { return turn_off_; }
+
   void WriteBlock(const BlockBase& block) {
     if (turn_off_ == true) {
       return;
@@ -2,13 +2,18 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <cstring>
+#include <memory>
+#include <span>
 #include <string>
 
 #include "bptree/exception.h"
+#include "bptree/io_uring.h"
 #include "bptree/log.h"
 
 namespace bptree {
@@ -25,6 +30,23 @@ enum class FileType {
   DIRECT_AND_SYNC,
 };
 
+// 批量读写（ReadBatch/WriteBatch）使用的io引擎
+enum class IoEngine {
+  // 逐个调用pread/pwrite
+  SYNC,
+  // 通过io_uring一次提交多个请求，内核不支持时退化为SYNC
+  IO_URING,
+};
+
+inline const char* IoEngineStr(IoEngine engine) {
+  if (engine == IoEngine::SYNC) {
+    return "sync";
+  } else if (engine == IoEngine::IO_URING) {
+    return "io_uring";
+  }
+  return "unknown";
+}
+
 template <OS os>
 class FileHandlerImpl;
 
@@ -80,16 +102,72 @@ class FileHandlerImpl<OS::LINUX> {
   FileHandlerImpl(const FileHandlerImpl&) = delete;
   FileHandlerImpl& operator=(const FileHandlerImpl&) = delete;
 
-  FileHandlerImpl(FileHandlerImpl&& other) : fd_(other.fd_), file_name_(std::move(other.file_name_)) { other.fd_ = -1; }
+  FileHandlerImpl(FileHandlerImpl&& other)
+      : fd_(other.fd_), file_name_(std::move(other.file_name_)), ring_(std::move(other.ring_)) {
+    other.fd_ = -1;
+  }
 
   FileHandlerImpl& operator=(FileHandlerImpl&& other) {
     Close();
     fd_ = other.fd_;
     file_name_ = std::move(other.file_name_);
+    ring_ = std::move(other.ring_);
     other.fd_ = -1;
     return *this;
   }
 
+  /**
+   * @brief 设置ReadBatch/WriteBatch使用的io引擎
+   * @param queue_depth io_uring一次最多提交的请求数量
+   * @return 实际使用的io引擎，内核不支持io_uring时返回IoEngine::SYNC
+   */
+  IoEngine SetIoEngine(IoEngine engine, unsigned queue_depth) {
+    ring_.reset();
+    if (engine == IoEngine::IO_URING) {
+      auto ring = std::make_unique<IoUring>(queue_depth);
+      if (ring->Valid() == false) {
+        BPTREE_LOG_WARN("file {} : io_uring is not supported, fall back to sync io", file_name_);
+        return IoEngine::SYNC;
+      }
+      ring_ = std::move(ring);
+    }
+    return GetIoEngine();
+  }
+
+  IoEngine GetIoEngine() const noexcept { return ring_ != nullptr ? IoEngine::IO_URING : IoEngine::SYNC; }
+
+  /**
+   * @brief 批量定位读，返回时所有请求都已经完成，使用io_uring时多个请求由内核并发执行
+   * @note 对buf和offset的要求同Read，任意一个请求失败时抛出异常
+   */
+  void ReadBatch(std::span<const IoRequest> requests) {
+    if (ring_ != nullptr) {
+      if (ring_->Submit(fd_, requests, false) == false) {
+        throw BptreeExecption("file {}. ReadBatch error : {}", file_name_, strerror(errno));
+      }
+      return;
+    }
+    for (auto& each : requests) {
+      Read(each.buf, each.nbyte, each.offset);
+    }
+  }
+
+  /**
+   * @brief 批量定位写，返回时所有请求都已经完成，不同请求之间的写入顺序没有保证
+   * @note 对buf和offset的要求同Write，任意一个请求失败时抛出异常
+   */
+  void WriteBatch(std::span<const IoRequest> requests) {
+    if (ring_ != nullptr) {
+      if (ring_->Submit(fd_, requests, true) == false) {
+        throw BptreeExecption("file {}. WriteBatch error : {}", file_name_, strerror(errno));
+      }
+      return;
+    }
+    for (auto& each : requests) {
+      Write(each.buf, each.nbyte, each.offset);
+    }
+  }
+
   /**
    * @brief 定位写，将buf开始的连续nbyte个字节写入偏移量为offset的位置
    * @param buf 写入数据首地址
@@ -262,8 +340,19 @@ class FileHandlerImpl<OS::LINUX> {
     }
   }
 
+  /**
+   * @brief 通知内核预读[offset, offset + nbyte)，不等待读取完成，之后的Read可以命中page cache
+   * @note 只是提示，失败时忽略
+   */
+  void Prefetch(size_t nbyte, size_t offset) noexcept {
+    posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(nbyte), POSIX_FADV_WILLNEED);
+  }
+
   void Flush() { fsync(fd_); }
 
+  // 只同步数据和读取数据所必需的元数据（例如文件大小），追加写的文件可以代替Flush
+  void DataSync() { fdatasync(fd_); }
+
   void Close() {
     if (fd_ != -1) {
       close(fd_);
@@ -278,10 +367,83 @@ class FileHandlerImpl<OS::LINUX> {
  private:
   int fd_;
   std::string file_name_;
+  // 为nullptr时批量读写逐个同步执行
+  std::unique_ptr<IoUring> ring_;
 };
 
 #ifdef __linux__
 using FileHandler = FileHandlerImpl<OS::LINUX>;
 #endif
 
+/*
+ * 以只读方式将整个文件映射到内存，映射的页由内核的page cache管理，多个进程映射同一个文件时共享物理页
+ * 映射之后文件的大小不会改变，超出映射范围的部分需要通过FileHandler读取
+ */
+class MappedFile {
+ public:
+  MappedFile() : data_(nullptr), size_(0) {}
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /**
+   * @brief 映射文件名称为filename的文件，文件必须存在并且不为空
+   * @note 打开文件或者映射失败时抛出异常
+   */
+  void Map(const std::string& filename) {
+    Unmap();
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+      throw BptreeExecption("open file {} error : {}", filename, strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      throw BptreeExecption("mmap file {} error : can't get the file size", filename);
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    // 映射建立之后关闭fd不影响映射
+    close(fd);
+    if (data == MAP_FAILED) {
+      throw BptreeExecption("mmap file {} error : {}", filename, strerror(errno));
+    }
+    data_ = static_cast<char*>(data);
+    size_ = static_cast<size_t>(st.st_size);
+  }
+
+  void Unmap() noexcept {
+    if (data_ != nullptr) {
+      munmap(data_, size_);
+      data_ = nullptr;
+      size_ = 0;
+    }
+  }
+
+  bool Mapped() const noexcept { return data_ != nullptr; }
+
+  const char* Data() const noexcept { return data_; }
+
+  size_t Size() const noexcept { return size_; }
+
+  /**
+   * @brief 通知内核预读映射中的[offset, offset + nbyte)，只是提示，失败时忽略
+   */
+  void Prefetch(size_t nbyte, size_t offset) noexcept {
+    // madvise要求起始地址按页对齐
+    size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = offset / page_size * page_size;
+    if (begin >= size_) {
+      return;
+    }
+    size_t end = std::min(offset + nbyte, size_);
+    madvise(data_ + begin, end - begin, MADV_WILLNEED);
+  }
+
+  ~MappedFile() { Unmap(); }
+
+ private:
+  char* data_;
+  size_t size_;
+};
+
 }  // namespace bptree
\ No newline at end of file
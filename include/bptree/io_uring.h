@@ -0,0 +1,236 @@
+#pragma once
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <span>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define BPTREE_HAS_IO_URING 1
+#else
+#define BPTREE_HAS_IO_URING 0
+#endif
+
+namespace bptree {
+
+// 一个定位读写请求，读请求时数据写入buf，写请求时从buf读取数据
+struct IoRequest {
+  char* buf;
+  size_t nbyte;
+  size_t offset;
+};
+
+/*
+ * 直接通过系统调用使用io_uring（不依赖liburing），一次提交多个定位读写请求，由内核并发执行，然后等待全部完成
+ * 内核不支持（或者io_uring被禁用）时Valid()返回false，调用方继续使用同步的pread/pwrite
+ * 同一时刻只有一个批次在使用ring，多个线程同时调用Submit时串行化
+ */
+class IoUring {
+ public:
+  explicit IoUring(unsigned queue_depth) {
+#if BPTREE_HAS_IO_URING
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, queue_depth, &params));
+    if (fd < 0) {
+      return;
+    }
+    ring_fd_ = fd;
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap == true) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                    IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      sq_ring_ = nullptr;
+      Release();
+      return;
+    }
+    if (single_mmap == true) {
+      cq_ring_ = sq_ring_;
+    } else {
+      cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                      IORING_OFF_CQ_RING);
+      if (cq_ring_ == MAP_FAILED) {
+        cq_ring_ = nullptr;
+        Release();
+        return;
+      }
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      Release();
+      return;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    queue_depth_ = params.sq_entries;
+#endif
+  }
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  ~IoUring() { Release(); }
+
+  bool Valid() const noexcept { return ring_fd_ != -1; }
+
+  // 一次最多同时提交的请求数量，内核会将构造时指定的值向上取整为2的幂
+  unsigned QueueDepth() const noexcept { return queue_depth_; }
+
+  /**
+   * @brief 对fd批量执行定位读（write == false）或者定位写，每次最多提交QueueDepth()个请求，返回时所有请求都已经完成
+   * @return
+   *     - true 所有请求都成功完成
+   *     - false 存在失败的请求，错误信息参考errno值，读请求遇到文件尾时errno为ENODATA
+   * @note 调用方需要保证Valid()为true。被内核拒绝或者只完成了一部分的请求使用同步的pread/pwrite完成剩余的部分
+   */
+  bool Submit(int fd, std::span<const IoRequest> requests, bool write) noexcept {
+#if BPTREE_HAS_IO_URING
+    std::lock_guard<std::mutex> guard(mutex_);
+    int error = 0;
+    for (size_t begin = 0; begin < requests.size(); begin += queue_depth_) {
+      size_t count = std::min<size_t>(queue_depth_, requests.size() - begin);
+      uint32_t tail = *sq_tail_;
+      for (size_t i = 0; i < count; ++i) {
+        const IoRequest& request = requests[begin + i];
+        uint32_t slot = (tail + i) & sq_mask_;
+        io_uring_sqe& sqe = sqes_[slot];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = write == true ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(request.buf);
+        sqe.len = static_cast<uint32_t>(request.nbyte);
+        sqe.off = request.offset;
+        sqe.user_data = begin + i;
+        sq_array_[slot] = slot;
+      }
+      // 内核读取sq_tail之前需要看到sqe的内容
+      std::atomic_ref<uint32_t>(*sq_tail_).store(tail + static_cast<uint32_t>(count), std::memory_order_release);
+      size_t to_submit = count;
+      size_t completed = 0;
+      while (completed < count) {
+        long ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit, count - completed, IORING_ENTER_GETEVENTS,
+                           nullptr, 0);
+        if (ret < 0) {
+          // 已经提交的请求必须等待完成之后才能返回，否则内核可能在返回之后访问buf
+          if (errno == EINTR || errno == EAGAIN || errno == EBUSY || to_submit != count) {
+            continue;
+          }
+          // 提交失败，此时内核没有消费任何sqe，回退sq_tail之后同步完成这一批请求
+          std::atomic_ref<uint32_t>(*sq_tail_).store(tail, std::memory_order_release);
+          for (size_t i = 0; i < count; ++i) {
+            int err = Finish(fd, requests[begin + i], 0, write);
+            error = error == 0 ? err : error;
+          }
+          completed = count;
+          break;
+        }
+        to_submit -= std::min<size_t>(to_submit, static_cast<size_t>(ret));
+        uint32_t head = *cq_head_;
+        uint32_t cq_tail = std::atomic_ref<uint32_t>(*cq_tail_).load(std::memory_order_acquire);
+        for (; head != cq_tail; ++head) {
+          const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+          int err = Finish(fd, requests[cqe.user_data], cqe.res, write);
+          error = error == 0 ? err : error;
+          ++completed;
+        }
+        std::atomic_ref<uint32_t>(*cq_head_).store(head, std::memory_order_release);
+      }
+    }
+    if (error != 0) {
+      errno = error;
+      return false;
+    }
+    return true;
+#else
+    errno = ENOSYS;
+    return false;
+#endif
+  }
+
+ private:
+  // res为内核返回的结果，小于0时为错误码，否则为已经完成的字节数，剩余的部分同步完成，返回0或者错误码
+  static int Finish(int fd, const IoRequest& request, int res, bool write) noexcept {
+    size_t done = res > 0 ? static_cast<size_t>(res) : 0;
+    while (done < request.nbyte) {
+      ssize_t ret = write == true ? pwrite(fd, request.buf + done, request.nbyte - done, request.offset + done)
+                                  : pread(fd, request.buf + done, request.nbyte - done, request.offset + done);
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return errno;
+      }
+      if (ret == 0) {
+        return write == true ? EIO : ENODATA;
+      }
+      done += static_cast<size_t>(ret);
+    }
+    return 0;
+  }
+
+  void Release() noexcept {
+#if BPTREE_HAS_IO_URING
+    if (sqes_ != nullptr) {
+      munmap(sqes_, sqes_size_);
+      sqes_ = nullptr;
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = nullptr;
+    if (sq_ring_ != nullptr) {
+      munmap(sq_ring_, sq_ring_size_);
+      sq_ring_ = nullptr;
+    }
+#endif
+    if (ring_fd_ != -1) {
+      close(ring_fd_);
+      ring_fd_ = -1;
+    }
+  }
+
+  int ring_fd_ = -1;
+  unsigned queue_depth_ = 0;
+  std::mutex mutex_;
+#if BPTREE_HAS_IO_URING
+  void* sq_ring_ = nullptr;
+  void* cq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+  uint32_t* sq_tail_ = nullptr;
+  uint32_t sq_mask_ = 0;
+  uint32_t* sq_array_ = nullptr;
+  uint32_t* cq_head_ = nullptr;
+  uint32_t* cq_tail_ = nullptr;
+  uint32_t cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+#endif
+};
+
+}  // namespace bptree
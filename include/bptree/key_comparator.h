@@ -1,10 +1,90 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <typeinfo>
 
 namespace bptree {
 
+/*
+ * 内置的key比较方式，查找等热点路径根据该类型直接调用key_traits中对应的内联实现，不经过虚函数
+ * CUSTOM表示用户自定义的Comparator，通过虚函数调用
+ */
+enum class KeyKind {
+  CUSTOM,
+  BYTEWISE,
+  BIG_ENDIAN_UINT32,
+  BIG_ENDIAN_UINT64,
+};
+
+namespace key_traits {
+
+// 按照无符号字节序比较，与std::string_view的比较结果一致
+struct Bytewise {
+  int Compare(const std::string_view& v1, const std::string_view& v2) const noexcept {
+    size_t n = v1.size() < v2.size() ? v1.size() : v2.size();
+    int result = n == 0 ? 0 : memcmp(v1.data(), v2.data(), n);
+    if (result != 0) {
+      return result;
+    }
+    return (v1.size() > v2.size()) - (v1.size() < v2.size());
+  }
+
+  // 前8个字节按大端拼接为整数（不足8字节补0）
+  uint64_t AbbreviateKey(const std::string_view& v) const noexcept {
+    if (v.size() >= sizeof(uint64_t)) {
+      uint64_t result = 0;
+      memcpy(&result, v.data(), sizeof(result));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      result = __builtin_bswap64(result);
+#endif
+      return result;
+    }
+    uint64_t result = 0;
+    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+      result <<= 8;
+      if (i < v.size()) {
+        result |= static_cast<uint8_t>(v[i]);
+      }
+    }
+    return result;
+  }
+};
+
+// key为大端存储的无符号整数，长度固定为sizeof(T)，顺序与Bytewise一致，比较时作为整数无分支比较
+template <typename T>
+struct BigEndianInteger {
+  static_assert(std::is_same_v<T, uint32_t> || std::is_same_v<T, uint64_t>);
+
+  static T Load(const std::string_view& v) noexcept {
+    T result = 0;
+    memcpy(&result, v.data(), sizeof(result));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if constexpr (sizeof(T) == sizeof(uint64_t)) {
+      result = __builtin_bswap64(result);
+    } else {
+      result = __builtin_bswap32(result);
+    }
+#endif
+    return result;
+  }
+
+  int Compare(const std::string_view& v1, const std::string_view& v2) const noexcept {
+    T n1 = Load(v1);
+    T n2 = Load(v2);
+    return (n1 > n2) - (n1 < n2);
+  }
+
+  uint64_t AbbreviateKey(const std::string_view& v) const noexcept {
+    return static_cast<uint64_t>(Load(v)) << (64 - 8 * sizeof(T));
+  }
+};
+
+}  // namespace key_traits
+
 /*
  * 支持自定义比较函数，便于用户实现变长key的比较逻辑
  */
@@ -13,14 +93,58 @@ class Comparator {
   virtual std::string ComparatorName() const { return "default_comparator"; }
 
   virtual int Compare(const std::string_view& v1, const std::string_view& v2) const {
-    if (v1 > v2) {
-      return 1;
-    } else if (v1 == v2) {
-      return 0;
-    } else {
-      return -1;
-    }
+    return key_traits::Bytewise().Compare(v1, v2);
+  }
+
+  /**
+   * @brief 返回key的8字节规范化前缀，block内的二分查找先比较前缀，前缀相等时再调用Compare
+   * 需要保证：AbbreviateKey(v1) < AbbreviateKey(v2)时Compare(v1, v2) < 0
+   * 默认实现将前8个字节按大端拼接为整数（不足8字节补0），与默认的Compare顺序一致
+   */
+  virtual uint64_t AbbreviateKey(const std::string_view& v) const { return key_traits::Bytewise().AbbreviateKey(v); }
+
+  /**
+   * @brief 是否使用AbbreviateKey加速查找
+   * 重写了Compare的子类默认不使用，如果同时重写了与之顺序一致的AbbreviateKey，可以重写本函数返回true
+   */
+  virtual bool SupportAbbreviatedKey() const { return typeid(*this) == typeid(Comparator); }
+
+  /**
+   * @brief BlockManager构造时调用一次，返回值不为CUSTOM时block内的查找不再调用本类的虚函数
+   * 子类默认为CUSTOM
+   */
+  virtual KeyKind GetKeyKind() const {
+    return typeid(*this) == typeid(Comparator) ? KeyKind::BYTEWISE : KeyKind::CUSTOM;
+  }
+};
+
+/*
+ * 大端存储的定长无符号整数key，key_size需要等于sizeof(T)
+ * 大端存储时整数顺序与字节序一致，因此与默认的Comparator顺序相同，区别在于比较时作为整数处理
+ */
+template <typename T>
+class BigEndianIntegerComparator : public Comparator {
+ public:
+  std::string ComparatorName() const override {
+    return sizeof(T) == sizeof(uint64_t) ? "big_endian_uint64_comparator" : "big_endian_uint32_comparator";
+  }
+
+  int Compare(const std::string_view& v1, const std::string_view& v2) const override {
+    return key_traits::BigEndianInteger<T>().Compare(v1, v2);
+  }
+
+  uint64_t AbbreviateKey(const std::string_view& v) const override {
+    return key_traits::BigEndianInteger<T>().AbbreviateKey(v);
+  }
+
+  bool SupportAbbreviatedKey() const override { return true; }
+
+  KeyKind GetKeyKind() const override {
+    return sizeof(T) == sizeof(uint64_t) ? KeyKind::BIG_ENDIAN_UINT64 : KeyKind::BIG_ENDIAN_UINT32;
   }
 };
 
-}  // namespace bptree
\ No newline at end of file
+using BigEndianUInt32Comparator = BigEndianIntegerComparator<uint32_t>;
+using BigEndianUInt64Comparator = BigEndianIntegerComparator<uint64_t>;
+
+}  // namespace bptree
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace bptree {
+namespace search {
+
+/*
+ * 在有序的uint64_t数组（block中的key前缀，见Comparator::AbbreviateKey）上查找lower bound
+ * 先用二分查找将范围缩小到simd_window个元素以内，再统计窗口中小于目标值的元素个数，
+ * 统计部分没有分支，支持AVX2或SSE4.2的cpu上使用向量比较 + movemask实现，具体实现在第一次调用时根据cpu特性选择
+ */
+
+// 二分查找缩小到这个范围以内之后进行线性统计
+constexpr size_t simd_window = 32;
+
+namespace detail {
+
+// 以下函数返回data[0, n)中小于target的元素个数
+inline size_t CountLessScalar(const uint64_t* data, size_t n, uint64_t target) noexcept {
+  size_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    count += data[i] < target ? 1 : 0;
+  }
+  return count;
+}
+
+#if defined(__x86_64__)
+
+// 向量指令只支持有符号比较，两边同时翻转符号位之后有符号比较的结果与无符号比较一致
+constexpr uint64_t sign_bit = uint64_t(1) << 63;
+
+__attribute__((target("sse4.2"))) inline size_t CountLessSse42(const uint64_t* data, size_t n,
+                                                                uint64_t target) noexcept {
+  const __m128i bias = _mm_set1_epi64x(static_cast<int64_t>(sign_bit));
+  const __m128i t = _mm_set1_epi64x(static_cast<int64_t>(target ^ sign_bit));
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), bias);
+    int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(t, v)));
+    count += __builtin_popcount(static_cast<unsigned>(mask));
+  }
+  return count + CountLessScalar(data + i, n - i, target);
+}
+
+__attribute__((target("avx2"))) inline size_t CountLessAvx2(const uint64_t* data, size_t n, uint64_t target) noexcept {
+  const __m256i bias = _mm256_set1_epi64x(static_cast<int64_t>(sign_bit));
+  const __m256i t = _mm256_set1_epi64x(static_cast<int64_t>(target ^ sign_bit));
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v0 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), bias);
+    __m256i v1 = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 4)), bias);
+    int mask0 = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(t, v0)));
+    int mask1 = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(t, v1)));
+    count += __builtin_popcount(static_cast<unsigned>(mask0 | (mask1 << 4)));
+  }
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), bias);
+    int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(t, v)));
+    count += __builtin_popcount(static_cast<unsigned>(mask));
+  }
+  return count + CountLessScalar(data + i, n - i, target);
+}
+
+#endif
+
+}  // namespace detail
+
+using count_less_func = size_t (*)(const uint64_t* data, size_t n, uint64_t target) noexcept;
+
+inline count_less_func SelectCountLess() noexcept {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return detail::CountLessAvx2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return detail::CountLessSse42;
+  }
+#endif
+  return detail::CountLessScalar;
+}
+
+inline const char* SearchImplStr() noexcept {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return "avx2";
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return "sse4.2";
+  }
+#endif
+  return "scalar";
+}
+
+/**
+ * @brief 返回有序数组data[0, n)中第一个大于等于target的元素下标，不存在则返回n
+ * @param count_less 窗口内的统计实现，用于测试和benchmark对比不同实现
+ */
+inline size_t LowerBound(const uint64_t* data, size_t n, uint64_t target, count_less_func count_less) noexcept {
+  size_t base = 0;
+  // 循环保证结果始终在[base, base + n]之间
+  while (n > simd_window) {
+    size_t half = n / 2;
+    if (data[base + half] < target) {
+      base += half;
+    }
+    n -= half;
+  }
+  return base + count_less(data + base, n, target);
+}
+
+inline size_t LowerBound(const uint64_t* data, size_t n, uint64_t target) noexcept {
+  static const count_less_func func = SelectCountLess();
+  return LowerBound(data, n, target, func);
+}
+
+/**
+ * @brief 返回有序数组data[0, n)中第一个大于target的元素下标，不存在则返回n
+ */
+inline size_t UpperBound(const uint64_t* data, size_t n, uint64_t target) noexcept {
+  if (target == UINT64_MAX) {
+    return n;
+  }
+  return LowerBound(data, n, target + 1);
+}
+
+}  // namespace search
+}  // namespace bptree
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <source_location>
 #include <string>
@@ -14,35 +15,36 @@ class Metric {
 
   const std::string& GetMetricName() const { return metric_name_; }
 
-  virtual void Clear() { value_ = 0.0; }
+  virtual void Clear() { value_.store(0.0, std::memory_order_relaxed); }
 
-  const double& GetValue() const { return value_; }
+  double GetValue() const { return value_.load(std::memory_order_relaxed); }
 
   void PrintToLog(const std::source_location location = std::source_location::current()) {
-    BPTREE_LOG_INFO("metric name : {}, value : {}", metric_name_, value_);
+    BPTREE_LOG_INFO("metric name : {}, value : {}", metric_name_, GetValue());
   }
 
   virtual ~Metric() {}
 
  protected:
   std::string metric_name_;
-  double value_;
+  // 多个线程会同时更新同一个指标，因此使用原子变量
+  std::atomic<double> value_;
 };
 
 class Counter : public Metric {
  public:
   Counter(const std::string& name) : Metric(name, 0) {}
 
-  void Add(const double& v = 1.0) noexcept { value_ += v; }
+  void Add(const double& v = 1.0) noexcept { value_.fetch_add(v, std::memory_order_relaxed); }
 };
 
 class Gauge : public Metric {
  public:
   Gauge(const std::string& name) : Metric(name, 0.0) {}
 
-  void Add(const double& v = 1.0) noexcept { value_ += v; }
+  void Add(const double& v = 1.0) noexcept { value_.fetch_add(v, std::memory_order_relaxed); }
 
-  void Sub(const double& v = 1.0) noexcept { value_ -= v; }
+  void Sub(const double& v = 1.0) noexcept { value_.fetch_sub(v, std::memory_order_relaxed); }
 };
 
 }  // namespace bptree
\ No newline at end of file
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace bptree {
+
+/*
+ * 缓存key对应的value，命中时不需要从根节点开始查找，按照占用的字节数淘汰
+ * 将key按照hash值划分到多个分片中，每个分片有独立的锁和lru链表，容量平均分配给各个分片
+ * 与block cache不同，查询时直接拷贝value，不持有元素的引用，因此Erase总是成功
+ * 线程安全
+ */
+class RowCache {
+ public:
+  // 每个元素除了key和value之外的内存占用（链表节点和hash表节点）的估计值，计入容量
+  static constexpr size_t entry_overhead = 96;
+
+  /**
+   * @param capacity 总容量（字节）
+   * @param shard_count 分片数量，会被调整为不超过该值的2的幂
+   */
+  RowCache(size_t capacity, size_t shard_count) : capacity_(capacity), shard_mask_(0) {
+    size_t count = 1;
+    while (count * 2 <= shard_count) {
+      count *= 2;
+    }
+    shard_mask_ = count - 1;
+    for (size_t i = 0; i < count; ++i) {
+      shards_.push_back(std::make_unique<Shard>(capacity / count));
+    }
+  }
+
+  RowCache(const RowCache&) = delete;
+  RowCache& operator=(const RowCache&) = delete;
+
+  // 命中时将value拷贝到调用方提供的value中
+  bool Lookup(std::string_view key, std::string& value) {
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> guard(shard.mut);
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+      return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    value.assign(it->second->value);
+    return true;
+  }
+
+  // key已经存在时覆盖value
+  void Insert(std::string_view key, std::string_view value) {
+    size_t charge = key.size() + value.size() + entry_overhead;
+    Shard& shard = GetShard(key);
+    if (charge > shard.capacity) {
+      return;
+    }
+    std::lock_guard<std::mutex> guard(shard.mut);
+    auto it = shard.map.find(key);
+    if (it != shard.map.end()) {
+      shard.usage = shard.usage - it->second->charge + charge;
+      it->second->value.assign(value);
+      it->second->charge = charge;
+      shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    } else {
+      shard.lru.push_front(Node{std::string(key), std::string(value), charge});
+      // map的key引用链表节点中的key，链表节点的地址在删除之前不会改变
+      shard.map.emplace(std::string_view(shard.lru.front().key), shard.lru.begin());
+      shard.usage += charge;
+    }
+    while (shard.usage > shard.capacity) {
+      Node& victim = shard.lru.back();
+      shard.usage -= victim.charge;
+      shard.map.erase(std::string_view(victim.key));
+      shard.lru.pop_back();
+    }
+  }
+
+  void Erase(std::string_view key) {
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> guard(shard.mut);
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+      return;
+    }
+    auto node = it->second;
+    shard.usage -= node->charge;
+    shard.map.erase(it);
+    shard.lru.erase(node);
+  }
+
+  // 当前所有元素占用的字节数
+  size_t GetUsage() const {
+    size_t result = 0;
+    for (auto& each : shards_) {
+      std::lock_guard<std::mutex> guard(each->mut);
+      result += each->usage;
+    }
+    return result;
+  }
+
+  size_t GetCapacity() const noexcept { return capacity_; }
+
+  size_t GetShardCount() const noexcept { return shards_.size(); }
+
+ private:
+  struct Node {
+    std::string key;
+    std::string value;
+    size_t charge;
+  };
+
+  struct Shard {
+    explicit Shard(size_t cap) : capacity(cap), usage(0) {}
+
+    mutable std::mutex mut;
+    // 头部为最近访问的元素
+    std::list<Node> lru;
+    std::unordered_map<std::string_view, std::list<Node>::iterator> map;
+    size_t capacity;
+    size_t usage;
+  };
+
+  Shard& GetShard(std::string_view key) { return *shards_[std::hash<std::string_view>()(key) & shard_mask_]; }
+
+  size_t capacity_;
+  size_t shard_mask_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}  // namespace bptree
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+#include "bptree/block.h"
+
+namespace bptree {
+
+/*
+ * 保存block的历史版本，用于快照读
+ * 每次写操作被分配一个递增的版本号，快照的版本号为创建快照时最后一个被分配的写版本号，快照可以看到版本号<=自身版本号的所有修改
+ * 当一个block被版本号为v的写操作第一次修改时，如果存在需要修改前数据的快照，则保存修改前的block镜像，镜像的结束版本为v，
+ * 即镜像对版本号 < v 的快照可见
+ * 快照读取某个block时，使用结束版本号大于快照版本号的镜像中最早的那个，如果不存在则使用cache中的block
+ * 线程安全
+ */
+class BlockVersionStore {
+ public:
+  BlockVersionStore() = default;
+
+  void AddSnapshot(uint64_t version) {
+    std::lock_guard<std::mutex> guard(mut_);
+    snapshots_.insert(version);
+  }
+
+  // 释放快照，同时删除不再被任何快照需要的镜像
+  void RemoveSnapshot(uint64_t version) {
+    std::lock_guard<std::mutex> guard(mut_);
+    auto it = snapshots_.find(version);
+    assert(it != snapshots_.end());
+    snapshots_.erase(it);
+    if (snapshots_.empty() == true) {
+      versions_.clear();
+      return;
+    }
+    uint64_t min_version = *snapshots_.begin();
+    for (auto it = versions_.begin(); it != versions_.end();) {
+      auto& images = it->second;
+      images.erase(images.begin(), images.upper_bound(min_version));
+      if (images.empty() == true) {
+        it = versions_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  /**
+   * @brief 判断最后一次修改版本为block_version的block在被修改前是否需要保存镜像
+   * @note 只有存在版本号 >= block_version 的快照时，修改前的数据才可能被快照读取
+   */
+  bool NeedToSave(uint64_t block_version) {
+    std::lock_guard<std::mutex> guard(mut_);
+    return snapshots_.empty() == false && *snapshots_.rbegin() >= block_version;
+  }
+
+  void Save(uint32_t index, uint64_t end_version, std::shared_ptr<const Block>&& image) {
+    std::lock_guard<std::mutex> guard(mut_);
+    // block在一次写操作中可能被淘汰后重新导入，这时只保留第一次保存的镜像
+    versions_[index].emplace(end_version, std::move(image));
+  }
+
+  // 返回版本号为version的快照应该读取的镜像，如果快照应该读取cache中的block，返回nullptr
+  std::shared_ptr<const Block> Find(uint32_t index, uint64_t version) {
+    std::lock_guard<std::mutex> guard(mut_);
+    auto it = versions_.find(index);
+    if (it == versions_.end()) {
+      return nullptr;
+    }
+    auto image = it->second.upper_bound(version);
+    if (image == it->second.end()) {
+      return nullptr;
+    }
+    return image->second;
+  }
+
+  size_t GetImageCount() {
+    std::lock_guard<std::mutex> guard(mut_);
+    size_t count = 0;
+    for (auto& each : versions_) {
+      count += each.second.size();
+    }
+    return count;
+  }
+
+ private:
+  std::mutex mut_;
+  std::multiset<uint64_t> snapshots_;
+  // block index -> (结束版本号 -> 镜像)
+  std::unordered_map<uint32_t, std::map<uint64_t, std::shared_ptr<const Block>>> versions_;
+};
+
+/*
+ * 快照，通过BlockManager::GetSnapshot获取，析构时释放
+ * 快照持有BlockVersionStore的引用，因此不能在BlockManager析构之后释放
+ */
+class Snapshot {
+ public:
+  Snapshot(BlockVersionStore& store, uint64_t version) : store_(store), version_(version) {
+    store_.AddSnapshot(version_);
+  }
+
+  Snapshot(const Snapshot&) = delete;
+  Snapshot& operator=(const Snapshot&) = delete;
+
+  uint64_t GetVersion() const noexcept { return version_; }
+
+  ~Snapshot() { store_.RemoveSnapshot(version_); }
+
+ private:
+  BlockVersionStore& store_;
+  uint64_t version_;
+};
+
+}  // namespace bptree
@@ -9,6 +9,7 @@
 #include <memory>
 #include <numeric>
 #include <string>
+#include <string_view>
 #include <thread>
 
 #include "bptree/exception.h"
@@ -24,6 +25,10 @@ inline bool FileNotExist(const std::string& filename) {
 
 inline void DeleteFile(const std::string& filename) { std::filesystem::remove(std::filesystem::path(filename)); }
 
+inline void RenameFile(const std::string& from, const std::string& to) {
+  std::filesystem::rename(std::filesystem::path(from), std::filesystem::path(to));
+}
+
 inline bool CreateDir(const std::string& dir) { return std::filesystem::create_directory(std::filesystem::path(dir)); }
 
 template <typename T>
@@ -59,6 +64,55 @@ inline std::string StringParser(const std::string& str, size_t& offset) {
   return tmp;
 }
 
+// varint编码，每个字节的低7位存储数据，最高位表示之后是否还有字节，uint64_t最多占用10个字节
+constexpr size_t max_varint_size = 10;
+
+inline size_t VarintSize(uint64_t value) noexcept {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+// dst至少有max_varint_size字节的空间，返回写入的字节数
+inline size_t EncodeVarint(char* dst, uint64_t value) noexcept {
+  size_t size = 0;
+  while (value >= 0x80) {
+    dst[size++] = static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  dst[size++] = static_cast<char>(value);
+  return size;
+}
+
+inline void VarintAppender(std::string& str, uint64_t value) {
+  char buf[max_varint_size];
+  str.append(buf, EncodeVarint(buf, value));
+}
+
+// 数据不完整或者超过10个字节时返回false
+inline bool DecodeVarint(std::string_view str, size_t& offset, uint64_t& value) noexcept {
+  value = 0;
+  for (size_t shift = 0; shift < 64 && offset < str.size(); shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(str[offset++]);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline uint64_t VarintParser(std::string_view str, size_t& offset) {
+  uint64_t value = 0;
+  if (DecodeVarint(str, offset, value) == false) {
+    throw BptreeExecption("invalid varint at offset {}", offset);
+  }
+  return value;
+}
+
 // helper function
 
 // tested
@@ -3,15 +3,25 @@
 #include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
 #include <functional>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include "bptree/checksum.h"
 #include "bptree/exception.h"
 #include "bptree/file.h"
 #include "bptree/log.h"
@@ -25,13 +35,66 @@ enum class MsgType : uint8_t {
   Undo,
 };
 
+/*
+ * 日志的内容，由较短的头部（例如日志类型、block编号和偏移量）和可选的数据部分（例如被修改区域的内容）组成
+ * 写日志时两部分直接拷贝到wal的缓冲区中，调用方不需要将它们拼接成临时的字符串
+ * 只引用调用方的数据，需要在WriteLog返回之前保持有效
+ */
+struct LogPayload {
+  LogPayload(const std::string& str) : head(str) {}
+
+  LogPayload(const char* str) : head(str) {}
+
+  LogPayload(std::string_view h, std::string_view b = std::string_view()) : head(h), body(b) {}
+
+  size_t size() const noexcept { return head.size() + body.size(); }
+
+  std::string_view head;
+  std::string_view body;
+};
+
+/*
+ * 在栈上构造日志头部，不申请内存
+ */
+class LogHead {
+ public:
+  static constexpr size_t capacity = 48;
+
+  LogHead() : size_(0) {}
+
+  LogHead& AppendByte(uint8_t byte) noexcept {
+    assert(size_ < capacity);
+    buf_[size_++] = static_cast<char>(byte);
+    return *this;
+  }
+
+  LogHead& AppendVarint(uint64_t value) noexcept {
+    assert(size_ + util::max_varint_size <= capacity);
+    size_ += util::EncodeVarint(&buf_[size_], value);
+    return *this;
+  }
+
+  std::string_view View() const noexcept { return std::string_view(buf_, size_); }
+
+ private:
+  char buf_[capacity];
+  size_t size_;
+};
+
 /*
  * 该类的作用是为block_manager提供事务日志的支持，通过将多个block的修改写入同一条wal中，
  * 如果在全部将block刷盘之前进程crach或者主机直接down掉，可以通过回放wal日志维护多个修改的一致性。
  * （即要么都修改，要么都不修改）
  * wal的作用：bptree内部使用，当产生split/merge时涉及多个block上的修改，通过wal保证一致性；提供给用户使用，支持单机事务功能
- * 每条日志的格式：length + sequence + type + log + crc32
+ * 文件格式（v2）：magic + 文件中第一条日志的编号，之后是连续的日志，每条日志的格式：
+ * varint(length) + type + varint(sequence) + varint(与上一条日志编号的差值) + varint(redo长度) + redo + undo + crc32c
+ * 其中length为type到undo的长度，crc32c覆盖同样的范围
+ * 旧版本（v1）的文件没有magic，每条日志的格式：length + sequence + type + redo + undo + log_number + crc32c（兼容crc32），
+ * 恢复时两种格式都可以读取，新的日志总是以v2格式写入
  * type标志以下几个类型之一：事务开始日志、事务结束日志、事务放弃日志、数据日志
+ * 所有接口都是线程安全的，多个事务的日志可以交错写入，恢复时按照sequence区分不同的事务
+ * 日志首先追加到用户态缓冲区中，由后台线程批量写入文件（双缓冲，写文件期间其他线程继续向另一个缓冲区追加日志），
+ * 缓冲区超过一半、有线程等待日志持久化或者缓冲区中的日志停留超过write_interval时触发写入，缓冲区满时写日志的线程等待
  */
 class WriteAheadLog {
  public:
@@ -58,18 +121,52 @@ class WriteAheadLog {
     Data,
   };
 
-  WriteAheadLog(const std::string& file_name)
+  // 缓冲区中的日志最多停留的时间，进程异常退出时最多丢失这段时间内写入且没有要求持久化的日志
+  static constexpr std::chrono::milliseconds write_interval{1};
+
+  static constexpr size_t default_buffer_size = 1024 * 1024;
+
+  // v2格式文件开头的magic，v1格式的文件以第一条日志的长度开头，不会与之相同
+  static constexpr uint32_t format_v2_magic = 0x32575042;
+
+  // 单条日志的最大长度，恢复时超过该长度的日志视为损坏
+  static constexpr uint64_t max_log_size = 1UL << 30;
+
+  /**
+   * @param buffer_size 日志缓冲区的大小，单条日志可以超过该值
+   */
+  WriteAheadLog(const std::string& file_name, size_t buffer_size = default_buffer_size)
       : next_wal_sequence_(0),
         next_log_number_(0),
         current_flush_number_(0),
         last_write_number_(0),
-        file_name_(file_name) {}
+        prev_log_number_(0),
+        legacy_format_(false),
+        file_name_(file_name),
+        buffer_size_(buffer_size),
+        written_number_(0),
+        writer_busy_(false),
+        write_waiters_(0),
+        stop_(false),
+        write_failed_(false),
+        file_write_count_(0),
+        sync_in_progress_(false) {}
 
+  // 打开wal文件并启动后台写线程
   void OpenFile() {
+    std::unique_lock<std::mutex> guard(mut_);
+    written_cv_.wait(guard, [this]() { return writer_busy_ == false; });
     if (util::FileNotExist(file_name_)) {
       f_ = FileHandler::CreateFile(file_name_, FileType::NORMAL);
+      WriteFileHeader();
     } else {
       f_ = FileHandler::OpenFile(file_name_, FileType::NORMAL);
+      if (std::filesystem::file_size(file_name_) == 0) {
+        WriteFileHeader();
+      }
+    }
+    if (writer_.joinable() == false) {
+      writer_ = std::thread([this]() { this->WriterLoop(); });
     }
   }
 
@@ -80,19 +177,56 @@ class WriteAheadLog {
   // 日志编号为log_number及其之前的日志确保持久化到磁盘中
   void EnsureLogFlush(uint64_t log_number) {
     // 请求不应该请求比最近写入日志编号还要大的编号
-    assert(last_write_number_ >= log_number);
-    if (current_flush_number_ < log_number) {
-      f_.Flush();
-
-      current_flush_number_ = last_write_number_;
-    }
+    assert(LastWriteNumber() >= log_number);
+    SyncUntil(log_number);
   }
 
-  void Flush() {
-    if (current_flush_number_ < last_write_number_) {
-      current_flush_number_ = last_write_number_;
-      f_.Flush();
+  void Flush() { SyncUntil(LastWriteNumber()); }
+
+  /**
+   * @brief 组提交，确保调用之前写入的所有日志持久化到磁盘
+   * 多个线程同时提交时只有一个线程（leader）执行fdatasync，覆盖所有已经写入的日志，其他线程等待其完成
+   * leader执行同步之前最多等待max_wait，直到等待同步的事务数量达到batch_size，max_wait为0时不等待
+   * 同步期间不持有mut_，其他线程可以继续写入日志，这些日志由下一个leader同步
+   * @return 当前线程作为leader执行同步时返回本次同步覆盖的事务数量，否则返回0
+   */
+  size_t GroupSync(size_t batch_size, std::chrono::microseconds max_wait) {
+    std::unique_lock<std::mutex> sync_guard(sync_mut_);
+    uint64_t target = LastWriteNumber();
+    pending_targets_.push_back(target);
+    if (pending_targets_.size() >= batch_size) {
+      leader_cv_.notify_one();
+    }
+    sync_cv_.wait(sync_guard, [&]() { return sync_in_progress_ == false || Synced(target) == true; });
+    if (Synced(target) == true) {
+      return 0;
+    }
+    sync_in_progress_ = true;
+    if (max_wait.count() > 0 && pending_targets_.size() < batch_size) {
+      leader_cv_.wait_for(sync_guard, max_wait, [&]() { return pending_targets_.size() >= batch_size; });
+    }
+    uint64_t sync_number = LastWriteNumber();
+    sync_guard.unlock();
+    // 同步失败时也需要清除sync_in_progress_，否则之后的同步和ResetLogFile会一直等待
+    std::exception_ptr error;
+    try {
+      SyncWritten(sync_number);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    sync_guard.lock();
+    // 持有sync_mut_时读取target，因此pending_targets_是递增的，本次同步覆盖的是其中的一个前缀
+    size_t batch = 0;
+    while (!error && pending_targets_.empty() == false && pending_targets_.front() <= sync_number) {
+      pending_targets_.pop_front();
+      ++batch;
+    }
+    sync_in_progress_ = false;
+    sync_cv_.notify_all();
+    if (error) {
+      std::rethrow_exception(error);
     }
+    return batch;
   }
 
   void Recover() {
@@ -100,62 +234,66 @@ class WriteAheadLog {
     recover();
   }
 
+  size_t GetBufferSize() const noexcept { return buffer_size_; }
+
+  // 后台线程调用write的次数，用于观察日志缓冲区的合并效果
+  size_t FileWriteCount() {
+    std::lock_guard<std::mutex> guard(mut_);
+    return file_write_count_;
+  }
+
   ~WriteAheadLog() { Close(); }
 
   // 申请一个新的事务编号，并将事务开始标志写入wal文件，之后在事务结束标志被写入前，所有使用该编号写入的
   // 数据日志都被认为是在一个事务内，wal保证这些数据日志要么都被提交，要么都会通过调用log_handler_进行回滚
-  // todo : 这里需要是线程安全的
   void Begin(uint64_t seq) {
+    std::unique_lock<std::mutex> guard(mut_);
     assert(writing_wal_.count(seq) == 0);
     writing_wal_.insert(seq);
     // write
-    WriteBeginLog(seq);
+    WriteBeginLog(guard, seq);
   }
 
   uint64_t RequestSeq() {
-    uint64_t seq = next_log_number_;
+    std::lock_guard<std::mutex> guard(mut_);
+    uint64_t seq = next_wal_sequence_;
     next_wal_sequence_ += 1;
     return seq;
   }
 
-  uint64_t WriteLog(uint64_t sequence, const std::string& redo_log, const std::string& undo_log,
+  uint64_t WriteLog(uint64_t sequence, const LogPayload& redo_log, const LogPayload& undo_log,
                     LogType etype = LogType::Data) {
-    if (sequence == no_wal_sequence) {
-      return no_wal_sequence;
-    }
-    uint8_t type = logTypeToUint8(etype);
-    uint64_t log_number = GetNextLogNum();
-    uint32_t length = sizeof(sequence) + sizeof(type) + redo_log.size() + undo_log.size() + 2 * sizeof(uint32_t) +
-                      sizeof(log_number) + sizeof(uint32_t);
-    std::string result;
-    util::StringAppender(result, length);
-    util::StringAppender(result, sequence);
-    util::StringAppender(result, type);
-    util::StringAppender(result, redo_log);
-    util::StringAppender(result, undo_log);
-    util::StringAppender(result, log_number);
-    uint32_t crc = crc32(&result[sizeof(length)], result.size() - sizeof(length));
-    util::StringAppender(result, crc);
-    f_.Write(result.data(), result.size());
-    last_write_number_ = log_number;
-    return log_number;
+    std::unique_lock<std::mutex> guard(mut_);
+    return writeLog(guard, sequence, redo_log, undo_log, etype);
   }
 
   void End(uint64_t sequence) {
     if (sequence == no_wal_sequence) {
       return;
     }
+    std::unique_lock<std::mutex> guard(mut_);
     assert(writing_wal_.count(sequence) == 1);
     writing_wal_.erase(sequence);
-    WriteEndLog(sequence);
+    WriteEndLog(guard, sequence);
   }
 
   // 调用方首先保证所有写入wal的日志对应的操作都已经写入磁盘，然后调用本函数
   // 本函数会清空之前写入的所有wal日志，每次调用本函数可视为提交了一条check point日志
   // 作用：防止wal日志无限增加，占用过多存储空间，并且恢复时间也很长
   void ResetLogFile() {
+    // 等待正在进行的组提交完成，同步过程中不持有mut_，不能在此期间替换f_
+    std::unique_lock<std::mutex> sync_guard(sync_mut_);
+    sync_cv_.wait(sync_guard, [this]() { return sync_in_progress_ == false; });
+    std::unique_lock<std::mutex> guard(mut_);
+    // 后台线程写文件期间不持有mut_，同样不能在此期间替换f_
+    written_cv_.wait(guard, [this]() { return writer_busy_ == false; });
+    // 缓冲区中还没有写入文件的日志和文件中的日志一样被丢弃
+    write_buf_.clear();
+    written_number_ = last_write_number_;
+    written_cv_.notify_all();
     util::DeleteFile(file_name_);
     f_ = FileHandler::CreateFile(file_name_, FileType::NORMAL);
+    WriteFileHeader();
   }
 
  private:
@@ -167,6 +305,10 @@ class WriteAheadLog {
   uint64_t current_flush_number_;
   // 最后写入（可能在缓存中）的日志编号
   uint64_t last_write_number_;
+  // 文件中最后一条日志的编号，下一条日志记录与它的差值
+  uint64_t prev_log_number_;
+  // 打开的文件是v1格式，需要重置文件之后才能写入新的日志
+  bool legacy_format_;
   std::string file_name_;
   std::unordered_set<uint64_t> writing_wal_;
   // 使用者注册本回调函数，当恢复过程中首先对checkpoint点后的日志按照写入顺序执行redo操作，然后将所有未提交的事务日志按照
@@ -177,6 +319,198 @@ class WriteAheadLog {
   // 举例，日志中可以记录每个block改动前后[offset, size]处的二进制值，回放过程中直接用新值/旧值覆盖掉现在的数据即可。
   std::function<void(uint64_t, MsgType type, const std::string&)> log_handler_;
   FileHandler f_;
+  // 等待写入文件的日志
+  std::string write_buf_;
+  // 后台线程正在写入文件的日志，只被后台线程访问
+  std::string writing_buf_;
+  size_t buffer_size_;
+  // 最后写入文件（可能在page cache中）的日志编号
+  uint64_t written_number_;
+  // 后台线程是否正在写文件（此时不持有mut_）
+  bool writer_busy_;
+  // 等待日志写入文件的线程数量，大于0时后台线程立即写入
+  size_t write_waiters_;
+  bool stop_;
+  bool write_failed_;
+  // 后台线程调用write的次数
+  size_t file_write_count_;
+  std::thread writer_;
+  // 通知后台线程有日志需要写入
+  std::condition_variable writer_cv_;
+  // 通知等待日志写入文件以及等待缓冲区空间的线程
+  std::condition_variable written_cv_;
+  // 保护以上所有成员，log_handler_只在恢复阶段被调用，不需要加锁
+  std::mutex mut_;
+  // 保护以下组提交使用的成员，需要同时持有时先获取sync_mut_再获取mut_
+  std::mutex sync_mut_;
+  // 等待leader完成同步的线程，以及等待同步完成才能重置wal文件的线程
+  std::condition_variable sync_cv_;
+  // 等待同步的事务数量达到batch_size的leader
+  std::condition_variable leader_cv_;
+  bool sync_in_progress_;
+  // 等待同步的提交需要持久化的最后一条日志编号，按照注册的顺序排列
+  std::deque<uint64_t> pending_targets_;
+
+  uint64_t LastWriteNumber() {
+    std::lock_guard<std::mutex> guard(mut_);
+    return last_write_number_;
+  }
+
+  bool Synced(uint64_t log_number) {
+    std::lock_guard<std::mutex> guard(mut_);
+    return current_flush_number_ >= log_number;
+  }
+
+  // 设置sync_in_progress_之后调用，等待sync_number及其之前的日志写入文件后同步，同步期间不持有mut_和sync_mut_
+  void SyncWritten(uint64_t sync_number) {
+    {
+      std::unique_lock<std::mutex> guard(mut_);
+      WaitWritten(guard, sync_number);
+    }
+    f_.DataSync();
+    std::lock_guard<std::mutex> guard(mut_);
+    current_flush_number_ = std::max(current_flush_number_, sync_number);
+  }
+
+  /**
+   * @brief 确保log_number及其之前的日志持久化，用于淘汰脏block和check point，不参与组提交的批量等待
+   * 和GroupSync的leader一样通过sync_in_progress_串行化同步，同步期间不持有mut_，不会阻塞写日志和后台写线程
+   */
+  void SyncUntil(uint64_t log_number) {
+    std::unique_lock<std::mutex> sync_guard(sync_mut_);
+    sync_cv_.wait(sync_guard, [&]() { return sync_in_progress_ == false || Synced(log_number) == true; });
+    if (Synced(log_number) == true) {
+      return;
+    }
+    sync_in_progress_ = true;
+    // 同步所有已经写入的日志，之后的同步请求可能因此不需要再次同步
+    uint64_t sync_number = LastWriteNumber();
+    sync_guard.unlock();
+    std::exception_ptr error;
+    try {
+      SyncWritten(sync_number);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    sync_guard.lock();
+    sync_in_progress_ = false;
+    sync_cv_.notify_all();
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  // 调用方需要持有mut_，日志直接追加到缓冲区中，缓冲区满时等待后台线程写入
+  uint64_t writeLog(std::unique_lock<std::mutex>& guard, uint64_t sequence, const LogPayload& redo_log,
+                    const LogPayload& undo_log, LogType etype = LogType::Data) {
+    if (sequence == no_wal_sequence) {
+      return no_wal_sequence;
+    }
+    if (write_buf_.size() >= buffer_size_) {
+      writer_cv_.notify_one();
+      written_cv_.wait(guard, [this]() { return write_buf_.size() < buffer_size_ || write_failed_ == true; });
+    }
+    CheckWriteError();
+    assert(legacy_format_ == false);
+    uint8_t type = logTypeToUint8(etype);
+    uint64_t log_number = GetNextLogNum();
+    uint64_t delta = log_number - prev_log_number_;
+    uint64_t length = sizeof(type) + util::VarintSize(sequence) + util::VarintSize(delta) +
+                      util::VarintSize(redo_log.size()) + redo_log.size() + undo_log.size();
+    bool was_empty = write_buf_.empty();
+    size_t begin = write_buf_.size();
+    util::VarintAppender(write_buf_, length);
+    size_t body = write_buf_.size();
+    write_buf_.push_back(static_cast<char>(type));
+    util::VarintAppender(write_buf_, sequence);
+    util::VarintAppender(write_buf_, delta);
+    util::VarintAppender(write_buf_, redo_log.size());
+    write_buf_.append(redo_log.head).append(redo_log.body);
+    write_buf_.append(undo_log.head).append(undo_log.body);
+    assert(write_buf_.size() - body == length);
+    uint32_t crc = checksum::Crc32c(&write_buf_[body], length);
+    util::StringAppender(write_buf_, crc);
+    prev_log_number_ = log_number;
+    last_write_number_ = log_number;
+    // 后台线程只在缓冲区从空变为非空以及超过一半时需要被唤醒
+    if (was_empty == true || (begin < buffer_size_ / 2 && write_buf_.size() >= buffer_size_ / 2)) {
+      writer_cv_.notify_one();
+    }
+    return log_number;
+  }
+
+  // 调用方需要持有mut_，在新建的文件开头写入v2格式的magic和之后第一条日志的编号
+  void WriteFileHeader() {
+    util::StringAppender(write_buf_, format_v2_magic);
+    util::StringAppender(write_buf_, next_log_number_);
+    prev_log_number_ = next_log_number_;
+    legacy_format_ = false;
+    writer_cv_.notify_one();
+  }
+
+  // 调用方需要持有mut_，等待日志编号为log_number及其之前的日志写入文件
+  void WaitWritten(std::unique_lock<std::mutex>& guard, uint64_t log_number) {
+    if (written_number_ < log_number) {
+      write_waiters_ += 1;
+      writer_cv_.notify_one();
+      written_cv_.wait(guard, [&]() { return written_number_ >= log_number || write_failed_ == true; });
+      write_waiters_ -= 1;
+    }
+    CheckWriteError();
+  }
+
+  void CheckWriteError() {
+    if (write_failed_ == true) {
+      throw BptreeExecption("file {}. background wal write error", file_name_);
+    }
+  }
+
+  void WriterLoop() {
+    std::unique_lock<std::mutex> guard(mut_);
+    while (true) {
+      writer_cv_.wait(guard, [this]() { return stop_ == true || write_buf_.empty() == false; });
+      // 积攒一批日志再写入，有线程等待或者缓冲区超过一半时立即写入
+      writer_cv_.wait_for(guard, write_interval, [this]() {
+        return stop_ == true || write_waiters_ > 0 || write_buf_.size() >= buffer_size_ / 2;
+      });
+      if (write_buf_.empty() == true) {
+        if (stop_ == true) {
+          break;
+        }
+        continue;
+      }
+      writing_buf_.swap(write_buf_);
+      uint64_t log_number = last_write_number_;
+      writer_busy_ = true;
+      guard.unlock();
+      bool succ = f_.WriteWithoutException(writing_buf_.data(), writing_buf_.size());
+      if (succ == false) {
+        BPTREE_LOG_ERROR("write wal file {} error : {}", file_name_, strerror(errno));
+      }
+      writing_buf_.clear();
+      guard.lock();
+      writer_busy_ = false;
+      if (succ == true) {
+        written_number_ = log_number;
+        file_write_count_ += 1;
+      } else {
+        write_failed_ = true;
+      }
+      written_cv_.notify_all();
+    }
+  }
+
+  // 缓冲区中的日志全部写入文件之后退出后台线程
+  void StopWriter() {
+    {
+      std::lock_guard<std::mutex> guard(mut_);
+      stop_ = true;
+    }
+    writer_cv_.notify_one();
+    if (writer_.joinable() == true) {
+      writer_.join();
+    }
+  }
 
   uint64_t GetNextLogNum() {
     uint64_t result = next_log_number_;
@@ -194,13 +528,33 @@ class WriteAheadLog {
     if (!log_handler_) {
       throw BptreeExecption("invalid log handler");
     }
-    bool seq_end = true;
-    uint64_t current_seq = 0;
-    std::vector<LogEntry> current_wal;
-    while (true) {
+    LogReader reader(f_, std::filesystem::file_size(file_name_));
+    bool compact_format = false;
+    // v1格式的文件开头是第一条日志的长度
+    std::optional<uint32_t> first_length;
+    uint32_t magic = 0;
+    if (reader.Read((char*)&magic, sizeof(magic)) == true) {
+      if (magic == format_v2_magic) {
+        uint64_t first_log_number = 0;
+        if (reader.Read((char*)&first_log_number, sizeof(first_log_number)) == true) {
+          compact_format = true;
+          prev_log_number_ = first_log_number;
+          next_log_number_ = std::max(next_log_number_, first_log_number);
+        }
+      } else {
+        BPTREE_LOG_INFO("wal file {} is in the legacy format", file_name_);
+        first_length = magic;
+        legacy_format_ = true;
+      }
+    }
+    // 多个事务的日志可能交错写入，这里记录每个还没有结束的事务的数据日志
+    std::unordered_map<uint64_t, std::vector<LogEntry>> uncommitted_wal;
+    // 两个条件都不满足时文件为空
+    while (compact_format == true || legacy_format_ == true) {
       bool read_error = false;
       bool crc_error = false;
-      LogEntry entry = ReadNextLogFromFile(read_error, crc_error);
+      LogEntry entry = compact_format == true ? ReadNextCompactLog(reader, read_error, crc_error)
+                                              : ReadNextLogFromFile(reader, first_length, read_error, crc_error);
       if (read_error == true || crc_error == true) {
         break;
       }
@@ -215,29 +569,32 @@ class WriteAheadLog {
         next_log_number_ = entry.log_number + 1;
       }
       if (entry.type == logTypeToUint8(LogType::TxBegin)) {
-        assert(seq_end == true);
-        current_seq = entry.sequence;
-        seq_end = false;
+        assert(uncommitted_wal.count(entry.sequence) == 0);
+        uncommitted_wal[entry.sequence];
       } else if (entry.type == logTypeToUint8(LogType::TxEnd)) {
-        assert(seq_end == false);
-        current_seq = 0;
-        current_wal.clear();
-        seq_end = true;
+        assert(uncommitted_wal.count(entry.sequence) == 1);
+        uncommitted_wal.erase(entry.sequence);
       } else if (entry.type == logTypeToUint8(LogType::Data)) {
-        assert(seq_end == false);
+        assert(uncommitted_wal.count(entry.sequence) == 1);
         // redo
-        current_wal.push_back(entry);
         log_handler_(entry.sequence, MsgType::Redo, entry.redo_log);
+        uncommitted_wal[entry.sequence].push_back(std::move(entry));
       } else {
         // 错误的日志
         BPTREE_LOG_ERROR("wal recover read a wrong type log");
         break;
       }
     }
+    std::vector<LogEntry> current_wal;
+    for (auto& each : uncommitted_wal) {
+      for (auto& entry : each.second) {
+        current_wal.push_back(std::move(entry));
+      }
+    }
     if (current_wal.empty() == false) {
       BPTREE_LOG_DEBUG("remain {} logs to undo", current_wal.size());
     }
-    // 此时没有完成的wal操作逆序排序，并执行undo
+    // 此时所有没有完成的wal操作按照日志编号逆序排序，并执行undo
     std::sort(current_wal.begin(), current_wal.end(),
               [](const LogEntry& e1, const LogEntry& e2) -> bool { return e1.log_number > e2.log_number; });
     for (auto& each : current_wal) {
@@ -248,25 +605,128 @@ class WriteAheadLog {
                     next_log_number_);
   }
 
-  LogEntry ReadNextLogFromFile(bool& error, bool& crc_error) {
+  /*
+   * 恢复时顺序读取wal文件，每次从文件中读取一大块数据，避免每条日志都调用read
+   */
+  class LogReader {
+   public:
+    static constexpr size_t chunk_size = 1024 * 1024;
+
+    LogReader(FileHandler& f, size_t file_size) : f_(f), remaining_(file_size), offset_(0) {}
+
+    bool Read(char* dst, size_t nbyte) {
+      while (buf_.size() - offset_ < nbyte) {
+        if (Fill() == false) {
+          return false;
+        }
+      }
+      memcpy(dst, &buf_[offset_], nbyte);
+      offset_ += nbyte;
+      return true;
+    }
+
+    bool ReadVarint(uint64_t& value) {
+      while (buf_.size() - offset_ < util::max_varint_size && Fill() == true) {
+      }
+      return util::DecodeVarint(std::string_view(buf_), offset_, value);
+    }
+
+   private:
+    bool Fill() {
+      if (remaining_ == 0) {
+        return false;
+      }
+      buf_.erase(0, offset_);
+      offset_ = 0;
+      size_t old_size = buf_.size();
+      size_t nbyte = std::min(remaining_, chunk_size);
+      buf_.resize(old_size + nbyte);
+      bool eof = false;
+      if (f_.ReadWithoutException(&buf_[old_size], nbyte, eof) == false) {
+        buf_.resize(old_size);
+        remaining_ = 0;
+        return false;
+      }
+      remaining_ -= nbyte;
+      return true;
+    }
+
+    FileHandler& f_;
+    size_t remaining_;
+    std::string buf_;
+    size_t offset_;
+  };
+
+  LogEntry ReadNextCompactLog(LogReader& reader, bool& error, bool& crc_error) {
+    uint64_t length = 0;
+    if (reader.ReadVarint(length) == false || length == 0 || length > max_log_size) {
+      error = true;
+      return LogEntry();
+    }
+    std::string buf;
+    buf.resize(length + sizeof(uint32_t));
+    if (reader.Read(buf.data(), buf.size()) == false) {
+      error = true;
+      return LogEntry();
+    }
+    LogEntry entry;
+    uint32_t crc = checksum::Crc32c(buf.data(), length);
+    uint32_t old_crc = 0;
+    memcpy(&old_crc, &buf[length], sizeof(uint32_t));
+    if (crc != old_crc) {
+      crc_error = true;
+      BPTREE_LOG_ERROR("crc check error, {} != {}", crc, old_crc);
+      return entry;
+    }
+    entry.crc = crc;
+    std::string_view body(buf.data(), length);
+    size_t offset = 0;
+    uint64_t delta = 0;
+    uint64_t redo_size = 0;
+    entry.type = static_cast<uint8_t>(body[offset++]);
+    if (util::DecodeVarint(body, offset, entry.sequence) == false || util::DecodeVarint(body, offset, delta) == false ||
+        util::DecodeVarint(body, offset, redo_size) == false || redo_size > length - offset) {
+      error = true;
+      BPTREE_LOG_ERROR("invalid wal log, length = {}", length);
+      return LogEntry();
+    }
+    entry.redo_log.assign(body.substr(offset, redo_size));
+    entry.undo_log.assign(body.substr(offset + redo_size));
+    entry.log_number = prev_log_number_ + delta;
+    prev_log_number_ = entry.log_number;
+    return entry;
+  }
+
+  // 读取v1格式的日志，first_length为文件开头已经读取的第一条日志的长度
+  LogEntry ReadNextLogFromFile(LogReader& reader, std::optional<uint32_t>& first_length, bool& error,
+                               bool& crc_error) {
     uint32_t length = 0;
-    bool eof = false;
-    bool succ = f_.ReadWithoutException((char*)&length, sizeof(length), eof);
-    if (succ == false) {
+    if (first_length.has_value() == true) {
+      length = first_length.value();
+      first_length.reset();
+    } else if (reader.Read((char*)&length, sizeof(length)) == false) {
+      error = true;
+      return LogEntry();
+    }
+    if (length < sizeof(uint32_t) || length > max_log_size) {
       error = true;
       return LogEntry();
     }
     std::string buf;
     buf.resize(length);
-    succ = f_.ReadWithoutException(buf.data(), length, eof);
+    bool succ = reader.Read(buf.data(), length);
     if (succ == false) {
       error = true;
       return LogEntry{};
     }
     LogEntry entry;
-    uint32_t crc = crc32(buf.data(), buf.size() - sizeof(uint32_t));
+    uint32_t crc = checksum::Crc32c(buf.data(), buf.size() - sizeof(uint32_t));
     uint32_t old_crc = 0;
     memcpy(&old_crc, &buf[buf.size() - sizeof(uint32_t)], sizeof(uint32_t));
+    // 兼容旧版本使用crc32生成校验码的日志
+    if (crc != old_crc && crc32(buf.data(), buf.size() - sizeof(uint32_t)) == old_crc) {
+      crc = old_crc;
+    }
     if (crc != old_crc) {
       crc_error = true;
       BPTREE_LOG_ERROR("crc check error, {} != {}", crc, old_crc);
@@ -283,10 +743,17 @@ class WriteAheadLog {
     return entry;
   }
 
-  void WriteBeginLog(uint64_t sequence) { WriteLog(sequence, "tx begin", "", LogType::TxBegin); }
+  void WriteBeginLog(std::unique_lock<std::mutex>& guard, uint64_t sequence) {
+    writeLog(guard, sequence, "tx begin", "", LogType::TxBegin);
+  }
 
-  void WriteEndLog(uint64_t sequence) { WriteLog(sequence, "tx end", "", LogType::TxEnd); }
+  void WriteEndLog(std::unique_lock<std::mutex>& guard, uint64_t sequence) {
+    writeLog(guard, sequence, "tx end", "", LogType::TxEnd);
+  }
 
-  void Close() { f_.Close(); }
+  void Close() {
+    StopWriter();
+    f_.Close();
+  }
 };
 }  // namespace bptree
\ No newline at end of file
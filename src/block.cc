@@ -7,6 +7,8 @@
 #include <string_view>
 
 #include "bptree/block_manager.h"
+#include "bptree/buffer_pool.h"
+#include "bptree/key_search.h"
 #include "bptree/log.h"
 
 // todo
@@ -14,6 +16,64 @@
 
 namespace bptree {
 
+namespace {
+
+// 自定义的Comparator，通过虚函数调用，不支持前缀比较时所有前缀都为0，查找时总是回退到Compare
+struct CustomKeyCompare {
+  const Comparator& cmp;
+
+  int Compare(const std::string_view& v1, const std::string_view& v2) const { return cmp.Compare(v1, v2); }
+
+  uint64_t AbbreviateKey(const std::string_view& v) const {
+    return cmp.SupportAbbreviatedKey() == true ? cmp.AbbreviateKey(v) : 0;
+  }
+};
+
+// cache置换时回收的Block对象，所有BlockManager共享，不会被析构，避免静态对象析构顺序导致的问题
+ObjectFreeList& BlockObjectFreeList() {
+  static ObjectFreeList* list = new ObjectFreeList(sizeof(Block), 4096);
+  return *list;
+}
+
+}  // namespace
+
+template <typename Func>
+decltype(auto) Block::DispatchKeyCompare(Func&& func) const {
+  switch (manager_.GetKeyKind()) {
+    case KeyKind::BYTEWISE:
+      return func(key_traits::Bytewise());
+    case KeyKind::BIG_ENDIAN_UINT32:
+      return func(key_traits::BigEndianInteger<uint32_t>());
+    case KeyKind::BIG_ENDIAN_UINT64:
+      return func(key_traits::BigEndianInteger<uint64_t>());
+    default:
+      return func(CustomKeyCompare{manager_.GetComparator()});
+  }
+}
+
+BlockBase::BlockBase(BlockManager& manager, uint32_t index, uint32_t height)
+    : manager_(manager),
+      buf_(nullptr),
+      own_buf_(true),
+      dirty_(true),
+      need_to_parse_(false),
+      crc_(0),
+      index_(index),
+      height_(height),
+      change_log_number_(0) {
+  buf_ = manager_.buffer_pool_.Allocate();
+}
+
+BlockBase::~BlockBase() {
+  if (dirty_ == true) {
+    std::cerr << "warn : block " << index_ << " destruct in dirty state, maybe throw exception or some inner error!"
+              << std::endl;
+  }
+  if (own_buf_ == true) {
+    manager_.buffer_pool_.Release(buf_);
+  }
+}
+
 bool BlockBase::Flush(bool update_dirty_block_count) noexcept {
   if (dirty_ == false) {
     return false;
@@ -24,7 +84,7 @@ bool BlockBase::Flush(bool update_dirty_block_count) noexcept {
   offset = util::AppendToBuf(buf_, height_, offset);
   FlushToBuf(offset);
   // calculate crc and update.
-  crc_ = crc32((const char*)&buf_[sizeof(crc_)], block_size - sizeof(crc_));
+  crc_ = checksum::Crc32c((const char*)&buf_[sizeof(crc_)], block_size - sizeof(crc_));
   util::AppendToBuf(buf_, crc_, 0);
   dirty_ = false;
   if (update_dirty_block_count == true) {
@@ -35,6 +95,7 @@ bool BlockBase::Flush(bool update_dirty_block_count) noexcept {
 }
 
 void BlockBase::SetDirty(bool update_dirty_block_count) {
+  BeforeModify();
   if (dirty_ == true) {
     return;
   }
@@ -44,6 +105,10 @@ void BlockBase::SetDirty(bool update_dirty_block_count) {
   dirty_ = true;
 }
 
+void* Block::operator new(size_t size) { return BlockObjectFreeList().Allocate(size); }
+
+void Block::operator delete(void* ptr) noexcept { BlockObjectFreeList().Release(ptr); }
+
 Block::Block(BlockManager& manager, uint32_t index, uint32_t height, uint32_t key_size, uint32_t value_size)
     : BlockBase(manager, index, height),
       next_free_index_(not_free_flag),
@@ -51,8 +116,10 @@ Block::Block(BlockManager& manager, uint32_t index, uint32_t height, uint32_t ke
       next_(0),
       key_size_(key_size),
       value_size_(value_size),
-      free_list_(1),
-      head_entry_(0) {
+      page_format_(slotted_page_format),
+      kv_count_(0),
+      // 新建的block对已经存在的快照不可见，因此本次写操作对它的修改不需要保存镜像
+      version_(manager.CurrentWriteVersion()) {
   // 如果是非叶子节点，value存储的应该是叶子节点的编号，因此修改value size
   if (GetHeight() != 0) {
     value_size_ = sizeof(uint32_t);
@@ -61,48 +128,43 @@ Block::Block(BlockManager& manager, uint32_t index, uint32_t height, uint32_t ke
   if (GetMaxEntrySize() < 1) {
     throw BptreeExecption("key and value occupy too much space");
   }
-  InitEmptyEntrys(no_wal_sequence);
 }
 
 void Block::SetNextFreeIndex(uint32_t nfi, uint64_t sequence) noexcept {
   BPTREE_LOG_DEBUG("block {} set next free index from {} to {}", GetIndex(), next_free_index_, nfi);
   if (sequence != no_wal_sequence) {
-    std::string redo_log = CreateMetaChangeWalLog("next_free_index", nfi);
-    std::string undo_log = CreateMetaChangeWalLog("next_free_index", next_free_index_);
-    manager_.wal_.WriteLog(sequence, redo_log, undo_log);
+    LogHead redo_log = CreateMetaChangeWalLog(detail::MetaField::NEXT_FREE_INDEX, nfi);
+    LogHead undo_log = CreateMetaChangeWalLog(detail::MetaField::NEXT_FREE_INDEX, next_free_index_);
+    manager_.wal_.WriteLog(sequence, redo_log.View(), undo_log.View());
   }
   SetDirty();
   next_free_index_ = nfi;
 }
 
+void Block::BeforeModify() { manager_.BeforeBlockModify(*this); }
+
 std::pair<uint32_t, uint32_t> Block::GetBlockIndexContainKey(const std::string& key) {
   assert(GetHeight() != super_height);
   if (GetHeight() > 0) {
-    for (size_t i = 0; i < kv_view_.size(); ++i) {
-      if (manager_.GetComparator().Compare(kv_view_[i].key_view, std::string_view(key)) >= 0) {
-        uint32_t child_index = GetChildIndex(i);
-        return manager_.GetBlock(child_index).Get().GetBlockIndexContainKey(key);
-      }
+    size_t i = SearchTheFirstGEKey(key);
+    if (i == kv_count_) {
+      return {0, 0};
     }
-    return {0, 0};
+    return manager_.GetBlock(GetChildIndex(i)).Get().GetBlockIndexContainKey(key);
   } else {
-    for (size_t i = 0; i < kv_view_.size(); ++i) {
-      if (manager_.GetComparator().Compare(kv_view_[i].key_view, std::string_view(key)) == 0) {
-        return {GetIndex(), i};
-      }
+    size_t i = SearchKey(key);
+    if (i != kv_count_) {
+      return {GetIndex(), i};
     }
   }
   return {0, 0};
 }
 
-// todo 使用二分查找优化
-// 假设key + value占用100字节，一个block大约容纳40个kv对，
-// 这个量级下遍历or二分差别不大。
 std::string Block::Get(const std::string& key) {
   assert(GetHeight() != super_height);
   if (GetHeight() > 0) {
     size_t tmp = SearchTheFirstGEKey(key);
-    if (tmp == GetKVView().size()) {
+    if (tmp == kv_count_) {
       BPTREE_LOG_DEBUG("get {} from inner block {}, not found", key, GetIndex());
       return "";
     } else {
@@ -111,9 +173,8 @@ std::string Block::Get(const std::string& key) {
     }
   } else {
     size_t tmp = SearchKey(key);
-    if (tmp != GetKVView().size()) {
-      uint32_t offset = GetOffsetByEntryIndex(kv_view_[tmp].index);
-      std::string result = std::string(GetEntryValueView(offset));
+    if (tmp != kv_count_) {
+      std::string result = std::string(GetValueView(tmp));
       BPTREE_LOG_DEBUG("get {} from leaf block {}, value == {}", key, GetIndex(), result);
       return result;
     }
@@ -125,7 +186,7 @@ std::string Block::Get(const std::string& key) {
 InsertInfo Block::Insert(const std::string& key, const std::string& value, uint64_t sequence) {
   assert(GetHeight() != super_height);
   if (GetHeight() > 0) {
-    if (kv_view_.empty() == true) {
+    if (kv_count_ == 0) {
       uint32_t child_block_index = manager_.AllocNewBlock(GetHeight() - 1, sequence);
       manager_.GetBlock(child_block_index).Get().Insert(key, value, sequence);
       auto ret = InsertKv(key, util::ConstructIndexByNum(child_block_index), sequence);
@@ -136,16 +197,11 @@ InsertInfo Block::Insert(const std::string& key, const std::string& value, uint6
       return InsertInfo::Ok();
     }
     size_t child_index = SearchTheFirstGEKey(std::string_view(key));
-    if (child_index == kv_view_.size()) {
-      BPTREE_LOG_DEBUG("block {} update max key from {} to {}, seq = {}", GetIndex(), kv_view_.back().key_view, key,
+    if (child_index == kv_count_) {
+      BPTREE_LOG_DEBUG("block {} update max key from {} to {}, seq = {}", GetIndex(), GetMaxKeyAsView(), key,
                        sequence);
-      assert(kv_view_.empty() == false);
-      child_index = kv_view_.size() - 1;
-      auto new_key = UpdateEntryKey(kv_view_.back().index, key, sequence);
-      kv_view_.back().key_view = new_key;
-      BPTREE_LOG_DEBUG("the new key's addr is {}, block addr is {}",
-                       reinterpret_cast<uint64_t>(kv_view_.back().key_view.data()),
-                       reinterpret_cast<uint64_t>(GetBuf()));
+      child_index = kv_count_ - 1;
+      UpdateKeyByIndex(child_index, key, sequence);
     }
     uint32_t child_block_index = GetChildIndex(child_index);
     InsertInfo info = manager_.GetBlock(child_block_index).Get().Insert(key, value, sequence);
@@ -180,20 +236,19 @@ DeleteInfo Block::Delete(const std::string& key, uint64_t sequence) {
   assert(GetHeight() != super_height);
   if (GetHeight() > 0) {
     size_t tmp = SearchTheFirstGEKey(std::string_view(key));
-    if (tmp == kv_view_.size()) {
+    if (tmp == kv_count_) {
       BPTREE_LOG_DEBUG("delete the key {} that is not exist, seq = {}", key, sequence);
       return DeleteInfo::Invalid();
     } else {
       auto block = manager_.GetBlock(GetChildIndex(tmp));
       DeleteInfo info = block.Get().Delete(key, sequence);
-      if (manager_.GetComparator().Compare(kv_view_[tmp].key_view, std::string_view(key)) == 0 &&
-          block.Get().GetKVView().size() != 0) {
+      if (manager_.GetComparator().Compare(GetKeyView(tmp), std::string_view(key)) == 0 &&
+          block.Get().GetKVCount() != 0) {
         // 更新maxkey的记录，如果子节点block的kv为空不需要处理，因为后面会在DoMerge中删除这个节点
         assert(info.state_ != DeleteInfo::State::Invalid);
         BPTREE_LOG_DEBUG("update inner block {}'s key because of delete, key == {}, seq = {}", GetIndex(), key,
                          sequence);
-        auto new_key = UpdateEntryKey(kv_view_[tmp].index, block.Get().GetMaxKey(), sequence);
-        kv_view_[tmp].key_view = new_key;
+        UpdateKeyByIndex(tmp, block.Get().GetMaxKeyAsView(), sequence);
       }
       if (info.state_ == DeleteInfo::State::Ok) {
         BPTREE_LOG_DEBUG("delete key {} from inner block {}, no merge, seq = {}", key, block.Get().GetIndex(),
@@ -212,12 +267,10 @@ DeleteInfo Block::Delete(const std::string& key, uint64_t sequence) {
   } else {
     std::string old_v;
     size_t tmp = SearchKey(std::string_view(key));
-    if (tmp != kv_view_.size()) {
-      old_v = kv_view_[tmp].value_view;
-      RemoveEntry(kv_view_[tmp].index, tmp == 0 ? 0 : kv_view_[tmp - 1].index, sequence);
-      auto it = kv_view_.begin();
-      std::advance(it, tmp);
-      kv_view_.erase(it);
+    if (tmp != kv_count_) {
+      old_v = GetValueView(tmp);
+      RemoveSlot(tmp, sequence);
+      manager_.InvalidateRow(key);
     }
     if (CheckIfNeedToMerge() == true) {
       BPTREE_LOG_DEBUG("delete key {} from leaf block {} results in merge, seq = {}", key, GetIndex(), sequence);
@@ -234,16 +287,17 @@ UpdateInfo Block::Update(const std::string& key, const std::string& value, uint6
   assert(GetHeight() != super_height);
   if (GetHeight() > 0) {
     size_t tmp = SearchTheFirstGEKey(std::string_view(key));
-    if (tmp != kv_view_.size()) {
+    if (tmp != kv_count_) {
       return manager_.GetBlock(GetChildIndex(tmp)).Get().Update(key, value, sequence);
     }
     BPTREE_LOG_DEBUG("update key {} in block {} fail, not exist, seq = {}", key, GetIndex(), sequence);
     return UpdateInfo::Invalid();
   } else {
     size_t tmp = SearchKey(std::string_view(key));
-    if (tmp != kv_view_.size()) {
-      std::string old_v(kv_view_[tmp].value_view);
-      kv_view_[tmp].value_view = UpdateEntryValue(kv_view_[tmp].index, value, sequence);
+    if (tmp != kv_count_) {
+      std::string old_v(GetValueView(tmp));
+      UpdateValueByIndex(tmp, value, sequence);
+      manager_.InvalidateRow(key);
       BPTREE_LOG_DEBUG("update key {} in block {} succ, seq = {}", key, GetIndex(), sequence);
       return UpdateInfo::Ok(old_v);
     }
@@ -252,49 +306,26 @@ UpdateInfo Block::Update(const std::string& key, const std::string& value, uint6
   return UpdateInfo::Invalid();
 }
 
-// todo 优化，std::lower_bound不能使用在这里，需要自己实现
 Block::InsertResult Block::InsertKv(const std::string_view& key, const std::string_view& value,
                                     uint64_t sequence) noexcept {
-  uint32_t prev_index = std::numeric_limits<uint32_t>::max();
-  for (size_t i = 0; i < kv_view_.size(); ++i) {
-    if (manager_.GetComparator().Compare(kv_view_[i].key_view, std::string_view(key)) == 0) {
-      return InsertResult::EXIST;
-    } else if (manager_.GetComparator().Compare(kv_view_[i].key_view, std::string_view(key)) > 0) {
-      break;
-    } else {
-      prev_index = i;
-    }
+  bool equal = false;
+  size_t slot = DispatchKeyCompare([&](const auto& cmp) -> size_t { return SearchTheFirstGEKey(cmp, key, equal); });
+  if (equal == true) {
+    return InsertResult::EXIST;
   }
-  bool full = false;
-  Entry entry;
-  if (prev_index == std::numeric_limits<uint32_t>::max()) {
-    entry = InsertEntry(0, key, value, full, sequence);
-  } else {
-    entry = InsertEntry(kv_view_[prev_index].index, key, value, full, sequence);
-  }
-  if (full == true) {
+  if (IsFull() == true) {
     return InsertResult::FULL;
   }
-  auto it = kv_view_.begin();
-  if (prev_index != std::numeric_limits<uint32_t>::max()) {
-    std::advance(it, prev_index + 1);
-  }
-  kv_view_.insert(it, entry);
+  InsertSlot(slot, key, value, sequence);
   return InsertResult::SUCC;
 }
 
 bool Block::AppendKv(const std::string_view& key, const std::string_view& value, uint64_t sequence) noexcept {
-  uint32_t prev_index = 0;
-  if (kv_view_.empty() == false) {
-    prev_index = kv_view_.back().index;
-    assert(manager_.GetComparator().Compare(kv_view_.back().key_view, key) < 0);
-  }
-  bool full = false;
-  Entry entry = InsertEntry(prev_index, key, value, full, sequence);
-  if (full == true) {
+  assert(kv_count_ == 0 || manager_.GetComparator().Compare(GetMaxKeyAsView(), key) < 0);
+  if (IsFull() == true) {
     return false;
   }
-  kv_view_.push_back(entry);
+  InsertSlot(kv_count_, key, value, sequence);
   return true;
 }
 
@@ -318,96 +349,80 @@ void Block::Print() {
     return;
   }
   BPTREE_LOG_INFO("prev : {}, next : {}", GetPrev(), GetNext());
-  for (size_t i = 0; i < kv_view_.size(); ++i) {
+  for (size_t i = 0; i < kv_count_; ++i) {
     std::string value_str;
     if (GetHeight() == 0) {
-      value_str = kv_view_[i].value_view;
+      value_str = GetValueView(i);
     } else {
-      uint32_t index = 0;
-      memcpy(&index, kv_view_[i].value_view.data(), kv_view_[i].value_view.length());
-      value_str = std::to_string(index);
+      value_str = std::to_string(GetChildIndex(i));
     }
-    BPTREE_LOG_INFO("{} th kv : (next entry index){} (key){} (value){}", i, kv_view_[i].index, kv_view_[i].key_view,
-                    value_str);
+    BPTREE_LOG_INFO("{} th kv : (record){} (key){} (value){}", i, GetSlot(i), GetKeyView(i), value_str);
   }
   BPTREE_LOG_INFO("--------end to print block's info--------");
 }
 
 void Block::SetPrev(uint32_t prev, uint64_t sequence) noexcept {
+  SetDirty();
   BPTREE_LOG_DEBUG("block {} set prev from {} to {}", GetIndex(), prev_, prev);
   if (sequence != no_wal_sequence) {
-    std::string redo_log = CreateMetaChangeWalLog("prev", prev);
-    std::string undo_log = CreateMetaChangeWalLog("prev", prev_);
-    auto log_num = manager_.wal_.WriteLog(sequence, redo_log, undo_log);
+    LogHead redo_log = CreateMetaChangeWalLog(detail::MetaField::PREV, prev);
+    LogHead undo_log = CreateMetaChangeWalLog(detail::MetaField::PREV, prev_);
+    auto log_num = manager_.wal_.WriteLog(sequence, redo_log.View(), undo_log.View());
     UpdateLogNumber(log_num);
   }
   prev_ = prev;
-  SetDirty();
 }
 
 void Block::SetNext(uint32_t next, uint64_t sequence) noexcept {
+  SetDirty();
   BPTREE_LOG_DEBUG("block {} set next from {} to {}", GetIndex(), next_, next);
   if (sequence != no_wal_sequence) {
-    std::string redo_log = CreateMetaChangeWalLog("next", next);
-    std::string undo_log = CreateMetaChangeWalLog("next", next_);
-    auto log_num = manager_.wal_.WriteLog(sequence, redo_log, undo_log);
+    LogHead redo_log = CreateMetaChangeWalLog(detail::MetaField::NEXT, next);
+    LogHead undo_log = CreateMetaChangeWalLog(detail::MetaField::NEXT, next_);
+    auto log_num = manager_.wal_.WriteLog(sequence, redo_log.View(), undo_log.View());
     UpdateLogNumber(log_num);
   }
   next_ = next;
-  SetDirty();
 }
 
 void Block::SetHeight(uint32_t height, uint64_t sequence) noexcept {
+  SetDirty();
   BPTREE_LOG_DEBUG("block {} set height from {} to {}", GetIndex(), getHeight(), height);
   if (sequence != no_wal_sequence) {
-    std::string redo_log = CreateMetaChangeWalLog("height", height);
-    std::string undo_log = CreateMetaChangeWalLog("height", GetHeight());
-    auto log_num = manager_.wal_.WriteLog(sequence, redo_log, undo_log);
+    LogHead redo_log = CreateMetaChangeWalLog(detail::MetaField::HEIGHT, height);
+    LogHead undo_log = CreateMetaChangeWalLog(detail::MetaField::HEIGHT, GetHeight());
+    auto log_num = manager_.wal_.WriteLog(sequence, redo_log.View(), undo_log.View());
     UpdateLogNumber(log_num);
   }
   getHeight() = height;
-  SetDirty();
 }
 
-void Block::SetHeadEntry(uint32_t entry, uint64_t sequence) noexcept {
-  BPTREE_LOG_DEBUG("block {} set head entry from {} to {}", GetIndex(), head_entry_, entry);
-  if (sequence != no_wal_sequence) {
-    std::string redo_log = CreateMetaChangeWalLog("head_entry", entry);
-    std::string undo_log = CreateMetaChangeWalLog("head_entry", head_entry_);
-    auto log_num = manager_.wal_.WriteLog(sequence, redo_log, undo_log);
-    UpdateLogNumber(log_num);
-  }
-  head_entry_ = entry;
+void Block::SetKvCount(uint32_t kv_count, uint64_t sequence) noexcept {
   SetDirty();
-}
-
-void Block::SetFreeList(uint32_t free_list, uint64_t sequence) noexcept {
-  BPTREE_LOG_DEBUG("block {} set free_list from {} to {}", GetIndex(), free_list_, free_list);
+  BPTREE_LOG_DEBUG("block {} set kv_count from {} to {}", GetIndex(), kv_count_, kv_count);
   if (sequence != no_wal_sequence) {
-    std::string redo_log = CreateMetaChangeWalLog("free_list", free_list);
-    std::string undo_log = CreateMetaChangeWalLog("free_list", free_list_);
-    auto log_num = manager_.wal_.WriteLog(sequence, redo_log, undo_log);
+    LogHead redo_log = CreateMetaChangeWalLog(detail::MetaField::KV_COUNT, kv_count);
+    LogHead undo_log = CreateMetaChangeWalLog(detail::MetaField::KV_COUNT, kv_count_);
+    auto log_num = manager_.wal_.WriteLog(sequence, redo_log.View(), undo_log.View());
     UpdateLogNumber(log_num);
   }
-  free_list_ = free_list;
-  SetDirty();
+  kv_count_ = kv_count;
 }
 
-std::string Block::CreateMetaChangeWalLog(const std::string& meta_name, uint32_t value) {
-  std::string result;
-  util::StringAppender(result, detail::LogTypeToUint8T(detail::LogType::BLOCK_META));
-  util::StringAppender(result, GetIndex());
-  util::StringAppender(result, meta_name);
-  util::StringAppender(result, value);
+LogHead Block::CreateMetaChangeWalLog(detail::MetaField field, uint32_t value) {
+  LogHead result;
+  result.AppendByte(detail::LogTypeToUint8T(detail::LogType::COMPACT_BLOCK_META))
+      .AppendVarint(GetIndex())
+      .AppendByte(detail::MetaFieldToUint8T(field))
+      .AppendVarint(value);
   return result;
 }
 
-std::string Block::CreateDataChangeWalLog(uint32_t offset, const std::string& change_region) {
-  std::string result;
-  util::StringAppender(result, detail::LogTypeToUint8T(detail::LogType::BLOCK_DATA));
-  util::StringAppender(result, GetIndex());
-  util::StringAppender(result, offset);
-  util::StringAppender(result, change_region);
+LogHead Block::CreateDataChangeWalLog(uint32_t offset) {
+  LogHead result;
+  result.AppendByte(detail::LogTypeToUint8T(detail::LogType::COMPACT_BLOCK_DATA))
+      .AppendVarint(GetIndex())
+      .AppendVarint(offset);
   return result;
 }
 
@@ -423,67 +438,70 @@ std::string Block::CreateDataView() {
   return block_view;
 }
 
-size_t Block::SearchKey(const std::string_view& key) const {
-  if (kv_view_.empty() == true) {
-    return 0;
-  }
-  ssize_t result = kv_view_.size();
-  ssize_t left = 0;
-  ssize_t right = kv_view_.size() - 1;
-  while (left <= right) {
-    ssize_t mid = (left + right) / 2;
-    int cmp = manager_.GetComparator().Compare(kv_view_[mid].key_view, key);
-    if (cmp == 0) {
-      return mid;
-    } else if (cmp < 0) {
+template <typename KeyCompare>
+size_t Block::SearchTheFirstGEKey(const KeyCompare& cmp, const std::string_view& key, bool& equal) const {
+  assert(abbr_keys_.size() == kv_count_);
+  // 先在前缀数组上确定前缀与key相等的范围[left, right)，前缀小于key的前缀的元素一定小于key，大于的一定大于key
+  uint64_t abbr = cmp.AbbreviateKey(key);
+  size_t left = search::LowerBound(abbr_keys_.data(), kv_count_, abbr);
+  size_t right = left;
+  if (left != kv_count_ && abbr_keys_[left] == abbr) {
+    right = left + search::UpperBound(&abbr_keys_[left], kv_count_ - left, abbr);
+  }
+  size_t end = right;
+  // 在前缀相等的范围内使用完整的key二分查找
+  while (left < right) {
+    size_t mid = left + (right - left) / 2;
+    if (cmp.Compare(GetKeyView(mid), key) < 0) {
       left = mid + 1;
     } else {
-      right = mid - 1;
+      right = mid;
     }
   }
-  return result;
+  equal = left != end && cmp.Compare(GetKeyView(left), key) == 0;
+  return left;
+}
+
+size_t Block::SearchKey(const std::string_view& key) const {
+  return DispatchKeyCompare([&](const auto& cmp) -> size_t {
+    bool equal = false;
+    size_t result = SearchTheFirstGEKey(cmp, key, equal);
+    return equal == true ? result : kv_count_;
+  });
 }
 
 size_t Block::SearchTheFirstGEKey(const std::string_view& key) const {
   BPTREE_LOG_DEBUG("search the first GE key {} from block {}", key, GetIndex());
-  if (kv_view_.empty() == true) {
-    return 0;
-  }
-  ssize_t result = kv_view_.size();
-  ssize_t left = 0;
-  ssize_t right = kv_view_.size() - 1;
-  while (left <= right) {
-    ssize_t mid = (left + right) / 2;
-    int cmp = manager_.GetComparator().Compare(kv_view_[mid].key_view, key);
-    if (cmp >= 0) {
-      right = mid - 1;
-      result = mid;
-    } else {
-      left = mid + 1;
-    }
-  }
-  return result;
+  return DispatchKeyCompare([&](const auto& cmp) -> size_t {
+    bool equal = false;
+    return SearchTheFirstGEKey(cmp, key, equal);
+  });
+}
+
+size_t Block::SearchTheFirstGTKey(const std::string_view& key) const {
+  BPTREE_LOG_DEBUG("search the first GT key {} from block {}", key, GetIndex());
+  return DispatchKeyCompare([&](const auto& cmp) -> size_t {
+    bool equal = false;
+    size_t result = SearchTheFirstGEKey(cmp, key, equal);
+    // block内的key不重复
+    return equal == true ? result + 1 : result;
+  });
 }
 
 void Block::MoveFirstElementTo(Block* other, uint64_t sequence) {
   BPTREE_LOG_DEBUG("block {} move first element to {}", GetIndex(), other->GetIndex());
-  assert(kv_view_.empty() == false);
-  uint32_t move_index = kv_view_[0].index;
-  auto ret = other->InsertKv(kv_view_[0].key_view, kv_view_[0].value_view, sequence);
+  assert(kv_count_ > 0);
+  auto ret = other->InsertKv(GetKeyView(0), GetValueView(0), sequence);
   assert(ret == InsertResult::SUCC);
-  RemoveEntry(move_index, 0, sequence);
-  kv_view_.erase(kv_view_.begin());
+  RemoveSlot(0, sequence);
 }
 
 void Block::MoveLastElementTo(Block* other, uint64_t sequence) {
   BPTREE_LOG_DEBUG("block {} move last element to {}", GetIndex(), other->GetIndex());
-  assert(kv_view_.empty() == false);
-  uint32_t size = kv_view_.size();
-  uint32_t move_index = kv_view_.back().index;
-  auto ret = other->InsertKv(kv_view_.back().key_view, kv_view_.back().value_view, sequence);
+  assert(kv_count_ > 0);
+  auto ret = other->InsertKv(GetKeyView(kv_count_ - 1), GetValueView(kv_count_ - 1), sequence);
   assert(ret == InsertResult::SUCC);
-  RemoveEntry(move_index, size == 1 ? 0 : kv_view_[size - 2].index, sequence);
-  kv_view_.pop_back();
+  RemoveSlot(kv_count_ - 1, sequence);
 }
 
 InsertInfo Block::DoSplit(uint32_t child_index, const std::string& key, const std::string& value, uint64_t sequence) {
@@ -546,10 +564,8 @@ DeleteInfo Block::DoMerge(uint32_t child_index, uint64_t sequence, const std::st
   uint32_t child_block_index = GetChildIndex(child_index);
   auto child = manager_.GetBlock(child_block_index);
   // 特殊情况，只有这个节点并且这个节点已经空了，则直接删除并返回继续merge
-  if (child.Get().GetKVView().size() == 0 && kv_view_.size() == 1) {
-    assert(head_entry_ == kv_view_[0].index);
-    RemoveEntry(kv_view_[0].index, 0, sequence);
-    kv_view_.clear();
+  if (child.Get().GetKVCount() == 0 && kv_count_ == 1) {
+    RemoveSlot(0, sequence);
     child.UnBind();
     manager_.DeallocBlock(child_block_index, sequence);
     return DeleteInfo::Merge(old_v);
@@ -561,7 +577,7 @@ DeleteInfo Block::DoMerge(uint32_t child_index, uint64_t sequence, const std::st
   if (child_index > 0) {
     left_child_index = child_index - 1;
     right_child_index = child_index;
-  } else if (child_index + 1 < kv_view_.size()) {
+  } else if (child_index + 1 < kv_count_) {
     left_child_index = child_index;
     right_child_index = child_index + 1;
   } else {
@@ -602,9 +618,7 @@ DeleteInfo Block::DoMerge(uint32_t child_index, uint64_t sequence, const std::st
     } else {
       left_child.Get().MoveLastElementTo(&right_child.Get(), sequence);
     }
-    // todo 优化，这里也可以使用string_view
-    auto key_view = UpdateEntryKey(kv_view_[left_child_index].index, left_child.Get().GetMaxKey(), sequence);
-    kv_view_[left_child_index].key_view = key_view;
+    UpdateKeyByIndex(left_child_index, left_child.Get().GetMaxKeyAsView(), sequence);
   }
   // 判断经过删除后，本节点是否需要merge，并将判断情况交给父节点处理
   if (CheckIfNeedToMerge()) {
@@ -614,32 +628,36 @@ DeleteInfo Block::DoMerge(uint32_t child_index, uint64_t sequence, const std::st
   }
 }
 
-void Block::HandleMetaUpdateWal(const std::string& meta_name, uint32_t value) {
+void Block::HandleMetaUpdateWal(detail::MetaField field, uint32_t value) {
   SetDirty();
-  if (meta_name == "height") {
-    getHeight() = value;
-  } else if (meta_name == "head_entry") {
-    head_entry_ = value;
-  } else if (meta_name == "free_list") {
-    free_list_ = value;
-  } else if (meta_name == "next_free_index") {
-    next_free_index_ = value;
-  } else if (meta_name == "prev") {
-    prev_ = value;
-  } else if (meta_name == "next") {
-    next_ = value;
-  } else {
-    throw BptreeExecption("invalid block meta name : {}", meta_name);
+  switch (field) {
+    case detail::MetaField::HEIGHT:
+      getHeight() = value;
+      break;
+    case detail::MetaField::KV_COUNT:
+      kv_count_ = value;
+      break;
+    case detail::MetaField::NEXT_FREE_INDEX:
+      next_free_index_ = value;
+      break;
+    case detail::MetaField::PREV:
+      prev_ = value;
+      break;
+    case detail::MetaField::NEXT:
+      next_ = value;
+      break;
+    default:
+      throw BptreeExecption("invalid block meta field : {}", detail::MetaFieldToUint8T(field));
   }
 }
 
-void Block::HandleDataUpdateWal(uint32_t offset, const std::string& region) {
+void Block::HandleDataUpdateWal(uint32_t offset, std::string_view region) {
   SetDirty();
   assert(offset + region.size() <= block_size);
   memcpy(&GetBuf()[offset], region.data(), region.size());
 }
 
-void Block::HandleViewWal(const std::string& view) {
+void Block::HandleViewWal(std::string_view view) {
   SetDirty();
   assert(view.size() == block_size);
   memcpy(&GetBuf()[0], view.data(), view.size());
@@ -647,70 +665,117 @@ void Block::HandleViewWal(const std::string& view) {
   UpdateMeta();
 }
 
-void Block::SetEntryNext(uint32_t index, uint32_t next, uint64_t sequence) noexcept {
-  SetDirty();
-  uint32_t offset = GetOffsetByEntryIndex(index);
-  assert(offset + sizeof(next) <= block_size);
-  if (sequence != no_wal_sequence) {
-    std::string redo_log((const char*)&next, sizeof(next));
-    std::string undo_log((const char*)&buf_[offset], sizeof(next));
-    auto log_num = manager_.wal_.WriteLog(sequence, CreateDataChangeWalLog(offset, redo_log),
-                                          CreateDataChangeWalLog(offset, undo_log));
-    UpdateLogNumber(log_num);
-  }
-  memcpy(&buf_[offset], &next, sizeof(next));
+uint64_t Block::AbbreviateKey(const std::string_view& key) const noexcept {
+  return DispatchKeyCompare([&](const auto& cmp) -> uint64_t { return cmp.AbbreviateKey(key); });
+}
+
+void Block::RebuildAbbreviatedKeys() noexcept {
+  abbr_keys_.resize(kv_count_);
+  DispatchKeyCompare([this](const auto& cmp) -> void {
+    for (size_t i = 0; i < kv_count_; ++i) {
+      abbr_keys_[i] = cmp.AbbreviateKey(GetKeyView(i));
+    }
+  });
 }
 
-std::string_view Block::SetEntryKey(uint32_t offset, const std::string_view& key, uint64_t sequence) noexcept {
+void Block::SetRegion(uint32_t offset, const std::string_view& region, uint64_t sequence) noexcept {
   SetDirty();
-  assert(key.size() == key_size_);
-  uint32_t key_offset = offset + sizeof(uint32_t);
+  assert(offset + region.size() <= block_size);
   if (sequence != no_wal_sequence) {
-    std::string undo_log((const char*)&buf_[key_offset], key_size_);
-    std::string redo_log(key);
-    auto log_num = manager_.wal_.WriteLog(sequence, CreateDataChangeWalLog(key_offset, redo_log),
-                                          CreateDataChangeWalLog(key_offset, undo_log));
+    // 修改数据的同时将修改处的新值和旧值写入sequence标识的wal日志中，新值和旧值直接从region和buf_拷贝到wal的缓冲区
+    LogHead head = CreateDataChangeWalLog(offset);
+    std::string_view undo_region((const char*)&buf_[offset], region.size());
+    auto log_num = manager_.wal_.WriteLog(sequence, LogPayload(head.View(), region), LogPayload(head.View(), undo_region));
     UpdateLogNumber(log_num);
   }
-  memcpy(&buf_[key_offset], key.data(), key_size_);
-  return std::string_view((const char*)&buf_[key_offset], static_cast<size_t>(key_size_));
+  memmove(&buf_[offset], region.data(), region.size());
+}
+
+void Block::InsertSlot(size_t slot, const std::string_view& key, const std::string_view& value,
+                       uint64_t sequence) noexcept {
+  assert(slot <= kv_count_ && IsFull() == false);
+  assert(key.size() == key_size_ && value.size() == value_size_);
+  uint16_t record = static_cast<uint16_t>(kv_count_);
+  // key和value分别写入，直接引用调用方的数据，不需要拼接成临时的string
+  SetRegion(GetRecordOffset(record), key, sequence);
+  SetRegion(GetRecordOffset(record) + key_size_, value, sequence);
+  // slot目录中[slot, kv_count_)向后移动一位，SetRegion先记录wal再memmove，region可以和目标区域重叠
+  if (slot < kv_count_) {
+    SetRegion(GetSlotOffset(slot + 1),
+              std::string_view(&buf_[GetSlotOffset(slot)], sizeof(uint16_t) * (kv_count_ - slot)), sequence);
+  }
+  // 在slot处写入新记录的编号
+  SetRegion(GetSlotOffset(slot), std::string_view((const char*)&record, sizeof(record)), sequence);
+  abbr_keys_.insert(abbr_keys_.begin() + slot, AbbreviateKey(key));
+  SetKvCount(kv_count_ + 1, sequence);
+}
+
+void Block::RemoveSlot(size_t slot, uint64_t sequence) noexcept {
+  assert(slot < kv_count_);
+  uint16_t record = GetSlot(slot);
+  uint16_t last = static_cast<uint16_t>(kv_count_ - 1);
+  if (record != last) {
+    // 将编号最大的记录移动到被删除记录的位置，并修改指向它的slot，保证记录紧密排列
+    SetRegion(GetRecordOffset(record), std::string_view(&buf_[GetRecordOffset(last)], GetEntrySize()), sequence);
+    for (size_t i = 0; i < kv_count_; ++i) {
+      if (GetSlot(i) == last) {
+        SetRegion(GetSlotOffset(i), std::string_view((const char*)&record, sizeof(record)), sequence);
+        break;
+      }
+    }
+  }
+  // slot目录中(slot, kv_count_)向前移动一位
+  if (slot + 1 < kv_count_) {
+    SetRegion(GetSlotOffset(slot),
+              std::string_view(&buf_[GetSlotOffset(slot + 1)], sizeof(uint16_t) * (kv_count_ - slot - 1)), sequence);
+  }
+  abbr_keys_.erase(abbr_keys_.begin() + slot);
+  SetKvCount(kv_count_ - 1, sequence);
 }
 
-std::string_view Block::SetEntryValue(uint32_t offset, const std::string_view& value, uint64_t sequence) noexcept {
-  SetDirty();
-  assert(value.size() == value_size_);
-  uint32_t value_offset = offset + sizeof(uint32_t) + key_size_;
-  if (sequence != no_wal_sequence) {
-    std::string undo_log((const char*)&buf_[value_offset], value_size_);
-    std::string redo_log(value);
-    // 修改数据的同时将修改处的新值和旧值写入sequence标识的wal日志中
-    auto log_num = manager_.wal_.WriteLog(sequence, CreateDataChangeWalLog(value_offset, redo_log),
-                                          CreateDataChangeWalLog(value_offset, undo_log));
-    UpdateLogNumber(log_num);
+void Block::ConvertFromLinkedEntryFormat() noexcept {
+  // 旧版本中page_format_和kv_count_的位置分别存储链表头部entry的索引值和空闲链表，entry的索引值从1开始计数
+  uint32_t head_entry = page_format_;
+  uint32_t legacy_entry_size = sizeof(uint32_t) + GetEntrySize();
+  std::string records;
+  uint32_t count = 0;
+  uint32_t entry_index = head_entry;
+  while (entry_index != 0) {
+    uint32_t offset = GetMetaSpace() + (entry_index - 1) * legacy_entry_size;
+    memcpy(&entry_index, &buf_[offset], sizeof(entry_index));
+    records.append(&buf_[offset + sizeof(uint32_t)], GetEntrySize());
+    count += 1;
+  }
+  // 新格式每个kv占用的空间比旧格式少，因此一定可以容纳
+  assert(count <= GetMaxEntrySize());
+  for (uint32_t i = 0; i < count; ++i) {
+    uint16_t record = static_cast<uint16_t>(i);
+    memcpy(&buf_[GetSlotOffset(i)], &record, sizeof(record));
+    memcpy(&buf_[GetRecordOffset(i)], &records[i * GetEntrySize()], GetEntrySize());
   }
-  memcpy(&buf_[value_offset], value.data(), value_size_);
-  return std::string_view((const char*)&buf_[value_offset], static_cast<size_t>(value_size_));
+  page_format_ = slotted_page_format;
+  kv_count_ = count;
+  BPTREE_LOG_DEBUG("block {} is converted from the linked entry format, kv count {}", GetIndex(), count);
 }
 
 /*
  * super block
  */
 
-std::string SuperBlock::CreateMetaChangeWalLog(const std::string& meta_name, uint32_t value) {
-  std::string result;
-  util::StringAppender(result, detail::LogTypeToUint8T(detail::LogType::SUPER_META));
-  util::StringAppender(result, GetIndex());
-  util::StringAppender(result, meta_name);
-  util::StringAppender(result, value);
+LogHead SuperBlock::CreateMetaChangeWalLog(detail::MetaField field, uint32_t value) {
+  LogHead result;
+  result.AppendByte(detail::LogTypeToUint8T(detail::LogType::COMPACT_SUPER_META))
+      .AppendByte(detail::MetaFieldToUint8T(field))
+      .AppendVarint(value);
   return result;
 }
 
 void SuperBlock::SetCurrentMaxBlockIndex(uint32_t value, uint64_t sequence) {
   BPTREE_LOG_DEBUG("super block set current_max_block_index from {} to {}", current_max_block_index_, value);
   if (sequence != no_wal_sequence) {
-    std::string redo_log = CreateMetaChangeWalLog("current_max_block_index", value);
-    std::string undo_log = CreateMetaChangeWalLog("current_max_block_index", current_max_block_index_);
-    auto log_num = manager_.GetWal().WriteLog(sequence, redo_log, undo_log);
+    LogHead redo_log = CreateMetaChangeWalLog(detail::MetaField::CURRENT_MAX_BLOCK_INDEX, value);
+    LogHead undo_log = CreateMetaChangeWalLog(detail::MetaField::CURRENT_MAX_BLOCK_INDEX, current_max_block_index_);
+    auto log_num = manager_.GetWal().WriteLog(sequence, redo_log.View(), undo_log.View());
     UpdateLogNumber(log_num);
   }
   current_max_block_index_ = value;
@@ -719,9 +784,9 @@ void SuperBlock::SetCurrentMaxBlockIndex(uint32_t value, uint64_t sequence) {
 void SuperBlock::SetFreeBlockHead(uint32_t value, uint64_t sequence) {
   BPTREE_LOG_DEBUG("super block set free_block_head from {} to {}", free_block_head_, value);
   if (sequence != no_wal_sequence) {
-    std::string redo_log = CreateMetaChangeWalLog("free_block_head", value);
-    std::string undo_log = CreateMetaChangeWalLog("free_block_head", free_block_head_);
-    auto log_num = manager_.GetWal().WriteLog(sequence, redo_log, undo_log);
+    LogHead redo_log = CreateMetaChangeWalLog(detail::MetaField::FREE_BLOCK_HEAD, value);
+    LogHead undo_log = CreateMetaChangeWalLog(detail::MetaField::FREE_BLOCK_HEAD, free_block_head_);
+    auto log_num = manager_.GetWal().WriteLog(sequence, redo_log.View(), undo_log.View());
     UpdateLogNumber(log_num);
   }
   free_block_head_ = value;
@@ -730,9 +795,9 @@ void SuperBlock::SetFreeBlockHead(uint32_t value, uint64_t sequence) {
 void SuperBlock::SetFreeBlockSize(uint32_t value, uint64_t sequence) {
   BPTREE_LOG_DEBUG("super block set free block size from {} to {}", free_block_size_, value);
   if (sequence != no_wal_sequence) {
-    std::string redo_log = CreateMetaChangeWalLog("free_block_size", value);
-    std::string undo_log = CreateMetaChangeWalLog("free_block_size", free_block_size_);
-    auto log_num = manager_.GetWal().WriteLog(sequence, redo_log, undo_log);
+    LogHead redo_log = CreateMetaChangeWalLog(detail::MetaField::FREE_BLOCK_SIZE, value);
+    LogHead undo_log = CreateMetaChangeWalLog(detail::MetaField::FREE_BLOCK_SIZE, free_block_size_);
+    auto log_num = manager_.GetWal().WriteLog(sequence, redo_log.View(), undo_log.View());
     UpdateLogNumber(log_num);
   }
   free_block_size_ = value;
@@ -1,9 +1,37 @@
 #include "bptree/block_manager.h"
 
+#include <atomic>
+#include <chrono>
+#include <optional>
 #include <thread>
 
 #include "gtest/gtest.h"
 
+static std::string MakeKey(int n) {
+  std::string key = std::to_string(n);
+  return std::string(8 - key.size(), '0') + key;
+}
+
+static std::string BigEndianKey(uint64_t num) {
+  std::string key(sizeof(num), '\0');
+  for (size_t i = 0; i < sizeof(num); ++i) {
+    key[i] = static_cast<char>(num >> (8 * (sizeof(num) - 1 - i)));
+  }
+  return key;
+}
+
+// 新建一个可读写的db，key和value都是MakeKey生成的8字节字符串
+static bptree::BlockManagerOption MakeOption(const std::string& db_name) {
+  bptree::BlockManagerOption option;
+  option.db_name = db_name;
+  option.neflag = bptree::NotExistFlag::CREATE;
+  option.eflag = bptree::ExistFlag::ERROR;
+  option.mode = bptree::Mode::WR;
+  option.key_size = 8;
+  option.value_size = 8;
+  return option;
+}
+
 TEST(block_manager, base) {
   spdlog::set_level(spdlog::level::debug);
   bptree::BlockManagerOption option;
@@ -35,6 +63,70 @@ TEST(block_manager, base) {
   std::string old_v2 = manager.Update("a", "valua");
   EXPECT_EQ(old_v2, "value");
   EXPECT_EQ("valua", manager.Get("a"));
+
+  std::string buf = "old value";
+  EXPECT_EQ(manager.Get("b", &buf), true);
+  EXPECT_EQ(buf, "bbbbb");
+  EXPECT_EQ(manager.Get("z", &buf), false);
+  EXPECT_EQ(buf, "");
+
+  {
+    bptree::PinnableValue pinned = manager.GetPinned("a");
+    EXPECT_EQ(pinned.Exist(), true);
+    EXPECT_EQ(pinned.Value(), "valua");
+    bptree::PinnableValue moved(std::move(pinned));
+    EXPECT_EQ(moved.Value(), "valua");
+    EXPECT_EQ(manager.GetPinned("z").Exist(), false);
+    // 读操作之间不会互相阻塞
+    EXPECT_EQ(manager.GetPinned("a").Value(), "valua");
+  }
+  // 析构之后可以进行写操作
+  EXPECT_EQ(manager.Update("a", "valub"), "valua");
+}
+
+TEST(block_manager, pinned_value_with_write) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::BlockManagerOption option = MakeOption("test_pinned_value_with_write");
+  option.create_check_point_per_ops = 1000;
+  bptree::BlockManager manager(option);
+  const int kv_count = 40000;
+  for (int i = 0; i < kv_count; i += 4) {
+    EXPECT_EQ(manager.Insert(MakeKey(i), MakeKey(i)), true);
+  }
+  auto& metrics = manager.GetMetricSet();
+  uint64_t split_count = metrics.GetAs<bptree::Counter>("block_split_count")->GetValue();
+  uint64_t checkpoint_count = metrics.GetAs<bptree::Counter>("create_checkpoint_count")->GetValue();
+  // 持有最后一个叶子节点中的value，同一个线程中对其他叶子节点的写操作引起分裂和check point，不会被阻塞
+  std::optional<bptree::PinnableValue> pinned(manager.GetPinned(MakeKey(kv_count - 4)));
+  ASSERT_EQ(pinned->Exist(), true);
+  for (int i = 0; i < kv_count / 4; ++i) {
+    if (i % 4 != 0) {
+      EXPECT_EQ(manager.Insert(MakeKey(i), MakeKey(i)), true);
+    }
+  }
+  EXPECT_GT(metrics.GetAs<bptree::Counter>("block_split_count")->GetValue(), split_count);
+  EXPECT_GT(metrics.GetAs<bptree::Counter>("create_checkpoint_count")->GetValue(), checkpoint_count);
+  EXPECT_EQ(pinned->Value(), MakeKey(kv_count - 4));
+
+  // 其他线程修改被持有的叶子节点时需要等待PinnableValue析构
+  std::atomic<bool> done = false;
+  std::thread writer([&]() {
+    for (int i = kv_count - 1; i > kv_count / 2; --i) {
+      if (i % 4 != 0) {
+        EXPECT_EQ(manager.Insert(MakeKey(i), MakeKey(i)), true);
+      }
+    }
+    done = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(done.load(), false);
+  EXPECT_EQ(pinned->Value(), MakeKey(kv_count - 4));
+  pinned.reset();
+  writer.join();
+  for (int i = 0; i < kv_count; i += 1) {
+    bool exist = i % 4 == 0 || i < kv_count / 4 || i > kv_count / 2;
+    EXPECT_EQ(manager.Get(MakeKey(i)), exist ? MakeKey(i) : "");
+  }
 }
 
 TEST(block_manager, getrange) {
@@ -63,12 +155,12 @@ TEST(block_manager, getrange) {
   EXPECT_EQ(expect_result, kvs);
 
   kvs = manager.GetRange(
-      "a", [](const bptree::Entry& entry) -> bptree::GetRangeOption { return bptree::GetRangeOption::SKIP; });
+      "a", [](const bptree::Entry&) -> bptree::GetRangeOption { return bptree::GetRangeOption::SKIP; });
   expect_result = {};
   EXPECT_EQ(expect_result, kvs);
 
   kvs = manager.GetRange(
-      "c", [](const bptree::Entry& entry) -> bptree::GetRangeOption { return bptree::GetRangeOption::SELECT; });
+      "c", [](const bptree::Entry&) -> bptree::GetRangeOption { return bptree::GetRangeOption::SELECT; });
   expect_result.clear();
   for (char c = 'c'; c < 'a' + 20; ++c) {
     std::string key;
@@ -76,4 +168,657 @@ TEST(block_manager, getrange) {
     expect_result.push_back({key, "value"});
   }
   EXPECT_EQ(expect_result, kvs);
-}
\ No newline at end of file
+}
+
+TEST(block_manager, getrange_start) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::BlockManagerOption option = MakeOption("test_getrange_start");
+  bptree::BlockManager manager(option);
+  // 只插入偶数key，数据分布在多个叶子节点中
+  const int kv_count = 4000;
+  for (int i = 0; i < kv_count; i += 2) {
+    manager.Insert(MakeKey(i), MakeKey(i));
+  }
+  auto first_key = [&](int n, bptree::RangeStart start) -> std::string {
+    std::string result;
+    manager.GetRange(
+        MakeKey(n),
+        [&](const bptree::Entry& entry) -> bptree::GetRangeOption {
+          result = std::string(entry.key_view);
+          return bptree::GetRangeOption::STOP;
+        },
+        start);
+    return result;
+  };
+  // 返回第一个大于等于n的偶数key，不存在时返回空字符串
+  auto expect_key = [&](int n) -> std::string {
+    n += n % 2;
+    return n < kv_count ? MakeKey(n) : "";
+  };
+  for (int i = 0; i <= kv_count; ++i) {
+    EXPECT_EQ(first_key(i, bptree::RangeStart::EQ), i % 2 == 0 && i < kv_count ? MakeKey(i) : "");
+    EXPECT_EQ(first_key(i, bptree::RangeStart::GE), expect_key(i));
+    EXPECT_EQ(first_key(i, bptree::RangeStart::GT), expect_key(i + 1));
+  }
+
+  auto kvs = manager.GetRange(
+      MakeKey(kv_count - 5),
+      [](const bptree::Entry&) -> bptree::GetRangeOption { return bptree::GetRangeOption::SELECT; },
+      bptree::RangeStart::GE);
+  std::vector<std::pair<std::string, std::string>> expect_result = {{MakeKey(kv_count - 4), MakeKey(kv_count - 4)},
+                                                                    {MakeKey(kv_count - 2), MakeKey(kv_count - 2)}};
+  EXPECT_EQ(kvs, expect_result);
+  kvs = manager.GetRange(
+      MakeKey(kv_count - 4),
+      [](const bptree::Entry&) -> bptree::GetRangeOption { return bptree::GetRangeOption::SELECT; },
+      bptree::RangeStart::GT);
+  expect_result.erase(expect_result.begin());
+  EXPECT_EQ(kvs, expect_result);
+}
+
+TEST(block_manager, readahead) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::BlockManagerOption option = MakeOption("test_readahead");
+  // cache远小于叶子节点的数量，扫描时大部分叶子节点需要从文件中读取
+  option.cache_size = 16;
+  option.readahead_blocks = 4;
+  bptree::BlockManager manager(option);
+  const int kv_count = 40000;
+  for (int i = 0; i < kv_count; ++i) {
+    manager.Insert(MakeKey(i), MakeKey(i));
+  }
+  auto& metrics = manager.GetMetricSet();
+  auto kvs = manager.GetRange(
+      MakeKey(0), [](const bptree::Entry&) -> bptree::GetRangeOption { return bptree::GetRangeOption::SELECT; });
+  ASSERT_EQ(kvs.size(), kv_count);
+  for (int i = 0; i < kv_count; ++i) {
+    EXPECT_EQ(kvs[i].first, MakeKey(i));
+  }
+  EXPECT_GT(metrics.GetAs<bptree::Counter>("readahead_hit_count")->GetValue(), 0);
+  // 扫描到最后一个叶子节点时所有的预读都被访问到
+  EXPECT_EQ(metrics.GetAs<bptree::Counter>("readahead_wasted_count")->GetValue(), 0);
+
+  // 提前结束的扫描留下没有被访问到的预读
+  int selected = 0;
+  kvs = manager.GetRange(MakeKey(0), [&](const bptree::Entry&) -> bptree::GetRangeOption {
+    return ++selected > kv_count / 10 ? bptree::GetRangeOption::STOP : bptree::GetRangeOption::SELECT;
+  });
+  EXPECT_EQ(kvs.size(), kv_count / 10);
+  EXPECT_GT(metrics.GetAs<bptree::Counter>("readahead_wasted_count")->GetValue(), 0);
+}
+
+TEST(block_manager, io_uring) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::BlockManagerOption option = MakeOption("test_io_uring");
+  option.cache_size = 64;
+  // 关闭double write时check point批量写回脏block
+  option.double_write_turn_off = true;
+  option.create_check_point_per_ops = 1000;
+  option.io_engine = bptree::IoEngine::IO_URING;
+  option.io_queue_depth = 8;
+  const int kv_count = 40000;
+  {
+    bptree::BlockManager manager(option);
+    for (int i = 0; i < kv_count; ++i) {
+      manager.Insert(MakeKey(i), MakeKey(i));
+    }
+    // MultiGet和范围查找的预读批量读入cache
+    std::vector<std::string> keys;
+    for (int i = 0; i < kv_count; i += 97) {
+      keys.push_back(MakeKey(i));
+    }
+    auto values = manager.MultiGet(keys);
+    EXPECT_EQ(values, keys);
+    auto kvs = manager.GetRange(MakeKey(0), [](const bptree::Entry&) -> bptree::GetRangeOption {
+      return bptree::GetRangeOption::SELECT;
+    });
+    ASSERT_EQ(kvs.size(), kv_count);
+    for (int i = 0; i < kv_count; ++i) {
+      EXPECT_EQ(kvs[i].first, MakeKey(i));
+    }
+    EXPECT_GT(manager.GetMetricSet().GetAs<bptree::Counter>("prefetch_block_count")->GetValue(), 0);
+  }
+  option.neflag = bptree::NotExistFlag::ERROR;
+  option.eflag = bptree::ExistFlag::SUCC;
+  bptree::BlockManager manager(option);
+  for (int i = 0; i < kv_count; i += 7) {
+    EXPECT_EQ(manager.Get(MakeKey(i)), MakeKey(i));
+  }
+}
+
+TEST(block_manager, concurrent) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::BlockManagerOption option = MakeOption("test_concurrent");
+  option.cache_size = 16;
+  option.create_check_point_per_ops = 1000;
+  bptree::BlockManager manager(option);
+
+  const int thread_count = 4;
+  const int kv_count_per_thread = 2000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kv_count_per_thread; ++i) {
+        // 各线程的key交错分布，使得多个线程同时修改相同的block
+        std::string key = MakeKey(i * thread_count + t);
+        EXPECT_EQ(manager.Insert(key, key), true);
+        EXPECT_EQ(manager.Get(key), key);
+      }
+    });
+  }
+  for (auto& each : threads) {
+    each.join();
+  }
+  threads.clear();
+
+  for (int t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kv_count_per_thread; ++i) {
+        std::string key = MakeKey(i * thread_count + t);
+        if (i % 2 == 0) {
+          EXPECT_EQ(manager.Delete(key), key);
+        } else {
+          EXPECT_EQ(manager.Update(key, MakeKey(i)), key);
+        }
+        // 其他线程的key只会被删除或者更新
+        std::string other = manager.Get(MakeKey(i * thread_count + (t + 1) % thread_count));
+        EXPECT_EQ(other.size() == 0 || other.size() == 8, true);
+      }
+    });
+  }
+  for (auto& each : threads) {
+    each.join();
+  }
+
+  for (int t = 0; t < thread_count; ++t) {
+    for (int i = 0; i < kv_count_per_thread; ++i) {
+      std::string key = MakeKey(i * thread_count + t);
+      EXPECT_EQ(manager.Get(key), i % 2 == 0 ? "" : MakeKey(i));
+    }
+  }
+  // 最小的未被删除的key为make_key(thread_count)
+  auto kvs = manager.GetRange(MakeKey(thread_count), [](const bptree::Entry&) -> bptree::GetRangeOption {
+    return bptree::GetRangeOption::SELECT;
+  });
+  EXPECT_EQ(kvs.size(), thread_count * kv_count_per_thread / 2);
+}
+
+TEST(block_manager, cache_policy) {
+  for (auto policy : {bptree::CachePolicy::CLOCK, bptree::CachePolicy::TWO_QUEUE}) {
+    bptree::BlockManagerOption option;
+    option.db_name = std::string("test_cache_policy_") + bptree::CachePolicyStr(policy);
+    option.neflag = bptree::NotExistFlag::CREATE;
+    option.eflag = bptree::ExistFlag::ERROR;
+    option.mode = bptree::Mode::WR;
+    option.key_size = 8;
+    option.value_size = 8;
+    option.cache_size = 16;
+    option.cache_policy = policy;
+    option.inner_block_cache_size = 4;
+    bptree::BlockManager manager(option);
+    for (int i = 0; i < 5000; ++i) {
+      std::string key = std::to_string(10000000 + i);
+      EXPECT_EQ(manager.Insert(key, key), true);
+    }
+    for (int i = 0; i < 5000; i += 2) {
+      std::string key = std::to_string(10000000 + i);
+      EXPECT_EQ(manager.Delete(key), key);
+    }
+    for (int i = 0; i < 5000; ++i) {
+      std::string key = std::to_string(10000000 + i);
+      EXPECT_EQ(manager.Get(key), i % 2 == 0 ? "" : key);
+    }
+  }
+}
+
+TEST(block_manager, integer_key) {
+  bptree::BlockManagerOption option;
+  option.db_name = "test_integer_key";
+  option.neflag = bptree::NotExistFlag::CREATE;
+  option.eflag = bptree::ExistFlag::ERROR;
+  option.mode = bptree::Mode::WR;
+  option.key_size = 4;
+  option.value_size = 8;
+  option.cmp = std::make_shared<bptree::BigEndianUInt64Comparator>();
+  // key_size与整数长度不一致
+  EXPECT_THROW(bptree::BlockManager tmp(option), bptree::BptreeExecption);
+
+  option.key_size = 8;
+  bptree::BlockManager manager(option);
+  EXPECT_EQ(manager.GetKeyKind(), bptree::KeyKind::BIG_ENDIAN_UINT64);
+  for (uint64_t i = 0; i < 5000; ++i) {
+    // 乱序插入，包含最高位为1的key
+    uint64_t num = (i * 7919) % 5000 + (i % 2 == 0 ? 0 : (uint64_t(1) << 63));
+    EXPECT_EQ(manager.Insert(BigEndianKey(num), BigEndianKey(num)), true);
+  }
+  EXPECT_EQ(manager.Insert(BigEndianKey(0), BigEndianKey(0)), false);
+  uint64_t high = 7919 % 5000 + (uint64_t(1) << 63);
+  EXPECT_EQ(manager.Get(BigEndianKey(high)), BigEndianKey(high));
+  EXPECT_EQ(manager.Get(BigEndianKey(5001)), "");
+  std::string prev;
+  size_t count = 0;
+  manager.GetRange(BigEndianKey(0), [&](const bptree::Entry& entry) -> bptree::GetRangeOption {
+    std::string key(entry.key_view);
+    EXPECT_LT(prev, key);
+    prev = key;
+    count += 1;
+    return bptree::GetRangeOption::SKIP;
+  });
+  EXPECT_EQ(count, 5000);
+}
+
+TEST(block_manager, multi_get) {
+  bptree::BlockManagerOption option;
+  option.db_name = "test_multi_get";
+  option.neflag = bptree::NotExistFlag::CREATE;
+  option.eflag = bptree::ExistFlag::ERROR;
+  option.mode = bptree::Mode::WR;
+  option.key_size = 8;
+  option.value_size = 100;
+  option.cache_size = 16;
+  bptree::BlockManager manager(option);
+  EXPECT_EQ(manager.MultiGet({}).size(), 0);
+  for (int i = 0; i < 10000; i += 2) {
+    std::string key = std::to_string(10000000 + i);
+    EXPECT_EQ(manager.Insert(key, std::string(100, 'a' + i % 26)), true);
+  }
+  std::vector<std::string> keys;
+  for (int i = 0; i < 500; ++i) {
+    // 包含不存在的key、重复的key以及大于所有key的key
+    keys.push_back(std::to_string(10000000 + rand() % 10100));
+  }
+  keys.push_back(keys.front());
+  auto values = manager.MultiGet(keys);
+  ASSERT_EQ(values.size(), keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(values[i], manager.Get(keys[i]));
+  }
+  EXPECT_EQ(manager.GetMetricSet().GetAs<bptree::Counter>("multi_get_count")->GetValue(), 2);
+}
+
+TEST(block_manager, iterator) {
+  bptree::BlockManagerOption option;
+  option.db_name = "test_iterator";
+  option.neflag = bptree::NotExistFlag::CREATE;
+  option.eflag = bptree::ExistFlag::ERROR;
+  option.mode = bptree::Mode::WR;
+  option.key_size = 8;
+  option.value_size = 100;
+  option.cache_size = 16;
+  bptree::BlockManager manager(option);
+  {
+    auto iter = manager.NewIterator();
+    iter.SeekToFirst();
+    EXPECT_EQ(iter.Valid(), false);
+  }
+  // key为[10000000, 10006000)中的偶数，跨越多个叶子节点
+  auto key_of = [](int i) -> std::string { return std::to_string(10000000 + i); };
+  for (int i = 0; i < 6000; i += 2) {
+    EXPECT_EQ(manager.Insert(key_of(i), std::string(100, 'a' + i % 26)), true);
+  }
+  {
+    auto iter = manager.NewIterator();
+    int i = 0;
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next(), i += 2) {
+      EXPECT_EQ(iter.Key(), key_of(i));
+      EXPECT_EQ(iter.Value(), std::string(100, 'a' + i % 26));
+    }
+    EXPECT_EQ(i, 6000);
+    i = 5998;
+    for (iter.SeekToLast(); iter.Valid(); iter.Prev(), i -= 2) {
+      EXPECT_EQ(iter.Key(), key_of(i));
+    }
+    EXPECT_EQ(i, -2);
+
+    iter.Seek(key_of(1001));
+    ASSERT_EQ(iter.Valid(), true);
+    EXPECT_EQ(iter.Key(), key_of(1002));
+    iter.Prev();
+    EXPECT_EQ(iter.Key(), key_of(1000));
+    iter.Seek(key_of(6001));
+    EXPECT_EQ(iter.Valid(), false);
+  }
+  {
+    bptree::IteratorOption iter_option;
+    iter_option.lower_bound = key_of(999);
+    iter_option.upper_bound = key_of(3000);
+    auto iter = manager.NewIterator(iter_option);
+    iter.SeekToFirst();
+    ASSERT_EQ(iter.Valid(), true);
+    EXPECT_EQ(iter.Key(), key_of(1000));
+    iter.Prev();
+    EXPECT_EQ(iter.Valid(), false);
+    iter.Seek(key_of(0));
+    EXPECT_EQ(iter.Key(), key_of(1000));
+    iter.SeekToLast();
+    ASSERT_EQ(iter.Valid(), true);
+    EXPECT_EQ(iter.Key(), key_of(2998));
+    iter.Next();
+    EXPECT_EQ(iter.Valid(), false);
+    int count = 0;
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+      count += 1;
+    }
+    EXPECT_EQ(count, 1000);
+  }
+  // 迭代器析构之后可以进行写操作
+  EXPECT_EQ(manager.Delete(key_of(0)), std::string(100, 'a'));
+}
+
+TEST(block_manager, iterator_with_write) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::BlockManagerOption option = MakeOption("test_iterator_with_write");
+  option.cache_size = 16;
+  // 迭代期间的写操作会触发check point
+  option.create_check_point_per_ops = 500;
+  bptree::BlockManager manager(option);
+  const int kv_count = 6000;
+  for (int i = 0; i < kv_count; i += 2) {
+    EXPECT_EQ(manager.Insert(MakeKey(i), MakeKey(i)), true);
+  }
+  auto& metrics = manager.GetMetricSet();
+  uint64_t split_count = metrics.GetAs<bptree::Counter>("block_split_count")->GetValue();
+  // 迭代器存活期间在同一个线程中插入当前位置之后的奇数key，引起叶子节点分裂，迭代器需要返回这些key
+  auto iter = manager.NewIterator();
+  int expect = 0;
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next(), ++expect) {
+    ASSERT_EQ(iter.Key(), MakeKey(expect));
+    EXPECT_EQ(iter.Value(), MakeKey(expect));
+    if (expect % 2 == 0) {
+      EXPECT_EQ(manager.Insert(MakeKey(expect + 1), MakeKey(expect + 1)), true);
+    }
+  }
+  EXPECT_EQ(expect, kv_count);
+  EXPECT_GT(metrics.GetAs<bptree::Counter>("block_split_count")->GetValue(), split_count);
+  // 反向迭代时删除当前位置的偶数key，引起叶子节点合并
+  uint64_t merge_count = metrics.GetAs<bptree::Counter>("block_merge_count")->GetValue();
+  expect = kv_count - 1;
+  for (iter.SeekToLast(); iter.Valid(); iter.Prev(), --expect) {
+    ASSERT_EQ(iter.Key(), MakeKey(expect));
+    if (expect % 2 == 0) {
+      EXPECT_EQ(manager.Delete(MakeKey(expect)), MakeKey(expect));
+    }
+  }
+  EXPECT_EQ(expect, -1);
+  EXPECT_GT(metrics.GetAs<bptree::Counter>("block_merge_count")->GetValue(), merge_count);
+  int count = 0;
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next(), ++count) {
+    EXPECT_EQ(iter.Key(), MakeKey(count * 2 + 1));
+  }
+  EXPECT_EQ(count, kv_count / 2);
+  // 迭代器不持有锁，可以移动到其他线程中继续使用
+  std::thread t([iter = std::move(iter)]() mutable {
+    iter.SeekToLast();
+    ASSERT_EQ(iter.Valid(), true);
+    EXPECT_EQ(iter.Key(), MakeKey(kv_count - 1));
+  });
+  t.join();
+}
+
+TEST(block_manager, key_filter) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::BlockManagerOption option = MakeOption("test_key_filter");
+  option.create_check_point_per_ops = 1000;
+  option.enable_key_filter = true;
+  // 超过新建db时filter的初始容量，check point时重新构建
+  const int kv_count = 20000;
+  {
+    bptree::BlockManager manager(option);
+    for (int i = 0; i < kv_count; i += 2) {
+      manager.Insert(MakeKey(i), MakeKey(i));
+    }
+    auto& metrics = manager.GetMetricSet();
+    EXPECT_GT(metrics.GetAs<bptree::Counter>("key_filter_rebuild_count")->GetValue(), 0);
+    for (int i = 0; i < kv_count; ++i) {
+      EXPECT_EQ(manager.Get(MakeKey(i)), i % 2 == 0 ? MakeKey(i) : "");
+    }
+    // 绝大多数不存在的key不需要查找树
+    EXPECT_GT(metrics.GetAs<bptree::Counter>("key_filter_skip_count")->GetValue(), kv_count / 2 * 9 / 10);
+    for (int i = 0; i < kv_count; i += 4) {
+      EXPECT_EQ(manager.Delete(MakeKey(i)), MakeKey(i));
+      EXPECT_EQ(manager.Get(MakeKey(i)), "");
+    }
+    std::vector<std::string> keys = {MakeKey(1), MakeKey(2), MakeKey(4)};
+    auto values = manager.MultiGet(keys);
+    EXPECT_EQ(values, std::vector<std::string>({"", MakeKey(2), ""}));
+  }
+  // 重新打开时加载关闭时持久化的filter
+  option.neflag = bptree::NotExistFlag::ERROR;
+  option.eflag = bptree::ExistFlag::SUCC;
+  {
+    bptree::BlockManager manager(option);
+    EXPECT_EQ(manager.GetMetricSet().GetAs<bptree::Counter>("key_filter_rebuild_count")->GetValue(), 0);
+    for (int i = 0; i < kv_count; ++i) {
+      EXPECT_EQ(manager.Get(MakeKey(i)), i % 4 == 2 ? MakeKey(i) : "");
+    }
+    manager.Insert(MakeKey(kv_count), MakeKey(kv_count));
+    EXPECT_EQ(manager.Get(MakeKey(kv_count)), MakeKey(kv_count));
+  }
+  // 关闭filter之后旧的filter文件被删除，再次开启时重新构建
+  option.enable_key_filter = false;
+  { bptree::BlockManager manager(option); }
+  option.enable_key_filter = true;
+  bptree::BlockManager manager(option);
+  EXPECT_EQ(manager.GetMetricSet().GetAs<bptree::Counter>("key_filter_rebuild_count")->GetValue(), 1);
+  EXPECT_EQ(manager.Get(MakeKey(kv_count)), MakeKey(kv_count));
+  EXPECT_EQ(manager.Get(MakeKey(kv_count - 2)), MakeKey(kv_count - 2));
+}
+
+TEST(block_manager, mmap_read_only) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::BlockManagerOption option = MakeOption("test_mmap_read_only");
+  option.cache_size = 64;
+  const int kv_count = 20000;
+  {
+    bptree::BlockManager manager(option);
+    for (int i = 0; i < kv_count; ++i) {
+      manager.Insert(MakeKey(i), MakeKey(i));
+    }
+  }
+  option.neflag = bptree::NotExistFlag::ERROR;
+  option.eflag = bptree::ExistFlag::SUCC;
+  option.mode = bptree::Mode::R;
+  option.mmap_read_only = true;
+  bptree::BlockManager manager(option);
+  // cache远小于block数量，同一个block被多次淘汰和重新加载
+  for (int round = 0; round < 2; ++round) {
+    for (int i = 0; i < kv_count; i += 3) {
+      EXPECT_EQ(manager.Get(MakeKey(i)), MakeKey(i));
+    }
+  }
+  EXPECT_EQ(manager.Get(MakeKey(kv_count)), "");
+  auto kvs = manager.GetRange(
+      MakeKey(0), [](const bptree::Entry&) -> bptree::GetRangeOption { return bptree::GetRangeOption::SELECT; });
+  ASSERT_EQ(kvs.size(), kv_count);
+  for (int i = 0; i < kv_count; ++i) {
+    EXPECT_EQ(kvs[i].first, MakeKey(i));
+  }
+  std::vector<std::string> keys;
+  for (int i = 0; i < kv_count; i += 101) {
+    keys.push_back(MakeKey(i));
+  }
+  EXPECT_EQ(manager.MultiGet(keys), keys);
+  auto& metrics = manager.GetMetricSet();
+  EXPECT_GT(metrics.GetAs<bptree::Counter>("mmap_load_block_count")->GetValue(), 0);
+  EXPECT_THROW(manager.Insert(MakeKey(kv_count), MakeKey(kv_count)), bptree::BptreeExecption);
+}
+
+TEST(block_manager, direct_io) {
+  spdlog::set_level(spdlog::level::info);
+  const int kv_count = 20000;
+  for (auto engine : {bptree::IoEngine::SYNC, bptree::IoEngine::IO_URING}) {
+    bptree::BlockManagerOption option;
+    option.db_name = std::string("test_direct_io_") + bptree::IoEngineStr(engine);
+    option.neflag = bptree::NotExistFlag::CREATE;
+    option.eflag = bptree::ExistFlag::ERROR;
+    option.mode = bptree::Mode::WR;
+    option.key_size = 8;
+    option.value_size = 8;
+    // cache远小于block数量，淘汰和加载都经过O_DIRECT读写
+    option.cache_size = 32;
+    option.create_check_point_per_ops = 1000;
+    option.double_write_turn_off = engine == bptree::IoEngine::IO_URING;
+    option.io_engine = engine;
+    option.direct_io = true;
+    {
+      bptree::BlockManager manager(option);
+      for (int i = 0; i < kv_count; ++i) {
+        manager.Insert(MakeKey(i), MakeKey(i));
+      }
+      for (int i = 0; i < kv_count; i += 5) {
+        EXPECT_EQ(manager.Delete(MakeKey(i)), MakeKey(i));
+      }
+    }
+    option.neflag = bptree::NotExistFlag::ERROR;
+    option.eflag = bptree::ExistFlag::SUCC;
+    bptree::BlockManager manager(option);
+    for (int i = 0; i < kv_count; ++i) {
+      EXPECT_EQ(manager.Get(MakeKey(i)), i % 5 == 0 ? "" : MakeKey(i));
+    }
+    auto kvs = manager.GetRange(
+        MakeKey(0), [](const bptree::Entry&) -> bptree::GetRangeOption { return bptree::GetRangeOption::SELECT; },
+        bptree::RangeStart::GE);
+    EXPECT_EQ(kvs.size(), kv_count / 5 * 4);
+  }
+}
+
+TEST(block_manager, buffer_pool) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::BlockManagerOption option = MakeOption("test_buffer_pool");
+  option.cache_size = 64;
+  option.buffer_pool_huge_page = true;
+  const int kv_count = 40000;
+  bptree::BlockManager manager(option);
+  for (int i = 0; i < kv_count; ++i) {
+    manager.Insert(MakeKey(i), MakeKey(i));
+  }
+  for (int i = 0; i < kv_count; i += 3) {
+    EXPECT_EQ(manager.Get(MakeKey(i)), MakeKey(i));
+  }
+  // cache置换过程中被淘汰的block的buf被复用，内存占用不超过buf池的容量
+  auto& pool = manager.GetBufferPool();
+  EXPECT_GT(manager.GetMetricSet().GetAs<bptree::Counter>("load_block_count")->GetValue(), 64);
+  EXPECT_LE(pool.SlabFrameCount(), pool.Capacity());
+  EXPECT_EQ(pool.HeapAllocCount(), 0);
+}
+
+TEST(block_manager, row_cache) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::BlockManagerOption option = MakeOption("test_row_cache");
+  option.row_cache_bytes = 1024 * 1024;
+  bptree::BlockManager manager(option);
+  const int kv_count = 10000;
+  for (int i = 0; i < kv_count; ++i) {
+    manager.Insert(MakeKey(i), MakeKey(i));
+  }
+  auto& metrics = manager.GetMetricSet();
+  for (int round = 0; round < 2; ++round) {
+    for (int i = 0; i < kv_count; i += 10) {
+      EXPECT_EQ(manager.Get(MakeKey(i)), MakeKey(i));
+    }
+  }
+  EXPECT_EQ(metrics.GetAs<bptree::Counter>("row_cache_hit_count")->GetValue(), kv_count / 10);
+  EXPECT_EQ(metrics.GetAs<bptree::Counter>("row_cache_miss_count")->GetValue(), kv_count / 10);
+  // 修改和删除使对应的行失效
+  EXPECT_EQ(manager.Update(MakeKey(0), MakeKey(1)), MakeKey(0));
+  EXPECT_EQ(manager.Get(MakeKey(0)), MakeKey(1));
+  EXPECT_EQ(manager.Delete(MakeKey(10)), MakeKey(10));
+  EXPECT_EQ(manager.Get(MakeKey(10)), "");
+  EXPECT_TRUE(manager.Insert(MakeKey(10), MakeKey(2)));
+  EXPECT_EQ(manager.Get(MakeKey(10)), MakeKey(2));
+
+  // 并发的读写之后，row cache中的value与树中的一致
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int round = 0; round < 20; ++round) {
+        for (int i = t; i < 100; i += 2) {
+          manager.Update(MakeKey(i), MakeKey(round));
+        }
+      }
+    });
+  }
+  for (int t = 0; t < 2; ++t) {
+    threads.emplace_back([&]() {
+      for (int round = 0; round < 40; ++round) {
+        for (int i = 0; i < 100; ++i) {
+          manager.Get(MakeKey(i));
+        }
+      }
+    });
+  }
+  for (auto& each : threads) {
+    each.join();
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(manager.Get(MakeKey(i)), MakeKey(19));
+    EXPECT_EQ(manager.GetPinned(MakeKey(i)).Value(), MakeKey(19));
+  }
+}
+
+TEST(block_manager, group_commit) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::BlockManagerOption option = MakeOption("test_group_commit");
+  option.sync_per_write = true;
+  option.group_commit_batch_size = 4;
+  option.group_commit_max_wait_us = 1000;
+  const int thread_count = 4;
+  const int kv_per_thread = 200;
+  {
+    bptree::BlockManager manager(option);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+      threads.emplace_back([&, t]() {
+        for (int i = t; i < thread_count * kv_per_thread; i += thread_count) {
+          manager.Insert(MakeKey(i), MakeKey(i));
+        }
+      });
+    }
+    for (auto& each : threads) {
+      each.join();
+    }
+    auto& metrics = manager.GetMetricSet();
+    double sync_count = metrics.GetAs<bptree::Counter>("group_commit_sync_count")->GetValue();
+    double tx_count = metrics.GetAs<bptree::Counter>("group_commit_tx_count")->GetValue();
+    EXPECT_GT(sync_count, 0);
+    EXPECT_LT(sync_count, thread_count * kv_per_thread);
+    EXPECT_EQ(tx_count, thread_count * kv_per_thread);
+  }
+  option.neflag = bptree::NotExistFlag::ERROR;
+  option.eflag = bptree::ExistFlag::SUCC;
+  bptree::BlockManager manager(option);
+  for (int i = 0; i < thread_count * kv_per_thread; ++i) {
+    EXPECT_EQ(manager.Get(MakeKey(i)), MakeKey(i));
+  }
+}
+
+TEST(block_manager, wal_buffer) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::BlockManagerOption option = MakeOption("test_wal_buffer");
+  // 缓冲区很小时写操作需要频繁等待后台线程写入
+  option.wal_buffer_size = 512;
+  const int thread_count = 4;
+  const int kv_per_thread = 500;
+  {
+    bptree::BlockManager manager(option);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+      threads.emplace_back([&, t]() {
+        for (int i = t; i < thread_count * kv_per_thread; i += thread_count) {
+          manager.Insert(MakeKey(i), MakeKey(i));
+        }
+      });
+    }
+    for (auto& each : threads) {
+      each.join();
+    }
+    EXPECT_EQ(manager.GetWal().GetBufferSize(), 512);
+    EXPECT_GT(manager.GetWal().FileWriteCount(), 0);
+  }
+  option.neflag = bptree::NotExistFlag::ERROR;
+  option.eflag = bptree::ExistFlag::SUCC;
+  bptree::BlockManager manager(option);
+  for (int i = 0; i < thread_count * kv_per_thread; ++i) {
+    EXPECT_EQ(manager.Get(MakeKey(i)), MakeKey(i));
+  }
+}
@@ -3,8 +3,12 @@
 #define private public
 #define protected public
 
+#include <fstream>
+#include <iterator>
+#include <limits>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "bptree/block.h"
 #include "bptree/block_manager.h"
@@ -43,6 +47,27 @@ TEST(block, helper) {
   offset = bptree::util::ParseStrFromBuf(buf, new_key, offset);
   EXPECT_EQ(key, new_key);
   EXPECT_EQ(offset, old_offset + sizeof(uint32_t) + key.size());
+
+  std::string varints;
+  std::vector<uint64_t> values = {0, 1, 127, 128, 16384, std::numeric_limits<uint32_t>::max(),
+                                  std::numeric_limits<uint64_t>::max()};
+  for (auto value : values) {
+    size_t old_size = varints.size();
+    bptree::util::VarintAppender(varints, value);
+    EXPECT_EQ(varints.size() - old_size, bptree::util::VarintSize(value));
+  }
+  EXPECT_EQ(bptree::util::VarintSize(127), 1);
+  EXPECT_EQ(bptree::util::VarintSize(128), 2);
+  EXPECT_EQ(bptree::util::VarintSize(std::numeric_limits<uint64_t>::max()), bptree::util::max_varint_size);
+  size_t varint_offset = 0;
+  for (auto value : values) {
+    EXPECT_EQ(bptree::util::VarintParser(varints, varint_offset), value);
+  }
+  EXPECT_EQ(varint_offset, varints.size());
+  // 不完整的varint
+  uint64_t value = 0;
+  varint_offset = varints.size() - bptree::util::max_varint_size;
+  EXPECT_FALSE(bptree::util::DecodeVarint(std::string_view(varints).substr(0, varints.size() - 1), varint_offset, value));
 }
 
 TEST(block, constructor) {
@@ -57,7 +82,8 @@ TEST(block, constructor) {
   bptree::Block block(manager, 2, 0, 1, 5);
   EXPECT_EQ(block.GetHeight(), 0);
 
-  EXPECT_EQ(block.GetEntrySize(), sizeof(uint32_t) + 1 + 5);
+  EXPECT_EQ(block.GetEntrySize(), 1 + 5);
+  EXPECT_EQ(block.GetMaxEntrySize(), (bptree::block_size - block.GetMetaSpace()) / (1 + 5 + sizeof(uint16_t)));
 
   std::string value = block.Get("a");
   EXPECT_EQ(value, "");
@@ -65,57 +91,45 @@ TEST(block, constructor) {
   EXPECT_EQ("value", block.Get("a"));
   block.Insert("b", "value", bptree::no_wal_sequence);
   EXPECT_EQ(block.GetMaxKey(), "b");
+  EXPECT_EQ(block.GetKVCount(), 2);
   block.Delete("a", bptree::no_wal_sequence);
   EXPECT_EQ("", block.Get("a"));
+  EXPECT_EQ(block.GetKVCount(), 1);
+
+  // 删除a之后，b对应的记录被移动到0号记录的位置
+  EXPECT_EQ(block.GetSlot(0), 0);
+  EXPECT_EQ(block.GetRecordOffset(0), bptree::block_size - block.GetEntrySize());
+  EXPECT_EQ(block.GetKeyView(0), "b");
+  EXPECT_EQ(block.GetValueView(0), "value");
+  EXPECT_EQ(std::string_view(&block.buf_[block.GetRecordOffset(0)], block.GetEntrySize()), "bvalue");
+
+  block.UpdateKeyByIndex(0, "c", bptree::no_wal_sequence);
+  EXPECT_EQ("value", block.Get("c"));
+
+  block.UpdateValueByIndex(0, "vvvvv", bptree::no_wal_sequence);
+  EXPECT_EQ("vvvvv", block.Get("c"));
+
+  // 新记录追加在记录区，slot目录保持有序
+  block.InsertSlot(0, "a", "avalu", bptree::no_wal_sequence);
+  EXPECT_EQ(block.GetKVCount(), 2);
+  EXPECT_EQ(block.GetSlot(0), 1);
+  EXPECT_EQ(block.GetSlot(1), 0);
+  auto entry = block.GetViewByIndex(0);
+  EXPECT_EQ(entry.key_view, "a");
+  EXPECT_EQ(entry.value_view, "avalu");
 
-  uint32_t offset = block.GetOffsetByEntryIndex(block.head_entry_);
-  std::string_view key = block.GetEntryKeyView(offset);
-  std::string_view value_v = block.GetEntryValueView(offset);
-  uint32_t index = block.GetEntryNext(offset);
-  EXPECT_EQ(key, "b");
-  EXPECT_EQ(value_v, "value");
-  EXPECT_EQ(index, 0);
-  key = "";
-  value_v = "";
-  index = block.ParseEntry(block.head_entry_, key, value_v);
-  EXPECT_EQ(key, "b");
-  EXPECT_EQ(value_v, "value");
-  EXPECT_EQ(index, 0);
-
-  block.UpdateEntryKey(block.head_entry_, "c", bptree::no_wal_sequence);
-  EXPECT_EQ(value_v, block.Get("c"));
-
-  value_v = "vvvvv";
-  block.UpdateEntryValue(block.head_entry_, std::string(value_v), bptree::no_wal_sequence);
-  EXPECT_EQ(value_v, block.Get("c"));
-
-  block.SetEntryKey(offset, std::string("d"), bptree::no_wal_sequence);
-  block.SetEntryValue(offset, std::string("newvv"), bptree::no_wal_sequence);
-  key = "";
-  value_v = "";
-  index = block.ParseEntry(block.head_entry_, key, value_v);
-  EXPECT_EQ(key, "d");
-  EXPECT_EQ(value_v, "newvv");
-  EXPECT_EQ(index, 0);
-
-  bool full = false;
-  auto entry =
-      block.InsertEntry(block.head_entry_, std::string("e"), std::string("value"), full, bptree::no_wal_sequence);
-  EXPECT_EQ(full, false);
-  EXPECT_EQ(block.GetEntryNext(offset), entry.index);
-  EXPECT_EQ(block.GetEntryNext(block.GetOffsetByEntryIndex(entry.index)), 0);
-  EXPECT_EQ(entry.key_view, "e");
-  EXPECT_EQ(entry.value_view, "value");
-
-  block.UpdateByIndex(0, "f", "ffval", bptree::no_wal_sequence);
-  offset = block.GetOffsetByEntryIndex(block.head_entry_);
-  EXPECT_EQ(block.GetEntryKeyView(offset), "f");
-  EXPECT_EQ(block.GetEntryValueView(offset), "ffval");
-
-  block.RemoveEntry(block.head_entry_, 0, bptree::no_wal_sequence);
-  block.RemoveEntry(block.head_entry_, 0, bptree::no_wal_sequence);
-  EXPECT_EQ(block.head_entry_, 0);
-  EXPECT_EQ(block.free_list_, 1);
+  block.UpdateByIndex(1, "f", "ffval", bptree::no_wal_sequence);
+  EXPECT_EQ(block.GetKeyView(1), "f");
+  EXPECT_EQ(block.GetValueView(1), "ffval");
+
+  // 删除0号记录之后，1号记录被移动过来，指向它的slot同时被修改
+  block.RemoveSlot(1, bptree::no_wal_sequence);
+  EXPECT_EQ(block.GetKVCount(), 1);
+  EXPECT_EQ(block.GetSlot(0), 0);
+  EXPECT_EQ(block.GetKeyView(0), "a");
+  EXPECT_EQ(block.GetValueView(0), "avalu");
+  block.RemoveSlot(0, bptree::no_wal_sequence);
+  EXPECT_EQ(block.GetKVCount(), 0);
   block.SetClean();
 
   bptree::Block block2(manager, 3, 0, 1, 5);
@@ -128,5 +142,171 @@ TEST(block, constructor) {
   EXPECT_EQ(block2.SearchTheFirstGEKey("b"), 1);
   block2.Insert("e", "value", bptree::no_wal_sequence);
   EXPECT_EQ(block2.SearchTheFirstGEKey("d"), 3);
+  // key前缀与slot目录一一对应
+  block2.Delete("b", bptree::no_wal_sequence);
+  ASSERT_EQ(block2.abbr_keys_.size(), block2.GetKVCount());
+  for (size_t i = 0; i < block2.GetKVCount(); ++i) {
+    EXPECT_EQ(block2.abbr_keys_[i], manager.GetComparator().AbbreviateKey(block2.GetKeyView(i)));
+  }
+  EXPECT_EQ(block2.SearchKey("c"), 1);
+  EXPECT_EQ(block2.SearchTheFirstGEKey("b"), 1);
   block2.SetClean();
-}
\ No newline at end of file
+}
+TEST(block, legacy_format) {
+  bptree::BlockManagerOption option;
+  option.db_name = "test_block_legacy";
+  option.neflag = bptree::NotExistFlag::CREATE;
+  option.eflag = bptree::ExistFlag::ERROR;
+  option.mode = bptree::Mode::WR;
+  option.key_size = 1;
+  option.value_size = 5;
+  bptree::BlockManager manager(option);
+  bptree::Block block(manager, 2, 0, 1, 5);
+  // 构造旧版本的链表格式：元数据中page_format_和kv_count_的位置分别为head_entry和free_list，
+  // 每个entry为next + key + value，链表顺序为 1 -> 3 -> 2
+  uint32_t offset = block.BlockBase::GetUsedSpace();
+  offset = bptree::util::AppendToBuf(block.buf_, bptree::not_free_flag, offset);
+  offset = bptree::util::AppendToBuf(block.buf_, uint32_t(0), offset);
+  offset = bptree::util::AppendToBuf(block.buf_, uint32_t(0), offset);
+  offset = bptree::util::AppendToBuf(block.buf_, uint32_t(1), offset);
+  offset = bptree::util::AppendToBuf(block.buf_, uint32_t(5), offset);
+  offset = bptree::util::AppendToBuf(block.buf_, uint32_t(1), offset);
+  offset = bptree::util::AppendToBuf(block.buf_, uint32_t(4), offset);
+  auto append_entry = [&](uint32_t next, const std::string& kv) {
+    offset = bptree::util::AppendToBuf(block.buf_, next, offset);
+    memcpy(&block.buf_[offset], kv.data(), kv.size());
+    offset += kv.size();
+  };
+  append_entry(3, "avalua");
+  append_entry(0, "cvaluc");
+  append_entry(2, "bvalub");
+
+  block.ParseFromBuf(block.BlockBase::GetUsedSpace());
+  EXPECT_EQ(block.page_format_, bptree::slotted_page_format);
+  EXPECT_EQ(block.GetKVCount(), 3);
+  EXPECT_EQ(block.Get("a"), "valua");
+  EXPECT_EQ(block.Get("b"), "valub");
+  EXPECT_EQ(block.Get("c"), "valuc");
+  EXPECT_EQ(block.GetMaxKey(), "c");
+  EXPECT_EQ(block.SearchTheFirstGEKey("b"), 1);
+  EXPECT_EQ(block.abbr_keys_.size(), 3);
+  block.SetClean();
+}
+
+TEST(block, legacy_format_mmap) {
+  bptree::BlockManagerOption option;
+  option.db_name = "test_block_legacy_mmap";
+  option.neflag = bptree::NotExistFlag::CREATE;
+  option.eflag = bptree::ExistFlag::ERROR;
+  option.mode = bptree::Mode::WR;
+  option.key_size = 1;
+  option.value_size = 5;
+  {
+    bptree::BlockManager manager(option);
+    manager.Insert("a", "valua");
+    manager.Insert("b", "valub");
+    manager.Insert("c", "valuc");
+  }
+  // 找到唯一的叶子节点，改写为旧版本的链表格式，链表顺序为 1 -> 3 -> 2
+  std::fstream file(bptree::CreateDbFileNameByDB(option.db_name), std::ios::in | std::ios::out | std::ios::binary);
+  std::vector<char> page(bptree::block_size, 0);
+  uint32_t leaf_index = 0;
+  for (uint32_t index = 1; file.seekg(static_cast<std::streamoff>(index) * bptree::block_size) &&
+                           file.read(page.data(), sizeof(uint32_t) * 4);
+       ++index) {
+    uint32_t height = 0;
+    uint32_t next_free_index = 0;
+    bptree::util::ParseFromBuf(page.data(), height, sizeof(uint32_t) * 2);
+    bptree::util::ParseFromBuf(page.data(), next_free_index, sizeof(uint32_t) * 3);
+    if (height == 0 && next_free_index == bptree::not_free_flag) {
+      leaf_index = index;
+      break;
+    }
+  }
+  ASSERT_NE(leaf_index, 0);
+  std::fill(page.begin() + sizeof(uint32_t) * 3, page.end(), 0);
+  uint32_t offset = sizeof(uint32_t) * 3;
+  offset = bptree::util::AppendToBuf(page.data(), bptree::not_free_flag, offset);
+  offset = bptree::util::AppendToBuf(page.data(), uint32_t(0), offset);
+  offset = bptree::util::AppendToBuf(page.data(), uint32_t(0), offset);
+  offset = bptree::util::AppendToBuf(page.data(), uint32_t(1), offset);
+  offset = bptree::util::AppendToBuf(page.data(), uint32_t(5), offset);
+  offset = bptree::util::AppendToBuf(page.data(), uint32_t(1), offset);
+  offset = bptree::util::AppendToBuf(page.data(), uint32_t(4), offset);
+  auto append_entry = [&](uint32_t next, const std::string& kv) {
+    offset = bptree::util::AppendToBuf(page.data(), next, offset);
+    memcpy(&page[offset], kv.data(), kv.size());
+    offset += kv.size();
+  };
+  append_entry(3, "avalua");
+  append_entry(0, "cvaluc");
+  append_entry(2, "bvalub");
+  uint32_t crc = bptree::checksum::Crc32c(&page[sizeof(crc)], bptree::block_size - sizeof(crc));
+  bptree::util::AppendToBuf(page.data(), crc, 0);
+  file.seekp(static_cast<std::streamoff>(leaf_index) * bptree::block_size);
+  file.write(page.data(), page.size());
+  file.close();
+
+  // 映射的页是只读的，旧版本格式的block不能原地转换
+  option.neflag = bptree::NotExistFlag::ERROR;
+  option.eflag = bptree::ExistFlag::SUCC;
+  option.mode = bptree::Mode::R;
+  option.mmap_read_only = true;
+  bptree::BlockManager manager(option);
+  EXPECT_EQ(manager.Get("a"), "valua");
+  EXPECT_EQ(manager.Get("b"), "valub");
+  EXPECT_EQ(manager.Get("c"), "valuc");
+  EXPECT_EQ(manager.Get("d"), "");
+  EXPECT_GT(manager.GetMetricSet().GetAs<bptree::Counter>("mmap_legacy_block_count")->GetValue(), 0);
+}
+
+TEST(block, legacy_format_wal) {
+  bptree::BlockManagerOption option;
+  option.db_name = "test_block_legacy_wal";
+  option.neflag = bptree::NotExistFlag::CREATE;
+  option.eflag = bptree::ExistFlag::ERROR;
+  option.mode = bptree::Mode::WR;
+  option.key_size = 1;
+  option.value_size = 5;
+  {
+    bptree::BlockManager manager(option);
+    manager.Insert("a", "valua");
+  }
+  // 构造旧版本未完成回放的v1格式wal文件，其中的元数据日志记录的是旧版本block布局中的字段名
+  uint64_t log_number = 0;
+  auto legacy_log = [&](uint64_t seq, uint8_t type, const std::string& redo) -> std::string {
+    std::string body;
+    bptree::util::StringAppender(body, seq);
+    bptree::util::StringAppender(body, type);
+    bptree::util::StringAppender(body, redo);
+    bptree::util::StringAppender(body, std::string());
+    bptree::util::StringAppender(body, log_number++);
+    uint32_t crc = bptree::checksum::Crc32c(body.data(), body.size());
+    bptree::util::StringAppender(body, crc);
+    std::string result;
+    bptree::util::StringAppender(result, static_cast<uint32_t>(body.size()));
+    return result + body;
+  };
+  std::string meta_log;
+  bptree::util::StringAppender(meta_log, bptree::detail::LogTypeToUint8T(bptree::detail::LogType::BLOCK_META));
+  bptree::util::StringAppender(meta_log, uint32_t(1));
+  bptree::util::StringAppender(meta_log, std::string("head_entry"));
+  bptree::util::StringAppender(meta_log, uint32_t(0));
+  std::string wal_content = legacy_log(0, 0, "tx begin") + legacy_log(0, 2, meta_log) + legacy_log(0, 1, "tx end");
+  {
+    std::ofstream out(bptree::CreateWalNameByDB(option.db_name), std::ios::binary | std::ios::trunc);
+    out.write(wal_content.data(), wal_content.size());
+  }
+  auto read_file = [](const std::string& file_name) -> std::string {
+    std::ifstream in(file_name, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  };
+  std::string db_content = read_file(bptree::CreateDbFileNameByDB(option.db_name));
+
+  // 旧版本的日志不能在转换格式之后的block上回放，拒绝打开并且不修改db文件和wal文件
+  option.neflag = bptree::NotExistFlag::ERROR;
+  option.eflag = bptree::ExistFlag::SUCC;
+  EXPECT_THROW(bptree::BlockManager manager(option), bptree::BptreeExecption);
+  EXPECT_EQ(read_file(bptree::CreateDbFileNameByDB(option.db_name)), db_content);
+  EXPECT_EQ(read_file(bptree::CreateWalNameByDB(option.db_name)), wal_content);
+}
@@ -0,0 +1,73 @@
+#include "bptree/buffer_pool.h"
+
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+TEST(buffer_pool, base) {
+  const size_t frame_size = 16 * 1024;
+  bptree::BlockBufferPool pool(frame_size, 4096, 200, false);
+  size_t frames_per_slab = bptree::BlockBufferPool::slab_size / frame_size;
+  // 容量向上取整为slab的整数倍
+  EXPECT_EQ(pool.Capacity(), 2 * frames_per_slab);
+  EXPECT_EQ(pool.SlabFrameCount(), 0);
+  std::vector<char*> frames;
+  for (size_t i = 0; i < pool.Capacity(); ++i) {
+    char* frame = pool.Allocate();
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(frame) % 4096, 0);
+    memset(frame, 'a', frame_size);
+    frames.push_back(frame);
+  }
+  EXPECT_EQ(pool.SlabFrameCount(), pool.Capacity());
+  EXPECT_EQ(pool.FreeFrameCount(), 0);
+  EXPECT_EQ(pool.HeapAllocCount(), 0);
+  // 池中的frame耗尽时从堆上分配
+  char* heap_frame = pool.Allocate();
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(heap_frame) % 4096, 0);
+  EXPECT_EQ(pool.HeapAllocCount(), 1);
+  pool.Release(heap_frame);
+  EXPECT_EQ(pool.FreeFrameCount(), 0);
+  // 被释放的frame被下一次分配复用，不再申请新的slab
+  std::set<char*> released(frames.begin(), frames.begin() + 10);
+  for (auto it = released.begin(); it != released.end(); ++it) {
+    pool.Release(*it);
+  }
+  EXPECT_EQ(pool.FreeFrameCount(), 10);
+  for (size_t i = 0; i < 10; ++i) {
+    EXPECT_EQ(released.count(pool.Allocate()), 1);
+  }
+  EXPECT_EQ(pool.HeapAllocCount(), 1);
+  EXPECT_EQ(pool.SlabFrameCount(), pool.Capacity());
+  for (auto each : frames) {
+    pool.Release(each);
+  }
+  EXPECT_EQ(pool.FreeFrameCount(), pool.Capacity());
+}
+
+TEST(buffer_pool, huge_page) {
+  // 系统没有配置大页时退化为普通页
+  bptree::BlockBufferPool pool(16 * 1024, 4096, 1, true);
+  char* frame = pool.Allocate();
+  memset(frame, 'a', 16 * 1024);
+  EXPECT_EQ(pool.SlabFrameCount(), pool.Capacity());
+  EXPECT_EQ(pool.HeapAllocCount(), 0);
+  pool.Release(frame);
+}
+
+TEST(buffer_pool, object_free_list) {
+  bptree::ObjectFreeList list(64, 2);
+  void* p1 = list.Allocate(64);
+  void* p2 = list.Allocate(64);
+  void* p3 = list.Allocate(64);
+  list.Release(p1);
+  list.Release(p2);
+  // 超过max_free的对象直接释放
+  list.Release(p3);
+  EXPECT_EQ(list.FreeCount(), 2);
+  void* p4 = list.Allocate(64);
+  EXPECT_TRUE(p4 == p1 || p4 == p2);
+  list.Release(p4);
+}
@@ -1,3 +1,6 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -34,4 +37,238 @@ TEST(cache, all) {
     auto expect = std::list<uint32_t>{5, 3, 2};
     EXPECT_EQ(expect, cache.lru_list_);
   }
-}
\ No newline at end of file
+}
+TEST(cache, sharded) {
+  std::vector<uint32_t> free_keys;
+  // 容量64，最多分为4个分片，每个分片容量为16
+  bptree::ShardedCache<uint32_t, uint32_t> cache(64, 8);
+  EXPECT_EQ(cache.GetShardCount(), 4);
+  EXPECT_EQ(cache.GetCapacity(), 64);
+  cache.SetFreeNotify([&free_keys](const uint32_t& key, const uint32_t& value) -> void {
+    EXPECT_EQ(key, value);
+    free_keys.push_back(key);
+  });
+  auto shard_of = [&cache](uint32_t key) -> size_t {
+    size_t index = 0;
+    while (cache.shards_[index].get() != &cache.GetShard(key)) {
+      ++index;
+    }
+    return index;
+  };
+  // 按照分片选择key，将每个分片恰好填满
+  std::vector<std::vector<uint32_t>> shard_keys(cache.GetShardCount());
+  uint32_t key = 0;
+  for (size_t filled = 0; filled < 64; ++key) {
+    auto& keys = shard_keys[shard_of(key)];
+    if (keys.size() < 16) {
+      keys.push_back(key);
+      cache.Insert(key, std::unique_ptr<uint32_t>(new uint32_t(key)));
+      ++filled;
+    }
+  }
+  EXPECT_EQ(free_keys.empty(), true);
+  // 与shard_keys[0]位于同一分片的两个新key
+  std::vector<uint32_t> extra_keys;
+  for (; extra_keys.size() < 2; ++key) {
+    if (shard_of(key) == 0) {
+      extra_keys.push_back(key);
+    }
+  }
+  {
+    // 被持有的元素不会被淘汰
+    auto wrapper = cache.Get(shard_keys[0][0]);
+    cache.Insert(extra_keys[0], std::unique_ptr<uint32_t>(new uint32_t(extra_keys[0])));
+    cache.Insert(extra_keys[1], std::unique_ptr<uint32_t>(new uint32_t(extra_keys[1])));
+    EXPECT_EQ(wrapper.Get(), shard_keys[0][0]);
+  }
+  // 插入第二个新key时淘汰最久未使用的shard_keys[0][1]，释放shard_keys[0][0]之后分片再次超出容量，淘汰shard_keys[0][2]
+  auto expect = std::vector<uint32_t>{shard_keys[0][1], shard_keys[0][2]};
+  EXPECT_EQ(free_keys, expect);
+  EXPECT_EQ(cache.GetEntrySize(), 64);
+  EXPECT_EQ(cache.Get(shard_keys[0][1]).Exist(), false);
+  EXPECT_EQ(cache.Clear(), true);
+  EXPECT_EQ(free_keys.size(), 66);
+
+  // 按照分片数量的倍数分配的key也会分散到所有分片中
+  std::vector<size_t> shard_counts(cache.GetShardCount(), 0);
+  for (uint32_t i = 0; i < 1024; ++i) {
+    shard_counts[shard_of(i * cache.GetShardCount())] += 1;
+  }
+  for (auto count : shard_counts) {
+    EXPECT_GT(count, 1024 / cache.GetShardCount() / 2);
+  }
+
+  bptree::ShardedCache<uint32_t, uint32_t> small_cache(8, 8);
+  EXPECT_EQ(small_cache.GetShardCount(), 1);
+}
+
+TEST(cache, concurrent) {
+  std::atomic<size_t> free_count(0);
+  bptree::ShardedCache<uint32_t, uint32_t> cache(64, 4);
+  cache.SetFreeNotify([&free_count](const uint32_t&, const uint32_t&) -> void { free_count.fetch_add(1); });
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, t]() {
+      for (uint32_t i = 0; i < 10000; ++i) {
+        uint32_t key = (i * 7 + t) % 256;
+        auto wrapper = cache.GetOrInsert(key, std::unique_ptr<uint32_t>(new uint32_t(key)));
+        EXPECT_EQ(wrapper.Get(), key);
+        auto again = cache.Get(key);
+        EXPECT_EQ(again.Exist(), true);
+      }
+    });
+  }
+  for (auto& each : threads) {
+    each.join();
+  }
+  EXPECT_EQ(cache.GetEntrySize(), 64);
+  EXPECT_EQ(cache.Clear(), true);
+  EXPECT_EQ(cache.GetEntrySize(), 0);
+  EXPECT_EQ(free_count.load() >= 64, true);
+}
+
+TEST(cache, clock) {
+  std::vector<uint32_t> free_keys;
+  bptree::ShardedCache<uint32_t, uint32_t> cache(3, 1, bptree::CachePolicy::CLOCK);
+  cache.SetFreeNotify([&free_keys](const uint32_t& key, const uint32_t&) -> void { free_keys.push_back(key); });
+  // frames : 0 2 4，访问标志均为false
+  cache.Insert(0, std::unique_ptr<uint32_t>(new uint32_t(0)));
+  cache.Insert(2, std::unique_ptr<uint32_t>(new uint32_t(2)));
+  cache.Insert(4, std::unique_ptr<uint32_t>(new uint32_t(4)));
+  // 访问0，设置0的访问标志
+  cache.Get(0);
+  // 淘汰时跳过0（清除访问标志），淘汰2
+  cache.Insert(3, std::unique_ptr<uint32_t>(new uint32_t(3)));
+  {
+    auto expect = std::vector<uint32_t>{2};
+    EXPECT_EQ(free_keys, expect);
+  }
+  {
+    // 被持有的元素不会被淘汰。5使用2空出的frame，插入6时淘汰访问标志为false的4
+    auto wrapper = cache.Get(3);
+    cache.Insert(5, std::unique_ptr<uint32_t>(new uint32_t(5)));
+    cache.Insert(6, std::unique_ptr<uint32_t>(new uint32_t(6)));
+    auto expect = std::vector<uint32_t>{2, 4};
+    EXPECT_EQ(free_keys, expect);
+    EXPECT_EQ(wrapper.Get(), 3);
+  }
+  // 释放3时设置访问标志并触发淘汰，3获得第二次机会，淘汰6
+  {
+    auto expect = std::vector<uint32_t>{2, 4, 6};
+    EXPECT_EQ(free_keys, expect);
+  }
+  EXPECT_EQ(cache.GetEntrySize(), 3);
+  EXPECT_EQ(cache.Get(3).Exist(), true);
+  EXPECT_EQ(cache.Clear(), true);
+  EXPECT_EQ(cache.GetEntrySize(), 0);
+}
+
+TEST(cache, two_queue) {
+  bptree::ShardedCache<uint32_t, uint32_t> cache(8, 1, bptree::CachePolicy::TWO_QUEUE);
+  // 0和1被多次访问，进入热数据队列
+  for (int round = 0; round < 2; ++round) {
+    for (uint32_t key = 0; key < 2; ++key) {
+      auto wrapper = cache.GetOrInsert(key, std::unique_ptr<uint32_t>(new uint32_t(key)));
+    }
+  }
+  // 顺序扫描，每个key只访问一次
+  for (uint32_t key = 100; key < 200; ++key) {
+    auto wrapper = cache.GetOrInsert(key, std::unique_ptr<uint32_t>(new uint32_t(key)));
+  }
+  EXPECT_EQ(cache.Get(0).Exist(), true);
+  EXPECT_EQ(cache.Get(1).Exist(), true);
+  EXPECT_EQ(cache.Get(100).Exist(), false);
+  EXPECT_EQ(cache.Get(199).Exist(), true);
+  EXPECT_EQ(cache.GetEntrySize(), 8);
+
+  // 刚从probation队列淘汰的key再次插入时直接进入热数据队列，之后的扫描不会淘汰它
+  EXPECT_EQ(cache.Get(193).Exist(), false);
+  { auto wrapper = cache.GetOrInsert(193, std::unique_ptr<uint32_t>(new uint32_t(193))); }
+  for (uint32_t key = 300; key < 400; ++key) {
+    auto wrapper = cache.GetOrInsert(key, std::unique_ptr<uint32_t>(new uint32_t(key)));
+  }
+  EXPECT_EQ(cache.Get(193).Exist(), true);
+  EXPECT_EQ(cache.Get(0).Exist(), true);
+  EXPECT_EQ(cache.Clear(), true);
+
+  // 同样的访问模式下，LRU策略会淘汰0和1
+  bptree::ShardedCache<uint32_t, uint32_t> lru(8, 1, bptree::CachePolicy::LRU);
+  for (uint32_t key = 0; key < 2; ++key) {
+    auto wrapper = lru.GetOrInsert(key, std::unique_ptr<uint32_t>(new uint32_t(key)));
+  }
+  for (uint32_t key = 100; key < 200; ++key) {
+    auto wrapper = lru.GetOrInsert(key, std::unique_ptr<uint32_t>(new uint32_t(key)));
+  }
+  EXPECT_EQ(lru.Get(0).Exist(), false);
+}
+
+TEST(cache, high_priority) {
+  for (auto policy : {bptree::CachePolicy::LRU, bptree::CachePolicy::CLOCK, bptree::CachePolicy::TWO_QUEUE}) {
+    bptree::ShardedCache<uint32_t, uint32_t> cache(8, 1, policy, 2);
+    EXPECT_EQ(cache.GetHighPriorityCapacity(), 2);
+    for (uint32_t key = 0; key < 2; ++key) {
+      cache.Insert(key, std::unique_ptr<uint32_t>(new uint32_t(key)), true);
+    }
+    // 顺序扫描只会淘汰普通元素
+    for (uint32_t key = 100; key < 200; ++key) {
+      auto wrapper = cache.GetOrInsert(key, std::unique_ptr<uint32_t>(new uint32_t(key)));
+    }
+    EXPECT_EQ(cache.Get(0).Exist(), true);
+    EXPECT_EQ(cache.Get(1).Exist(), true);
+    EXPECT_EQ(cache.Get(100).Exist(), false);
+    EXPECT_EQ(cache.GetEntrySize(), 8);
+
+    // 高优先级元素超出保留的容量时，首先淘汰最久未使用的高优先级元素
+    { auto wrapper = cache.GetOrInsert(2, std::unique_ptr<uint32_t>(new uint32_t(2)), true); }
+    for (uint32_t key = 200; key < 300; ++key) {
+      auto wrapper = cache.GetOrInsert(key, std::unique_ptr<uint32_t>(new uint32_t(key)));
+    }
+    EXPECT_EQ(cache.Get(0).Exist(), false);
+    EXPECT_EQ(cache.Get(1).Exist(), true);
+    EXPECT_EQ(cache.Get(2).Exist(), true);
+    EXPECT_EQ(cache.Clear(), true);
+    EXPECT_EQ(cache.GetEntrySize(), 0);
+
+    // 没有其他可淘汰元素时，高优先级元素可以使用全部容量
+    for (uint32_t key = 0; key < 10; ++key) {
+      cache.Insert(key, std::unique_ptr<uint32_t>(new uint32_t(key)), true);
+    }
+    EXPECT_EQ(cache.GetEntrySize(), 8);
+    EXPECT_EQ(cache.Get(1).Exist(), false);
+    EXPECT_EQ(cache.Get(2).Exist(), true);
+  }
+}
+
+TEST(cache, notify_without_lock) {
+  bptree::LRUCache<uint32_t, uint32_t> cache(uint32_t(2));
+  std::atomic<bool> in_notify(false);
+  std::atomic<bool> release(false);
+  cache.SetFreeNotify([&](const uint32_t& key, const uint32_t&) -> void {
+    // 回调执行时不持有分片的锁，可以访问cache，被淘汰的key已经不在cache中
+    EXPECT_EQ(cache.Contains(key), false);
+    EXPECT_EQ(cache.Contains(1), true);
+    in_notify = true;
+    while (release.load() == false) {
+      std::this_thread::yield();
+    }
+  });
+  cache.Insert(0, std::unique_ptr<uint32_t>(new uint32_t(0)));
+  cache.Insert(1, std::unique_ptr<uint32_t>(new uint32_t(1)));
+  std::thread evict_thread([&]() { cache.Insert(2, std::unique_ptr<uint32_t>(new uint32_t(2))); });
+  while (in_notify.load() == false) {
+    std::this_thread::yield();
+  }
+  // 回调执行期间其他key的访问不会被阻塞
+  EXPECT_EQ(cache.Get(1).Get(), 1);
+  std::atomic<bool> waited(false);
+  std::thread wait_thread([&]() {
+    cache.WaitForEviction(0);
+    waited = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(waited.load(), false);
+  release = true;
+  evict_thread.join();
+  wait_thread.join();
+  EXPECT_EQ(waited.load(), true);
+}
@@ -0,0 +1,38 @@
+#include "bptree/checksum.h"
+
+#include <cstdlib>
+#include <string>
+
+#include "gtest/gtest.h"
+
+// https://reveng.sourceforge.io/crc-catalogue/17plus.htm#crc.cat.crc-32c
+
+TEST(checksum, crc32c) {
+  char buffer[] = "123456789";
+  EXPECT_EQ(bptree::checksum::Crc32cPortable(buffer, 9), 0xE3069283);
+  EXPECT_EQ(bptree::checksum::Crc32c(buffer, 9), 0xE3069283);
+  EXPECT_EQ(bptree::checksum::Crc32c(buffer, 0), 0);
+  std::string zeros(32, '\0');
+  EXPECT_EQ(bptree::checksum::Crc32c(zeros.data(), zeros.size()), 0x8A9136AA);
+}
+
+TEST(checksum, hardware) {
+#if defined(__x86_64__)
+  if (bptree::checksum::Crc32cHardwareSupported() == false) {
+    GTEST_SKIP() << "sse4.2 or pclmul is not supported";
+  }
+  std::string buf;
+  for (int i = 0; i < 4 * 16 * 1024 + 64; ++i) {
+    buf.push_back(static_cast<char>(rand()));
+  }
+  // 覆盖非对齐的起始位置以及交错计算的边界
+  for (size_t offset : {0, 1, 3, 7}) {
+    for (size_t n : {0, 1, 8, 100, 3 * 1024 - 1, 3 * 1024, 3 * 1024 + 9, 16 * 1024, 4 * 16 * 1024}) {
+      EXPECT_EQ(bptree::checksum::Crc32cHardware(&buf[offset], n),
+                bptree::checksum::Crc32cPortable(&buf[offset], n));
+    }
+  }
+#else
+  GTEST_SKIP() << "hardware crc32c is only implemented on x86_64";
+#endif
+}
@@ -0,0 +1,72 @@
+#include "bptree/cuckoo_filter.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+TEST(cuckoo_filter, base) {
+  bptree::CuckooFilter filter(10000);
+  for (int i = 0; i < 10000; ++i) {
+    filter.Add("key_" + std::to_string(i));
+  }
+  EXPECT_EQ(filter.Overflowed(), false);
+  EXPECT_EQ(filter.Size(), 10000);
+  // 插入过的key一定存在
+  for (int i = 0; i < 10000; ++i) {
+    EXPECT_TRUE(filter.MayContain("key_" + std::to_string(i)));
+  }
+  // 16位指纹，误判率约为 8 / 65536
+  size_t false_positive = 0;
+  for (int i = 10000; i < 110000; ++i) {
+    if (filter.MayContain("key_" + std::to_string(i)) == true) {
+      ++false_positive;
+    }
+  }
+  EXPECT_LT(false_positive, 100);
+  for (int i = 0; i < 10000; i += 2) {
+    filter.Remove("key_" + std::to_string(i));
+  }
+  EXPECT_EQ(filter.Size(), 5000);
+  size_t removed_but_contained = 0;
+  for (int i = 0; i < 10000; ++i) {
+    bool contain = filter.MayContain("key_" + std::to_string(i));
+    if (i % 2 == 1) {
+      EXPECT_TRUE(contain);
+    } else if (contain == true) {
+      ++removed_but_contained;
+    }
+  }
+  EXPECT_LT(removed_but_contained, 10);
+}
+
+TEST(cuckoo_filter, overflow) {
+  bptree::CuckooFilter filter(0);
+  size_t capacity = filter.BucketCount() * bptree::CuckooFilter::slots_per_bucket;
+  for (size_t i = 0; i < capacity * 2 && filter.Overflowed() == false; ++i) {
+    filter.Add("key_" + std::to_string(i));
+  }
+  EXPECT_TRUE(filter.Overflowed());
+  EXPECT_TRUE(filter.MayContain("not_exist"));
+}
+
+TEST(cuckoo_filter, serialize) {
+  bptree::CuckooFilter filter(1000);
+  for (int i = 0; i < 1000; ++i) {
+    filter.Add("key_" + std::to_string(i));
+  }
+  std::string data = filter.Serialize();
+  auto copy = bptree::CuckooFilter::Deserialize(data);
+  ASSERT_NE(copy, nullptr);
+  EXPECT_EQ(copy->Size(), 1000);
+  EXPECT_EQ(copy->BucketCount(), filter.BucketCount());
+  for (int i = 0; i < 2000; ++i) {
+    std::string key = "key_" + std::to_string(i);
+    EXPECT_EQ(copy->MayContain(key), filter.MayContain(key));
+  }
+  // 数据损坏或者不完整
+  std::string broken = data;
+  broken[broken.size() / 2] ^= 0x01;
+  EXPECT_EQ(bptree::CuckooFilter::Deserialize(broken), nullptr);
+  EXPECT_EQ(bptree::CuckooFilter::Deserialize(data.substr(0, data.size() - 1)), nullptr);
+  EXPECT_EQ(bptree::CuckooFilter::Deserialize(""), nullptr);
+}
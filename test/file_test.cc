@@ -1,6 +1,8 @@
 #include "bptree/file.h"
 
+#include <cstring>
 #include <new>
+#include <string>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -14,4 +16,38 @@ TEST(file, all) {
   char* buf2 = new ((std::align_val_t)512) char[1024];
   fh.Read(buf2, 1024, 0);
   EXPECT_EQ(buf2[0], 'h');
-}
\ No newline at end of file
+}
+
+TEST(file, batch) {
+  for (auto engine : {bptree::IoEngine::SYNC, bptree::IoEngine::IO_URING}) {
+    std::string name = std::string("test_batch_") + bptree::IoEngineStr(engine) + ".db";
+    bptree::FileHandler fh = bptree::FileHandler::CreateFile(name);
+    fh.SetIoEngine(engine, 4);
+    // 请求数量超过队列深度时分多次提交
+    const size_t count = 10;
+    const size_t size = 4096;
+    std::vector<char*> bufs;
+    std::vector<bptree::IoRequest> requests;
+    for (size_t i = 0; i < count; ++i) {
+      char* buf = new ((std::align_val_t)512) char[size];
+      memset(buf, 'a' + i, size);
+      bufs.push_back(buf);
+      requests.push_back(bptree::IoRequest{buf, size, i * size});
+    }
+    fh.WriteBatch(requests);
+    for (auto each : bufs) {
+      memset(each, 0, size);
+    }
+    fh.ReadBatch(requests);
+    for (size_t i = 0; i < count; ++i) {
+      EXPECT_EQ(bufs[i][0], 'a' + i);
+      EXPECT_EQ(bufs[i][size - 1], 'a' + i);
+    }
+    // 读到文件尾
+    std::vector<bptree::IoRequest> eof = {bptree::IoRequest{bufs[0], size, count * size}};
+    EXPECT_THROW(fh.ReadBatch(eof), bptree::BptreeExecption);
+    for (auto each : bufs) {
+      operator delete[](each, (std::align_val_t)512);
+    }
+  }
+}
@@ -11,4 +11,50 @@ TEST(key_comparator, all) {
   EXPECT_TRUE(cmp.Compare(std::string_view("a"), std::string_view("ab")) < 0);
   EXPECT_TRUE(cmp.Compare(std::string_view("a"), std::string_view("a")) == 0);
   EXPECT_TRUE(cmp.Compare(std::string_view("b"), std::string_view("a")) > 0);
-}
\ No newline at end of file
+}
+class ReverseComparator : public bptree::Comparator {
+ public:
+  int Compare(const std::string_view& v1, const std::string_view& v2) const override {
+    return bptree::Comparator::Compare(v2, v1);
+  }
+};
+
+TEST(key_comparator, abbreviated_key) {
+  bptree::Comparator cmp;
+  EXPECT_TRUE(cmp.SupportAbbreviatedKey());
+  EXPECT_EQ(cmp.AbbreviateKey(std::string_view("")), 0);
+  EXPECT_EQ(cmp.AbbreviateKey(std::string_view("\x01")), uint64_t(1) << 56);
+  EXPECT_EQ(cmp.AbbreviateKey(std::string_view("abcdefgh")), cmp.AbbreviateKey(std::string_view("abcdefghij")));
+  EXPECT_LT(cmp.AbbreviateKey(std::string_view("a")), cmp.AbbreviateKey(std::string_view("ab")));
+  EXPECT_LT(cmp.AbbreviateKey(std::string_view("abcdefg")), cmp.AbbreviateKey(std::string_view("abcdefh")));
+  // 按照无符号字节比较，与默认的Compare一致
+  EXPECT_LT(cmp.AbbreviateKey(std::string_view("\x7f")), cmp.AbbreviateKey(std::string_view("\x80")));
+  EXPECT_TRUE(cmp.Compare(std::string_view("\x7f"), std::string_view("\x80")) < 0);
+
+  ReverseComparator reverse;
+  EXPECT_FALSE(reverse.SupportAbbreviatedKey());
+}
+
+TEST(key_comparator, integer_key) {
+  bptree::Comparator bytewise;
+  bptree::BigEndianUInt64Comparator cmp64;
+  bptree::BigEndianUInt32Comparator cmp32;
+  EXPECT_EQ(bytewise.GetKeyKind(), bptree::KeyKind::BYTEWISE);
+  EXPECT_EQ(cmp64.GetKeyKind(), bptree::KeyKind::BIG_ENDIAN_UINT64);
+  EXPECT_EQ(cmp32.GetKeyKind(), bptree::KeyKind::BIG_ENDIAN_UINT32);
+  EXPECT_EQ(ReverseComparator().GetKeyKind(), bptree::KeyKind::CUSTOM);
+  // 大端存储的整数顺序与字节序一致
+  for (int i = 0; i < 1000; ++i) {
+    std::string k1, k2;
+    for (int j = 0; j < 8; ++j) {
+      k1.push_back(static_cast<char>(rand() % 4 == 0 ? 0xFF : rand()));
+      k2.push_back(static_cast<char>(j < 6 ? k1[j] : rand()));
+    }
+    int expect = bytewise.Compare(k1, k2);
+    EXPECT_EQ(cmp64.Compare(k1, k2), expect < 0 ? -1 : (expect > 0 ? 1 : 0));
+    EXPECT_EQ(cmp64.AbbreviateKey(k1), bytewise.AbbreviateKey(k1));
+    expect = bytewise.Compare(k1.substr(4), k2.substr(4));
+    EXPECT_EQ(cmp32.Compare(k1.substr(4), k2.substr(4)), expect < 0 ? -1 : (expect > 0 ? 1 : 0));
+    EXPECT_EQ(cmp32.AbbreviateKey(k1.substr(4)), bytewise.AbbreviateKey(k1.substr(4)));
+  }
+}
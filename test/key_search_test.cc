@@ -0,0 +1,44 @@
+#include "bptree/key_search.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+static std::vector<bptree::search::count_less_func> SupportedImpls() {
+  std::vector<bptree::search::count_less_func> result{bptree::search::detail::CountLessScalar};
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2")) {
+    result.push_back(bptree::search::detail::CountLessSse42);
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    result.push_back(bptree::search::detail::CountLessAvx2);
+  }
+#endif
+  return result;
+}
+
+TEST(key_search, lower_bound) {
+  auto impls = SupportedImpls();
+  // 包含重复值以及最高位为1的值，覆盖无符号比较和窗口边界
+  for (size_t n : {0, 1, 2, 3, 5, 31, 32, 33, 64, 100, 257}) {
+    std::vector<uint64_t> data;
+    for (size_t i = 0; i < n; ++i) {
+      uint64_t v = static_cast<uint64_t>(rand() % 64);
+      data.push_back(i % 2 == 0 ? v : v | (uint64_t(1) << 63));
+    }
+    std::sort(data.begin(), data.end());
+    for (uint64_t target : {uint64_t(0), uint64_t(1), uint64_t(17), uint64_t(64), uint64_t(1) << 63,
+                            (uint64_t(1) << 63) + 30, UINT64_MAX}) {
+      size_t expect = std::lower_bound(data.begin(), data.end(), target) - data.begin();
+      for (auto impl : impls) {
+        EXPECT_EQ(bptree::search::LowerBound(data.data(), n, target, impl), expect);
+      }
+      EXPECT_EQ(bptree::search::LowerBound(data.data(), n, target), expect);
+      EXPECT_EQ(bptree::search::UpperBound(data.data(), n, target),
+                std::upper_bound(data.begin(), data.end(), target) - data.begin());
+    }
+  }
+}
@@ -0,0 +1,49 @@
+#include "bptree/row_cache.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+TEST(row_cache, base) {
+  bptree::RowCache cache(1024 * 1024, 4);
+  EXPECT_EQ(cache.GetShardCount(), 4);
+  std::string value;
+  EXPECT_FALSE(cache.Lookup("a", value));
+  cache.Insert("a", "value_a");
+  cache.Insert("b", "value_b");
+  EXPECT_TRUE(cache.Lookup("a", value));
+  EXPECT_EQ(value, "value_a");
+  // 覆盖已有的value
+  cache.Insert("a", "new_a");
+  EXPECT_TRUE(cache.Lookup("a", value));
+  EXPECT_EQ(value, "new_a");
+  cache.Erase("a");
+  EXPECT_FALSE(cache.Lookup("a", value));
+  cache.Erase("not_exist");
+  EXPECT_TRUE(cache.Lookup("b", value));
+  EXPECT_EQ(value, "value_b");
+  EXPECT_EQ(cache.GetUsage(), 1 + 7 + bptree::RowCache::entry_overhead);
+}
+
+TEST(row_cache, evict) {
+  size_t charge = 8 + 8 + bptree::RowCache::entry_overhead;
+  bptree::RowCache cache(charge * 10, 1);
+  auto make_key = [](int n) -> std::string {
+    std::string key = std::to_string(n);
+    return std::string(8 - key.size(), '0') + key;
+  };
+  for (int i = 0; i < 10; ++i) {
+    cache.Insert(make_key(i), make_key(i));
+  }
+  std::string value;
+  // 访问0之后，最久没有被访问的是1
+  EXPECT_TRUE(cache.Lookup(make_key(0), value));
+  cache.Insert(make_key(10), make_key(10));
+  EXPECT_LE(cache.GetUsage(), cache.GetCapacity());
+  EXPECT_TRUE(cache.Lookup(make_key(0), value));
+  EXPECT_FALSE(cache.Lookup(make_key(1), value));
+  EXPECT_TRUE(cache.Lookup(make_key(10), value));
+  // 超过分片容量的元素不会被缓存
+  cache.Insert("big", std::string(charge * 10, 'a'));
+  EXPECT_FALSE(cache.Lookup("big", value));
+}
@@ -0,0 +1,133 @@
+#include "bptree/snapshot.h"
+
+#include <thread>
+
+#include "bptree/block_manager.h"
+#include "gtest/gtest.h"
+
+static std::string MakeKey(int n) {
+  std::string key = std::to_string(n);
+  return std::string(8 - key.size(), '0') + key;
+}
+
+TEST(snapshot, read) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::BlockManagerOption option;
+  option.db_name = "test_snapshot";
+  option.neflag = bptree::NotExistFlag::CREATE;
+  option.eflag = bptree::ExistFlag::ERROR;
+  option.mode = bptree::Mode::WR;
+  option.key_size = 8;
+  option.value_size = 8;
+  option.cache_size = 8;
+  bptree::BlockManager manager(option);
+
+  const int kv_count = 4000;
+  for (int i = 0; i < kv_count; i += 2) {
+    manager.Insert(MakeKey(i), MakeKey(i));
+  }
+  auto older_snapshot = manager.GetSnapshot();
+  {
+    auto snapshot = manager.GetSnapshot();
+    // 快照创建之后的插入（导致分裂）、删除（导致合并）和更新对快照不可见
+    for (int i = 1; i < kv_count; i += 2) {
+      manager.Insert(MakeKey(i), MakeKey(i));
+    }
+    for (int i = 0; i < kv_count; i += 4) {
+      manager.Delete(MakeKey(i));
+    }
+    for (int i = 2; i < kv_count; i += 4) {
+      manager.Update(MakeKey(i), "updated_");
+    }
+    for (int i = 0; i < kv_count; ++i) {
+      EXPECT_EQ(manager.Get(MakeKey(i), snapshot), i % 2 == 0 ? MakeKey(i) : "");
+    }
+    auto kvs = manager.GetRange(
+        MakeKey(0),
+        [](const bptree::Entry&) -> bptree::GetRangeOption { return bptree::GetRangeOption::SELECT; },
+        snapshot);
+    ASSERT_EQ(kvs.size(), kv_count / 2);
+    for (size_t i = 0; i < kvs.size(); ++i) {
+      EXPECT_EQ(kvs[i].first, MakeKey(i * 2));
+      EXPECT_EQ(kvs[i].second, MakeKey(i * 2));
+    }
+    // 起始key在快照中不存在
+    kvs = manager.GetRange(
+        MakeKey(1),
+        [](const bptree::Entry&) -> bptree::GetRangeOption { return bptree::GetRangeOption::SELECT; },
+        snapshot);
+    EXPECT_EQ(kvs.empty(), true);
+    // 从第一个大于等于起始key的位置开始
+    kvs = manager.GetRange(
+        MakeKey(1),
+        [](const bptree::Entry&) -> bptree::GetRangeOption { return bptree::GetRangeOption::SELECT; },
+        snapshot, bptree::RangeStart::GE);
+    ASSERT_EQ(kvs.size(), kv_count / 2 - 1);
+    EXPECT_EQ(kvs[0].first, MakeKey(2));
+    kvs = manager.GetRange(
+        MakeKey(2),
+        [](const bptree::Entry&) -> bptree::GetRangeOption { return bptree::GetRangeOption::SELECT; },
+        snapshot, bptree::RangeStart::GT);
+    ASSERT_EQ(kvs.size(), kv_count / 2 - 2);
+    EXPECT_EQ(kvs[0].first, MakeKey(4));
+  }
+  EXPECT_EQ(manager.Get(MakeKey(1), older_snapshot), "");
+  older_snapshot.reset();
+
+  auto snapshot = manager.GetSnapshot();
+  for (int i = 0; i < kv_count; ++i) {
+    EXPECT_EQ(manager.Get(MakeKey(i), snapshot), manager.Get(MakeKey(i)));
+  }
+}
+
+TEST(snapshot, concurrent_scan) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::BlockManagerOption option;
+  option.db_name = "test_snapshot_concurrent";
+  option.neflag = bptree::NotExistFlag::CREATE;
+  option.eflag = bptree::ExistFlag::ERROR;
+  option.mode = bptree::Mode::WR;
+  option.key_size = 8;
+  option.value_size = 8;
+  bptree::BlockManager manager(option);
+
+  const int kv_count = 4000;
+  for (int i = 0; i < kv_count; ++i) {
+    manager.Insert(MakeKey(i), MakeKey(i));
+  }
+  std::atomic<bool> stop(false);
+  std::thread writer([&]() {
+    int round = 0;
+    while (stop == false) {
+      // key 0不会被删除，作为范围查找的起点
+      for (int i = 2 + round % 2; i < kv_count; i += 2) {
+        if (round % 4 < 2) {
+          manager.Delete(MakeKey(i));
+        } else {
+          manager.Insert(MakeKey(i), MakeKey(i));
+        }
+      }
+      ++round;
+    }
+  });
+  for (int i = 0; i < 20; ++i) {
+    auto snapshot = manager.GetSnapshot();
+    auto kvs = manager.GetRange(
+        MakeKey(0),
+        [](const bptree::Entry&) -> bptree::GetRangeOption { return bptree::GetRangeOption::SELECT; },
+        snapshot);
+    auto again = manager.GetRange(
+        MakeKey(0),
+        [](const bptree::Entry&) -> bptree::GetRangeOption { return bptree::GetRangeOption::SELECT; },
+        snapshot);
+    // 同一个快照的两次扫描结果一致，并且结果有序
+    EXPECT_EQ(kvs, again);
+    ASSERT_EQ(kvs.empty(), false);
+    EXPECT_EQ(kvs[0].first, MakeKey(0));
+    for (size_t j = 1; j < kvs.size(); ++j) {
+      EXPECT_LT(kvs[j - 1].first, kvs[j].first);
+    }
+  }
+  stop = true;
+  writer.join();
+}
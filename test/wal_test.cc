@@ -1,5 +1,12 @@
 #include "bptree/wal.h"
 
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
 #include "crc32.h"
 #include "gtest/gtest.h"
 
@@ -9,7 +16,7 @@ TEST(wal, all) {
   int b = 0;
   int c = 0;
   int d = 0;
-  auto recover_func = [&](uint64_t seq, bptree::MsgType, std::string msg) -> void {
+  auto recover_func = [&](uint64_t, bptree::MsgType, std::string msg) -> void {
     assert(msg.size() == 3 && msg[1] == '=');
     if (msg[0] == 'a') {
       a = msg[2] - '0';
@@ -54,4 +61,174 @@ TEST(wal, all) {
   EXPECT_EQ(b, 4);
   EXPECT_EQ(c, 0);
   EXPECT_EQ(d, 0);
-}
\ No newline at end of file
+}
+TEST(wal, group_sync) {
+  spdlog::set_level(spdlog::level::info);
+  bptree::WriteAheadLog wal("bptree_wal_group_sync.log");
+  wal.RegisterLogHandler([](uint64_t, bptree::MsgType, std::string) -> void {});
+  wal.OpenFile();
+  wal.Recover();
+  const size_t thread_count = 8;
+  const size_t tx_per_thread = 50;
+  std::atomic<size_t> sync_count(0);
+  std::atomic<size_t> tx_count(0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&]() {
+      for (size_t i = 0; i < tx_per_thread; ++i) {
+        uint64_t seq = wal.RequestSeq();
+        wal.Begin(seq);
+        wal.WriteLog(seq, "a=1", "a=0");
+        wal.End(seq);
+        size_t batch = wal.GroupSync(thread_count, std::chrono::microseconds(2000));
+        if (batch > 0) {
+          sync_count.fetch_add(1);
+          tx_count.fetch_add(batch);
+        }
+      }
+    });
+  }
+  for (auto& each : threads) {
+    each.join();
+  }
+  // 每个提交都被计入某一次同步，并发的提交共享同步
+  EXPECT_EQ(tx_count.load(), thread_count * tx_per_thread);
+  EXPECT_LT(sync_count.load(), thread_count * tx_per_thread);
+  // 所有日志都已经同步，不需要再次同步
+  EXPECT_EQ(wal.GroupSync(1, std::chrono::microseconds(0)), 0);
+}
+
+TEST(wal, buffered_write) {
+  spdlog::set_level(spdlog::level::info);
+  const size_t log_count = 1000;
+  {
+    bptree::WriteAheadLog wal("bptree_wal_buffered.log");
+    wal.RegisterLogHandler([](uint64_t, bptree::MsgType, std::string) -> void {});
+    wal.OpenFile();
+    wal.Recover();
+    uint64_t seq = wal.RequestSeq();
+    wal.Begin(seq);
+    uint64_t log_number = 0;
+    for (size_t i = 0; i < log_count; ++i) {
+      log_number = wal.WriteLog(seq, "a=" + std::to_string(i), "");
+    }
+    wal.End(seq);
+    wal.EnsureLogFlush(log_number);
+    // 日志先追加到缓冲区中，由后台线程合并写入
+    EXPECT_LT(wal.FileWriteCount(), log_count);
+    // 析构时缓冲区中还没有写入的日志（事务结束日志）写入文件
+  }
+  size_t redo_count = 0;
+  size_t undo_count = 0;
+  bptree::WriteAheadLog wal("bptree_wal_buffered.log");
+  wal.RegisterLogHandler([&](uint64_t, bptree::MsgType type, std::string msg) -> void {
+    if (type == bptree::MsgType::Redo) {
+      EXPECT_EQ(msg, "a=" + std::to_string(redo_count));
+      redo_count += 1;
+    } else {
+      undo_count += 1;
+    }
+  });
+  wal.OpenFile();
+  wal.Recover();
+  EXPECT_EQ(redo_count, log_count);
+  EXPECT_EQ(undo_count, 0);
+}
+
+TEST(wal, compact_format) {
+  spdlog::set_level(spdlog::level::info);
+  const size_t log_count = 100;
+  {
+    bptree::WriteAheadLog wal("bptree_wal_compact.log");
+    wal.RegisterLogHandler([](uint64_t, bptree::MsgType, std::string) -> void {});
+    wal.OpenFile();
+    wal.Recover();
+    uint64_t seq = wal.RequestSeq();
+    wal.Begin(seq);
+    for (size_t i = 0; i < log_count; ++i) {
+      wal.WriteLog(seq, "a=1", "a=0");
+    }
+    wal.End(seq);
+    wal.Flush();
+    // v1格式每条日志有36字节的额外开销，v2格式中sequence和日志编号都只占用1字节
+    size_t header_size = sizeof(uint32_t) + sizeof(uint64_t);
+    EXPECT_LT(std::filesystem::file_size("bptree_wal_compact.log"), header_size + (log_count + 2) * 20);
+  }
+  // 日志编号按照差值编码，重新打开之后继续递增
+  {
+    bptree::WriteAheadLog wal("bptree_wal_compact.log");
+    wal.RegisterLogHandler([](uint64_t, bptree::MsgType, std::string) -> void {});
+    wal.OpenFile();
+    wal.Recover();
+    uint64_t seq = wal.RequestSeq();
+    EXPECT_EQ(seq, 1);
+    wal.Begin(seq);
+    EXPECT_EQ(wal.WriteLog(seq, "b=1", "b=0"), log_count + 3);
+    wal.End(seq);
+  }
+  size_t redo_count = 0;
+  bptree::WriteAheadLog wal("bptree_wal_compact.log");
+  wal.RegisterLogHandler([&](uint64_t, bptree::MsgType type, std::string) -> void {
+    EXPECT_EQ(type, bptree::MsgType::Redo);
+    redo_count += 1;
+  });
+  wal.OpenFile();
+  wal.Recover();
+  EXPECT_EQ(redo_count, log_count + 1);
+  EXPECT_EQ(wal.RequestSeq(), 2);
+}
+
+TEST(wal, legacy_format) {
+  spdlog::set_level(spdlog::level::info);
+  // 构造v1格式的wal文件：length + sequence + type + redo + undo + log_number + crc32c
+  uint64_t log_number = 0;
+  auto legacy_log = [&](uint64_t seq, uint8_t type, const std::string& redo, const std::string& undo) -> std::string {
+    std::string body;
+    bptree::util::StringAppender(body, seq);
+    bptree::util::StringAppender(body, type);
+    bptree::util::StringAppender(body, redo);
+    bptree::util::StringAppender(body, undo);
+    bptree::util::StringAppender(body, log_number++);
+    uint32_t crc = bptree::checksum::Crc32c(body.data(), body.size());
+    bptree::util::StringAppender(body, crc);
+    std::string result;
+    bptree::util::StringAppender(result, static_cast<uint32_t>(body.size()));
+    return result + body;
+  };
+  {
+    std::ofstream out("bptree_wal_legacy.log", std::ios::binary | std::ios::trunc);
+    std::string content = legacy_log(0, 0, "tx begin", "") + legacy_log(0, 2, "a=7", "a=0") +
+                          legacy_log(0, 1, "tx end", "") + legacy_log(1, 0, "tx begin", "") +
+                          legacy_log(1, 2, "b=5", "b=0");
+    out.write(content.data(), content.size());
+  }
+  int a = 0;
+  int b = 0;
+  auto handler = [&](uint64_t, bptree::MsgType, std::string msg) -> void {
+    if (msg[0] == 'a') {
+      a = msg[2] - '0';
+    } else if (msg[0] == 'b') {
+      b = msg[2] - '0';
+    }
+  };
+  {
+    bptree::WriteAheadLog wal("bptree_wal_legacy.log");
+    wal.RegisterLogHandler(handler);
+    wal.OpenFile();
+    wal.Recover();
+    EXPECT_EQ(a, 7);
+    EXPECT_EQ(b, 0);
+    // 重置之后以v2格式写入新的日志
+    wal.ResetLogFile();
+    uint64_t seq = wal.RequestSeq();
+    EXPECT_EQ(seq, 2);
+    wal.Begin(seq);
+    EXPECT_EQ(wal.WriteLog(seq, "b=3", "b=0"), log_number + 1);
+    wal.End(seq);
+  }
+  bptree::WriteAheadLog wal("bptree_wal_legacy.log");
+  wal.RegisterLogHandler(handler);
+  wal.OpenFile();
+  wal.Recover();
+  EXPECT_EQ(b, 3);
+}
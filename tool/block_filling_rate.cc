@@ -26,7 +26,7 @@ void PrintBlue(uint32_t index, double rate) { printf(" %5d - %f" blue " ■ " no
 
 void PrintBlock(uint32_t index, const bptree::Block* block) {
   double max = block->GetMaxEntrySize();
-  double used = block->GetKVView().size();
+  double used = block->GetKVCount();
   double filling_rate = used / max;
   if (filling_rate >= 0 && filling_rate < 0.2) {
     PrintWhite(index, filling_rate);